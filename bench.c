@@ -0,0 +1,385 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "rle/rle.h"
+#include "lz77/lz77.h"
+#include "lzss/lzss.h"
+#include "lz78/lz78.h"
+#include "huffman/huffman.h"
+#include "deflate/deflate.h"
+#include "utils/crc32.h"
+#include "utils/mem.h"
+
+#define DEFAULT_INPUT_FILE	"./data/miserables.txt"
+#define NR_RUNS			3
+#define CRC32_BENCH_BYTES	(1ULL << 30)
+#define SMALL_MIN_LEN		64
+#define SMALL_MAX_LEN		(16 * 1024)
+#define SMALL_NR_MESSAGES	2000
+
+/**
+ * @brief Codec (heap and caller buffer variants).
+ */
+struct codec {
+	const char *	name;
+	uint8_t *	(*compress)(uint8_t *, uint32_t, uint32_t *);
+	uint8_t *	(*uncompress)(uint8_t *, uint32_t, uint32_t *);
+	uint32_t	(*compress_bound)(uint32_t);
+	int		(*compress_into)(uint8_t *, uint32_t, uint8_t *, uint32_t, uint32_t *);
+	int		(*uncompress_into)(uint8_t *, uint32_t, uint8_t *, uint32_t, uint32_t *);
+};
+
+static const struct codec codecs[] = {
+	{ "RLE", rle_compress, rle_uncompress, rle_compress_bound, rle_compress_into, rle_uncompress_into },
+	{ "LZ77", lz77_compress, lz77_uncompress, lz77_compress_bound, lz77_compress_into, lz77_uncompress_into },
+	{ "LZSS", lzss_compress, lzss_uncompress, lzss_compress_bound, lzss_compress_into, lzss_uncompress_into },
+	{ "LZ78", lz78_compress, lz78_uncompress, lz78_compress_bound, lz78_compress_into, lz78_uncompress_into },
+	{ "HUFFMAN", huffman_compress, huffman_uncompress, huffman_compress_bound, huffman_compress_into, huffman_uncompress_into },
+	{ "DEFLATE", deflate_compress, deflate_uncompress, deflate_compress_bound, deflate_compress_into, deflate_uncompress_into },
+};
+
+/**
+ * @brief Read input file.
+ *
+ * @param input_file 		input file
+ * @param len 			file/buffer length
+ *
+ * @return content of file
+ */
+static uint8_t *read_input_file(const char *input_file, uint32_t *len)
+{
+	uint8_t *buf = NULL;
+	long size;
+	FILE *fp;
+
+	/* open input file */
+	fp = fopen(input_file, "r");
+	if (!fp) {
+		fprintf(stderr, "Can't open input file \"%s\"\n", input_file);
+		goto err;
+	}
+
+	/* get file size */
+	fseek(fp, 0, SEEK_END);
+	size = *len = ftell(fp);
+	rewind(fp);
+
+	/* check size */
+	if (size > UINT32_MAX) {
+		fprintf(stderr, "Input file \"%s\" is too big\n", input_file);
+		goto err;
+	}
+
+	/* allocate buffer */
+	buf = (uint8_t *) xmalloc(*len);
+
+	/* read file */
+	if (fread(buf, sizeof(uint8_t), *len, fp) != *len) {
+		fprintf(stderr, "Can't read input file \"%s\"\n", input_file);
+		goto err;
+	}
+
+	/* close input file */
+	fclose(fp);
+
+	return buf;
+err:
+	xfree(buf);
+	if (fp)
+		fclose(fp);
+	return NULL;
+}
+
+/**
+ * @brief Get wall clock time (threads run concurrently, so CPU time is meaningless).
+ *
+ * @return time in seconds
+ */
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * @brief CRC-32 benchmark : speed of each implementation.
+ * 
+ * @param src 		input buffer
+ * @param src_len 	input buffer length
+ */
+static void crc32_benchmark(uint8_t *src, uint32_t src_len)
+{
+	struct {
+		const char *	name;
+		uint32_t	(*crc32)(uint32_t, const uint8_t *, uint32_t);
+		int		supported;
+	} impls[] = {
+		{ "slice-by-8",		crc32_slice8,	1 },
+		{ "slice-by-16",	crc32_slice16,	1 },
+		{ "pclmul",		crc32_pclmul,	crc32_pclmul_supported() },
+		{ "best",		crc32_update,	1 },
+	};
+	uint32_t crc, ref = crc32_slice8(0, src, src_len), nr_loops, i, j;
+	double start, best;
+	int run;
+
+	/* print start message */
+	printf("********************** CRC-32 **********************\n");
+	printf("implementation      speed (GB/s)    status\n");
+
+	/* process about CRC32_BENCH_BYTES per run */
+	nr_loops = src_len ? CRC32_BENCH_BYTES / src_len + 1 : 0;
+
+	for (i = 0; i < sizeof(impls) / sizeof(impls[0]); i++) {
+		if (!impls[i].supported) {
+			printf("%-18s %13s    %s\n", impls[i].name, "-", "UNSUPPORTED");
+			continue;
+		}
+
+		/* keep best run */
+		for (run = 0, best = 0, crc = 0; run < NR_RUNS; run++) {
+			start = now();
+			for (j = 0; j < nr_loops; j++)
+				crc = impls[i].crc32(0, src, src_len);
+			if (run == 0 || now() - start < best)
+				best = now() - start;
+		}
+
+		printf("%-18s %13.2f    %s\n", impls[i].name, (double) src_len * nr_loops / best / 1e9, crc == ref ? "OK" : "ERROR");
+	}
+}
+
+/**
+ * @brief Parallel deflate benchmark : compression speed for 1, 2, 4... threads.
+ *
+ * @param src 		input buffer
+ * @param src_len 	input buffer length
+ * @param level 	compression level
+ */
+static void parallel_benchmark(uint8_t *src, uint32_t src_len, int level)
+{
+	uint32_t zip_len, unzip_len;
+	double start, best, base = 0;
+	int nr_cpus, nr_threads, i;
+	uint8_t *zip, *unzip;
+
+	/* print start message */
+	printf("********************** PARALLEL DEFLATE (level %d) **********************\n", level);
+	printf("threads      time (s)    speed (MB/s)    speedup    ratio    status\n");
+
+	nr_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	for (nr_threads = 1;; nr_threads = nr_threads * 2 < nr_cpus ? nr_threads * 2 : nr_cpus) {
+		/* keep best run */
+		for (i = 0, best = 0, zip = NULL; i < NR_RUNS; i++) {
+			xfree(zip);
+			start = now();
+			zip = deflate_compress_parallel(src, src_len, &zip_len, level, nr_threads);
+			if (i == 0 || now() - start < best)
+				best = now() - start;
+		}
+
+		/* check output */
+		unzip = deflate_uncompress(zip, zip_len, &unzip_len);
+
+		/* print statistics */
+		if (nr_threads == 1)
+			base = best;
+		printf("%7d %13f %15.2f %10.2f %8.3f    %s\n", nr_threads, best, src_len / best / 1e6, base / best,
+		       (double) src_len / (double) zip_len,
+		       unzip && src_len == unzip_len && memcmp(src, unzip, unzip_len) == 0 ? "OK" : "ERROR");
+
+		/* free memory */
+		xfree(zip);
+		xfree(unzip);
+
+		if (nr_threads >= nr_cpus)
+			break;
+	}
+}
+
+/**
+ * @brief Compare two latencies (for qsort).
+ */
+static int compare_latencies(const void *a, const void *b)
+{
+	double x = *((const double *) a), y = *((const double *) b);
+
+	return x < y ? -1 : x > y;
+}
+
+/**
+ * @brief Get a latency percentile.
+ * 
+ * @param latencies 	latencies (sorted in place)
+ * @param n 		number of latencies
+ * @param percentile 	percentile (0 to 100)
+ * 
+ * @return latency
+ */
+static double percentile(double *latencies, uint32_t n, uint32_t percentile)
+{
+	qsort(latencies, n, sizeof(double), compare_latencies);
+	return latencies[(uint64_t) (n - 1) * percentile / 100];
+}
+
+/**
+ * @brief Small messages benchmark : compression + decompression latency of each message, with a new
+ * context per call (deflate_compress_level/deflate_uncompress) or with reused contexts.
+ *
+ * @param src 		input buffer (messages are taken from it)
+ * @param src_len 	input buffer length
+ * @param level 	compression level
+ */
+static void small_messages_benchmark(uint8_t *src, uint32_t src_len, int level)
+{
+	double *oneshot = (double *) xmalloc(sizeof(double) * SMALL_NR_MESSAGES);
+	double *reused = (double *) xmalloc(sizeof(double) * SMALL_NR_MESSAGES);
+	struct deflate_uncompress_context uncompress_context;
+	struct deflate_compress_context compress_context;
+	uint32_t len, offset, zip_len, unzip_len, i;
+	uint8_t *zip, *unzip;
+	double start;
+	int ok;
+
+	/* print start message */
+	printf("********************** SMALL MESSAGES (level %d) **********************\n", level);
+	printf("size (B)    one shot p50/p99 (us)    context p50/p99 (us)    status\n");
+
+	deflate_compress_context_init(&compress_context, level);
+	deflate_uncompress_context_init(&uncompress_context);
+
+	for (len = SMALL_MIN_LEN; len <= SMALL_MAX_LEN && len <= src_len; len *= 4) {
+		for (i = 0, ok = 1, srand(len); i < SMALL_NR_MESSAGES; i++) {
+			offset = rand() % (src_len - len + 1);
+
+			/* new context per call */
+			start = now();
+			zip = deflate_compress_level(src + offset, len, &zip_len, level);
+			unzip = deflate_uncompress(zip, zip_len, &unzip_len);
+			oneshot[i] = now() - start;
+			ok &= unzip && unzip_len == len && memcmp(src + offset, unzip, len) == 0;
+			xfree(zip);
+			xfree(unzip);
+
+			/* reused contexts */
+			start = now();
+			zip = deflate_compress_with_context(&compress_context, src + offset, len, &zip_len);
+			unzip = deflate_uncompress_with_context(&uncompress_context, zip, zip_len, &unzip_len);
+			reused[i] = now() - start;
+			ok &= unzip && unzip_len == len && memcmp(src + offset, unzip, len) == 0;
+		}
+
+		printf("%8u %14.2f / %-9.2f %13.2f / %-9.2f %s\n", len,
+		       percentile(oneshot, SMALL_NR_MESSAGES, 50) * 1e6, percentile(oneshot, SMALL_NR_MESSAGES, 99) * 1e6,
+		       percentile(reused, SMALL_NR_MESSAGES, 50) * 1e6, percentile(reused, SMALL_NR_MESSAGES, 99) * 1e6,
+		       ok ? "OK" : "ERROR");
+	}
+
+	deflate_compress_context_free(&compress_context);
+	deflate_uncompress_context_free(&uncompress_context);
+	xfree(oneshot);
+	xfree(reused);
+}
+
+/**
+ * @brief Caller buffers benchmark : each codec with heap output buffers vs caller buffers (sized with compress bound).
+ *
+ * @param src 		input buffer
+ * @param src_len 	input buffer length
+ */
+static void caller_buffers_benchmark(uint8_t *src, uint32_t src_len)
+{
+	double start, zip_heap, zip_into, unzip_heap, unzip_into;
+	uint32_t zip_len, unzip_len, bound, i, j;
+	uint8_t *zip, *unzip, *dst, *out;
+	int ok;
+
+	/* print start message */
+	printf("********************** CALLER BUFFERS **********************\n");
+	printf("codec      heap zip (s)    into zip (s)    heap unzip (s)    into unzip (s)    status\n");
+
+	for (i = 0; i < sizeof(codecs) / sizeof(codecs[0]); i++) {
+		/* caller buffers */
+		bound = codecs[i].compress_bound(src_len);
+		dst = (uint8_t *) xmalloc(bound);
+		out = (uint8_t *) xmalloc(src_len);
+
+		/* keep best run */
+		zip_heap = zip_into = unzip_heap = unzip_into = 0;
+		for (j = 0, ok = 1; j < NR_RUNS; j++) {
+			start = now();
+			zip = codecs[i].compress(src, src_len, &zip_len);
+			if (j == 0 || now() - start < zip_heap)
+				zip_heap = now() - start;
+
+			start = now();
+			unzip = codecs[i].uncompress(zip, zip_len, &unzip_len);
+			if (j == 0 || now() - start < unzip_heap)
+				unzip_heap = now() - start;
+			ok &= unzip && unzip_len == src_len && memcmp(src, unzip, src_len) == 0;
+			xfree(zip);
+			xfree(unzip);
+
+			start = now();
+			ok &= codecs[i].compress_into(src, src_len, dst, bound, &zip_len) == 0;
+			if (j == 0 || now() - start < zip_into)
+				zip_into = now() - start;
+
+			start = now();
+			ok &= codecs[i].uncompress_into(dst, zip_len, out, src_len, &unzip_len) == 0;
+			if (j == 0 || now() - start < unzip_into)
+				unzip_into = now() - start;
+			ok &= unzip_len == src_len && memcmp(src, out, src_len) == 0;
+		}
+
+		printf("%-10s %12f %15f %17f %17f    %s\n", codecs[i].name, zip_heap, zip_into, unzip_heap, unzip_into,
+		       ok ? "OK" : "ERROR");
+
+		xfree(dst);
+		xfree(out);
+	}
+}
+
+int main(int argc, char **argv)
+{
+	const char *input_file;
+	uint32_t src_len;
+	uint8_t *src;
+	int level;
+
+	/* check arguments */
+	if (argc > 3) {
+		fprintf(stderr, "%s [input_file] [level]\n", argv[0]);
+		return 1;
+	}
+
+	/* set input file and level */
+	input_file = argc > 1 ? argv[1] : DEFAULT_INPUT_FILE;
+	level = argc > 2 ? atoi(argv[2]) : DEFLATE_LEVEL_DEFAULT;
+
+	/* read input file */
+	src = read_input_file(input_file, &src_len);
+	if (!src)
+		return 1;
+
+	/* CRC-32 benchmark */
+	crc32_benchmark(src, src_len);
+
+	/* parallel compression benchmark */
+	parallel_benchmark(src, src_len, level);
+
+	/* small messages benchmark */
+	small_messages_benchmark(src, src_len, level);
+
+	/* caller buffers benchmark */
+	caller_buffers_benchmark(src, src_len);
+
+	xfree(src);
+
+	return 0;
+}
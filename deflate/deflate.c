@@ -2,103 +2,276 @@
 #include <stdlib.h>
 #include <endian.h>
 #include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <math.h>
 
 #include "deflate.h"
 #include "lz77.h"
+#include "optimal.h"
+#include "split.h"
 #include "huffman.h"
+#include "fix_huffman.h"
+#include "dyn_huffman.h"
 #include "no_compression.h"
 #include "../utils/bit_stream.h"
 #include "../utils/byte_stream.h"
+#include "../utils/crc32.h"
+#include "../utils/match_copy.h"
 #include "../utils/mem.h"
 
 #define DEFLATE_BLOCK_SIZE			0xFFFF
 #define DEFLATE_COMPRESSION_NO			0
 #define DEFLATE_COMPRESSION_FIX_HUFFMAN		1
 #define DEFLATE_COMPRESSION_DYN_HUFFMAN		2
+#define DEFLATE_PARALLEL_CHUNK_SIZE		(128 * 1024)
+#define DEFLATE_DICTIONARY_SIZE			32768
+#define DEFLATE_STREAM_SLIDE_SIZE		65536
+#define DEFLATE_STREAM_WINDOW_SIZE		(2 * DEFLATE_STREAM_SLIDE_SIZE + DEFLATE_DICTIONARY_SIZE)
+#define DEFLATE_MAX_MATCH_LEN			258
+#define DEFLATE_ENTROPY_SAMPLE_STEP		4
+#define DEFLATE_INCOMPRESSIBLE_ENTROPY		7.9
+#define DEFLATE_REPEAT_PROBE_BITS		12
+#define DEFLATE_MAX_HEADER_SIZE			1024
+#define DEFLATE_UNCOMPRESS_INPUT_SIZE		65536
+#define DEFLATE_UNCOMPRESS_WINDOW_SIZE		65536
+
+#define DEFLATE_UNCOMPRESS_HEADER		0
+#define DEFLATE_UNCOMPRESS_STORED		1
+#define DEFLATE_UNCOMPRESS_HUFFMAN		2
+#define DEFLATE_UNCOMPRESS_TRAILER		3
+#define DEFLATE_UNCOMPRESS_END			4
+#define DEFLATE_UNCOMPRESS_ERROR		5
 
 /**
- * @brief CRC table.
+ * @brief Write a block.
+ * 
+ * Exact length of each compression method is computed from LZ77 tokens frequencies
+ * and huffman codes lengths : only the shortest one is encoded.
+ * 
+ * @param tokens 		LZ77 tokens (with frequencies)
+ * @param block 		input block
+ * @param block_len 		input block length
+ * @param last_block 		last block ?
+ * @param bs_out 		output bit stream
  */
-static const uint32_t crc32_tab[16] = {
-	0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190,
-	0x6B6B51F4, 0x4DB26158, 0x5005713C, 0xEDB88320, 0xF00F9344,
-	0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278,
-	0xBDBDF21C
-};
+static void __write_block(struct lz77_tokens *tokens, uint8_t *block, uint16_t block_len, int last_block, struct bit_stream *bs_out)
+{
+	struct huffman_table table_dyn_lit, table_dyn_dist;
+	uint32_t bit_pos, fix_huff_len, dyn_huff_len, no_len;
+
+	/* build dynamic huffman tables */
+	deflate_huffman_build_dynamic_tables(tokens, &table_dyn_lit, &table_dyn_dist);
+
+	/* compute output length (in bytes) of each compression method */
+	bit_pos = bs_out->byte_offset * 8 + bs_out->bit_offset + 3;
+	fix_huff_len = (bit_pos + deflate_huffman_compressed_len(tokens, &deflate_huffman_fix_table_lit, &deflate_huffman_fix_table_dist)) / 8;
+	dyn_huff_len = (bit_pos + deflate_huffman_tables_len(&table_dyn_lit, &table_dyn_dist)
+			+ deflate_huffman_compressed_len(tokens, &table_dyn_lit, &table_dyn_dist)) / 8;
+	no_len = (bit_pos + 7) / 8 + 4 + block_len;
+
+	/* encode block with best compression method */
+	bit_stream_write_bits(bs_out, last_block, 1, BIT_ORDER_LSB);
+	if (fix_huff_len <= dyn_huff_len && fix_huff_len <= no_len) {
+		bit_stream_write_bits(bs_out, DEFLATE_COMPRESSION_FIX_HUFFMAN, 2, BIT_ORDER_LSB);
+		deflate_huffman_compress(tokens, &deflate_huffman_fix_table_lit, &deflate_huffman_fix_table_dist, bs_out, 0);
+	} else if (dyn_huff_len <= no_len) {
+		bit_stream_write_bits(bs_out, DEFLATE_COMPRESSION_DYN_HUFFMAN, 2, BIT_ORDER_LSB);
+		deflate_huffman_compress(tokens, &table_dyn_lit, &table_dyn_dist, bs_out, 1);
+	} else {
+		bit_stream_write_bits(bs_out, DEFLATE_COMPRESSION_NO, 2, BIT_ORDER_MSB);
+		deflate_no_compression_compress(block, block_len, bs_out);
+	}
+
+	/* last block : flush last byte */
+	if (last_block)
+		bit_stream_flush(bs_out);
+
+	/* free dynamic huffman tables */
+	huffman_table_free(&table_dyn_lit);
+	huffman_table_free(&table_dyn_dist);
+}
 
 /**
- * @brief Compute CRC of a buffer.
+ * @brief Check if a block looks incompressible (high entropy and no repeated strings).
+ * 
+ * Entropy is estimated on sampled bytes. Repeated strings are probed on positions chosen from their
+ * content, so that both copies of a string are probed (previous 32 KiB included, matches may refer to them).
  * 
- * @param buf 		input buffer
- * @param length 	input buffer length
- * @param crc 		initial value
+ * @param src 			input buffer
+ * @param start 		block start
+ * @param block_len 		input block length
  * 
- * @return crc
+ * @return 1 if LZ77 and huffman coding are not worth trying
  */
-uint32_t __crc32(const uint8_t *buf, uint32_t length, uint32_t crc)
+static int __block_is_incompressible(uint8_t *src, uint32_t start, uint32_t block_len)
 {
-	uint32_t i;
+	uint8_t *block = src + start;
+	uint32_t freqs[256] = { 0 }, probes[1 << DEFLATE_REPEAT_PROBE_BITS] = { 0 }, nr_samples = 0, nr_probes = 0, nr_repeats = 0;
+	uint32_t value, h, i;
+	double entropy = 0, p;
+
+	/* order 0 entropy of sampled bytes */
+	for (i = 0; i < block_len; i += DEFLATE_ENTROPY_SAMPLE_STEP, nr_samples++)
+		freqs[block[i]]++;
+	for (i = 0; i < 256; i++) {
+		if (freqs[i]) {
+			p = (double) freqs[i] / nr_samples;
+			entropy -= p * log2(p);
+		}
+	}
 
-	for (i = 0; i < length; i++) {
-		crc ^= buf[i];
-		crc = crc32_tab[crc & 0x0F] ^ (crc >> 4);
-		crc = crc32_tab[crc & 0x0F] ^ (crc >> 4);
+	if (entropy < DEFLATE_INCOMPRESSIBLE_ENTROPY)
+		return 0;
+
+	/* repeated 4 bytes strings (one position out of 4 is probed, previous 32 KiB only fill the probes) */
+	for (i = start > DEFLATE_DICTIONARY_SIZE ? start - DEFLATE_DICTIONARY_SIZE : 0; i < start; i++) {
+		memcpy(&value, src + i, sizeof(uint32_t));
+		h = value * 2654435761U;
+		if (!(h >> 30))
+			probes[(h >> (30 - DEFLATE_REPEAT_PROBE_BITS)) & ((1 << DEFLATE_REPEAT_PROBE_BITS) - 1)] = value;
 	}
+	for (i = 0; i + sizeof(uint32_t) <= block_len; i++) {
+		memcpy(&value, block + i, sizeof(uint32_t));
+		h = value * 2654435761U;
+		if (h >> 30)
+			continue;
 
-	return ~crc;
+		h = (h >> (30 - DEFLATE_REPEAT_PROBE_BITS)) & ((1 << DEFLATE_REPEAT_PROBE_BITS) - 1);
+		if (probes[h] == value)
+			nr_repeats++;
+		probes[h] = value;
+		nr_probes++;
+	}
+
+	return nr_repeats * 64 <= nr_probes;
 }
 
 /**
- * @brief Compress a block.
+ * @brief Compress a block (split in several blocks where symbols statistics change, on levels with block splitting).
  * 
- * @param block 		input block
+ * @param ctx 			LZ77 context
+ * @param tokens 		LZ77 tokens buffer
+ * @param src 			input buffer
+ * @param start 		block start
  * @param block_len 		input block length
  * @param last_block 		last block ?
- * @param bs_fix_huff 		fix huffman bit stream
- * @param bs_dyn_huff 		dynamic huffman bit stream
- * @param bs_no 		no compression bit stream
- * 
- * @return output bit stream (with best compression)
- */
-static struct bit_stream *__compress_block(uint8_t *block, uint16_t block_len, int last_block,
-					   struct bit_stream *bs_fix_huff,
-					   struct bit_stream *bs_dyn_huff,
-					   struct bit_stream *bs_no)
-{
-	struct lz77_node *lz77_nodes;
-	struct bit_stream *bs;
-
-	/* lz77 compression */
-	lz77_nodes = deflate_lz77_compress(block, block_len);
-
-	/* fix huffman compression */
-	bit_stream_write_bits(bs_fix_huff, last_block, 1, BIT_ORDER_LSB);
-	bit_stream_write_bits(bs_fix_huff, DEFLATE_COMPRESSION_FIX_HUFFMAN, 2, BIT_ORDER_LSB);
-	deflate_huffman_compress(lz77_nodes, bs_fix_huff, 0);
-
-	/* dynamic huffman compression */
-	bit_stream_write_bits(bs_dyn_huff, last_block, 1, BIT_ORDER_LSB);
-	bit_stream_write_bits(bs_dyn_huff, DEFLATE_COMPRESSION_DYN_HUFFMAN, 2, BIT_ORDER_LSB);
-	deflate_huffman_compress(lz77_nodes, bs_dyn_huff, 1);
-
-	/* no compression */
-	bit_stream_write_bits(bs_no, last_block, 1, BIT_ORDER_LSB);
-	bit_stream_write_bits(bs_no, DEFLATE_COMPRESSION_NO, 2, BIT_ORDER_MSB);
-	deflate_no_compression_compress(block, block_len, bs_no);
-
-	/* choose best compression method */
-	if (bs_fix_huff->byte_offset <= bs_dyn_huff->byte_offset && bs_fix_huff->byte_offset <= bs_no->byte_offset)
-		bs = bs_fix_huff;
-	else if (bs_dyn_huff->byte_offset <= bs_no->byte_offset)
-		bs = bs_dyn_huff;
+ * @param bs_out 		output bit stream
+ */
+static void __compress_block(struct lz77_context *ctx, struct lz77_tokens *tokens, uint8_t *src, uint32_t start,
+			     uint16_t block_len, int last_block, struct bit_stream *bs_out)
+{
+	uint32_t ends[DEFLATE_SPLIT_MAX_BLOCKS], nr_blocks, first, len, i;
+	struct lz77_tokens slice;
+
+	/* incompressible block : skip lz77 and store it (next blocks may still match into it) */
+	if (__block_is_incompressible(src, start, block_len)) {
+		bit_stream_write_bits(bs_out, last_block, 1, BIT_ORDER_LSB);
+		bit_stream_write_bits(bs_out, DEFLATE_COMPRESSION_NO, 2, BIT_ORDER_LSB);
+		deflate_no_compression_compress(src + start, block_len, bs_out);
+		deflate_lz77_skip(ctx, src, start, start + block_len);
+		return;
+	}
+
+	/* lz77 compression (optimal parsing on highest levels) */
+	deflate_lz77_tokens_reset(tokens);
+	if (ctx->config->optimal_passes)
+		deflate_optimal_compress(ctx, src, start, start + block_len, tokens);
 	else
-		bs = bs_no;
+		deflate_lz77_compress(ctx, src, start, start + block_len, tokens);
 
-	/* last block : flush last byte */
-	if (last_block)
-		bit_stream_flush(bs);
+	/* fixed size block */
+	if (!ctx->config->block_split) {
+		__write_block(tokens, src + start, block_len, last_block, bs_out);
+		return;
+	}
 
-	return bs;
+	/* split block and write each part */
+	nr_blocks = deflate_split_block(tokens, ends);
+	for (i = 0, first = 0; i < nr_blocks; first = ends[i++]) {
+		len = deflate_lz77_tokens_slice(tokens, first, ends[i], &slice);
+		__write_block(&slice, src + start, len, last_block && i == nr_blocks - 1, bs_out);
+		start += len;
+	}
+}
+
+/**
+ * @brief Compress a chunk (sequence of blocks).
+ * 
+ * @param ctx 			LZ77 context
+ * @param tokens 		LZ77 tokens buffer
+ * @param src 			input buffer
+ * @param start 		chunk start
+ * @param end 			chunk end
+ * @param last_chunk 		last chunk ? (otherwise chunk ends with an empty stored block, on a byte boundary)
+ * @param bs 			blocks bit stream (working buffer)
+ * @param bs_out 		output byte stream
+ * @param crc 			CRC (updated block by block, while input is still in cache)
+ */
+static void __compress_chunk(struct lz77_context *ctx, struct lz77_tokens *tokens, uint8_t *src, uint32_t start, uint32_t end,
+			     int last_chunk, struct bit_stream *bs, struct byte_stream *bs_out, uint32_t *crc)
+{
+	uint16_t block_len;
+	int last_block = 0;
+
+	/* clear bit stream */
+	bs->byte_offset = 0;
+	bs->bit_offset = 0;
+
+	/* compress block by block (at least one block) */
+	do {
+		/* compute block length */
+		block_len = DEFLATE_BLOCK_SIZE;
+		if (end - start <= block_len) {
+			block_len = end - start;
+			last_block = last_chunk;
+		}
+
+		/* compress block */
+		__compress_block(ctx, tokens, src, start, block_len, last_block, bs);
+		*crc = crc32_update(*crc, src + start, block_len);
+		start += block_len;
+
+		/* copy bit stream to output buffer */
+		byte_stream_write(bs_out, bs->buf, bs->byte_offset);
+
+		/* clear bit stream (remember last byte) */
+		bs->buf[0] = bs->buf[bs->byte_offset];
+		bs->byte_offset = 0;
+	} while (start < end);
+
+	/* not last chunk : go to next byte with an empty stored block (sync flush) */
+	if (!last_chunk) {
+		bit_stream_write_bits(bs, 0, 1, BIT_ORDER_LSB);
+		bit_stream_write_bits(bs, DEFLATE_COMPRESSION_NO, 2, BIT_ORDER_LSB);
+		deflate_no_compression_compress(NULL, 0, bs);
+		byte_stream_write(bs_out, bs->buf, bs->byte_offset);
+	}
+}
+
+/**
+ * @brief Compress a buffer with a compression context to a byte stream.
+ * 
+ * @param context 	compression context
+ * @param src 		input buffer
+ * @param src_len 	input buffer length
+ * @param bs_out 	output byte stream
+ */
+static void __compress_with_context(struct deflate_compress_context *context, uint8_t *src, uint32_t src_len, struct byte_stream *bs_out)
+{
+	uint32_t crc = 0;
+
+	/* reset lz77 context (hash tables are scaled to input length) */
+	deflate_lz77_context_reset(&context->ctx, src_len);
+
+	/* compress whole buffer as one chunk */
+	__compress_chunk(&context->ctx, &context->tokens, src, 0, src_len, 1, &context->bs, bs_out, &crc);
+
+	/* write crc */
+	byte_stream_write_u32(bs_out, htole32(crc));
+
+	/* write uncompressed length */
+	byte_stream_write_u32(bs_out, htole32(src_len));
 }
 
 /**
@@ -112,43 +285,313 @@ static struct bit_stream *__compress_block(uint8_t *block, uint16_t block_len, i
  */
 uint8_t *deflate_compress(uint8_t *src, uint32_t src_len, uint32_t *dst_len)
 {
-	struct bit_stream bs_fix_huff = { 0 }, bs_dyn_huff = { 0 }, bs_no = { 0 }, *bs;
+	return deflate_compress_level(src, src_len, dst_len, DEFLATE_LEVEL_DEFAULT);
+}
+
+/**
+ * @brief Compute maximum compressed length.
+ * 
+ * Each block (at most DEFLATE_SPLIT_MAX_BLOCKS per DEFLATE_BLOCK_SIZE bytes, each one holding at least one byte)
+ * is never longer than a stored block : header, padding and length take at most 6 bytes. Last byte and trailer follow.
+ * 
+ * @param len 		input buffer length
+ *
+ * @return maximum output buffer length
+ */
+uint32_t deflate_compress_bound(uint32_t len)
+{
+	uint32_t nr_blocks;
+
+	nr_blocks = (len / DEFLATE_BLOCK_SIZE + 1) * DEFLATE_SPLIT_MAX_BLOCKS;
+	if (nr_blocks > len + 1)
+		nr_blocks = len + 1;
+
+	return len + 6 * nr_blocks + 1 + 2 * sizeof(uint32_t);
+}
+
+/**
+ * @brief Compress a buffer with deflate algorithm into a caller buffer.
+ * 
+ * @param src 		input buffer
+ * @param src_len 	input buffer length
+ * @param dst 		output buffer
+ * @param dst_cap 	output buffer capacity
+ * @param dst_len 	output buffer length (needed length if output buffer is too small)
+ *
+ * @return 0 on success, -1 if output buffer is too small
+ */
+int deflate_compress_into(uint8_t *src, uint32_t src_len, uint8_t *dst, uint32_t dst_cap, uint32_t *dst_len)
+{
+	return deflate_compress_level_into(src, src_len, dst, dst_cap, dst_len, DEFLATE_LEVEL_DEFAULT);
+}
+
+/**
+ * @brief Compress a buffer with deflate algorithm and a compression level.
+ * 
+ * @param src 		input buffer
+ * @param src_len 	input buffer length
+ * @param dst_len 	output buffer length
+ * @param level 	compression level (from 1 = fastest to 12 = best compression, 10 to 12 = optimal parsing)
+ *
+ * @return output buffer
+ */
+uint8_t *deflate_compress_level(uint8_t *src, uint32_t src_len, uint32_t *dst_len, int level)
+{
+	struct deflate_compress_context context;
+	uint8_t *dst;
+
+	/* compress with a temporary context */
+	deflate_compress_context_init(&context, level);
+	dst = deflate_compress_with_context(&context, src, src_len, dst_len);
+
+	/* keep output buffer */
+	context.out.buf = NULL;
+	deflate_compress_context_free(&context);
+
+	return dst;
+}
+
+/**
+ * @brief Compress a buffer with deflate algorithm and a compression level into a caller buffer.
+ * 
+ * @param src 		input buffer
+ * @param src_len 	input buffer length
+ * @param dst 		output buffer
+ * @param dst_cap 	output buffer capacity
+ * @param dst_len 	output buffer length (needed length if output buffer is too small)
+ * @param level 	compression level (from 1 = fastest to 12 = best compression, 10 to 12 = optimal parsing)
+ *
+ * @return 0 on success, -1 if output buffer is too small
+ */
+int deflate_compress_level_into(uint8_t *src, uint32_t src_len, uint8_t *dst, uint32_t dst_cap, uint32_t *dst_len, int level)
+{
+	struct deflate_compress_context context;
+	int ret;
+
+	/* compress with a temporary context */
+	deflate_compress_context_init(&context, level);
+	ret = deflate_compress_with_context_into(&context, src, src_len, dst, dst_cap, dst_len);
+	deflate_compress_context_free(&context);
+
+	return ret;
+}
+
+/**
+ * @brief Init a compression context.
+ * 
+ * @param context 	compression context
+ * @param level 	compression level (from 1 = fastest to 12 = best compression, 10 to 12 = optimal parsing)
+ */
+void deflate_compress_context_init(struct deflate_compress_context *context, int level)
+{
+	memset(context, 0, sizeof(struct deflate_compress_context));
+
+	/* create lz77 context and tokens buffer */
+	deflate_lz77_context_init(&context->ctx, level);
+	deflate_lz77_tokens_init(&context->tokens);
+}
+
+/**
+ * @brief Compress a buffer with a compression context (input sized buffers are not reallocated once they have grown).
+ * 
+ * @param context 	compression context
+ * @param src 		input buffer
+ * @param src_len 	input buffer length
+ * @param dst_len 	output buffer length
+ *
+ * @return output buffer (owned by context, valid until next call)
+ */
+uint8_t *deflate_compress_with_context(struct deflate_compress_context *context, uint8_t *src, uint32_t src_len, uint32_t *dst_len)
+{
+	/* reset output */
+	context->out.size = 0;
+
+	/* compress */
+	__compress_with_context(context, src, src_len, &context->out);
+
+	/* set destination length */
+	*dst_len = context->out.size;
+
+	return context->out.buf;
+}
+
+/**
+ * @brief Compress a buffer with a compression context into a caller buffer.
+ * 
+ * @param context 	compression context
+ * @param src 		input buffer
+ * @param src_len 	input buffer length
+ * @param dst 		output buffer
+ * @param dst_cap 	output buffer capacity
+ * @param dst_len 	output buffer length (needed length if output buffer is too small)
+ *
+ * @return 0 on success, -1 if output buffer is too small
+ */
+int deflate_compress_with_context_into(struct deflate_compress_context *context, uint8_t *src, uint32_t src_len, uint8_t *dst,
+				       uint32_t dst_cap, uint32_t *dst_len)
+{
+	struct byte_stream out = { 0 };
+
+	/* set output byte stream */
+	out.buf = dst;
+	out.capacity = dst_cap;
+	out.fixed = 1;
+
+	/* compress */
+	__compress_with_context(context, src, src_len, &out);
+
+	/* set destination length */
+	*dst_len = out.size;
+
+	return *dst_len > dst_cap ? -1 : 0;
+}
+
+/**
+ * @brief Free a compression context.
+ * 
+ * @param context 	compression context
+ */
+void deflate_compress_context_free(struct deflate_compress_context *context)
+{
+	deflate_lz77_context_free(&context->ctx);
+	deflate_lz77_tokens_free(&context->tokens);
+	xfree(context->bs.buf);
+	xfree(context->out.buf);
+}
+
+/**
+ * @brief Parallel compression job (shared by all workers).
+ */
+struct deflate_parallel_job {
+	uint8_t *			src;		/* input buffer */
+	uint32_t			src_len;	/* input buffer length */
+	int				level;		/* compression level */
+	uint32_t			nr_chunks;	/* number of chunks */
+	uint32_t			next_chunk;	/* next chunk to compress */
+	pthread_mutex_t			lock;		/* next chunk lock */
+	struct byte_stream *		outputs;	/* compressed chunks */
+	uint32_t *			crcs;		/* chunks CRCs */
+};
+
+/**
+ * @brief Parallel compression worker : compress chunks until there is none left.
+ * 
+ * @param arg 		parallel job
+ * 
+ * @return NULL
+ */
+static void *__compress_worker(void *arg)
+{
+	struct deflate_parallel_job *job = (struct deflate_parallel_job *) arg;
+	struct bit_stream bs = { 0 };
+	uint32_t chunk, start, end;
+	struct lz77_tokens tokens;
+	struct lz77_context ctx;
+
+	/* create lz77 context and working buffers once (reused by all chunks) */
+	deflate_lz77_context_init(&ctx, job->level);
+	deflate_lz77_tokens_init(&tokens);
+
+	for (;;) {
+		/* get next chunk */
+		pthread_mutex_lock(&job->lock);
+		chunk = job->next_chunk++;
+		pthread_mutex_unlock(&job->lock);
+		if (chunk >= job->nr_chunks)
+			break;
+
+		/* compute chunk bounds */
+		start = chunk * DEFLATE_PARALLEL_CHUNK_SIZE;
+		end = job->src_len - start > DEFLATE_PARALLEL_CHUNK_SIZE ? start + DEFLATE_PARALLEL_CHUNK_SIZE : job->src_len;
+
+		/* prime lz77 context with previous 32 KiB */
+		deflate_lz77_context_reset(&ctx, end);
+		deflate_lz77_prime(&ctx, job->src, start > DEFLATE_DICTIONARY_SIZE ? start - DEFLATE_DICTIONARY_SIZE : 0, start);
+
+		/* compress chunk */
+		job->crcs[chunk] = 0;
+		__compress_chunk(&ctx, &tokens, job->src, start, end, chunk == job->nr_chunks - 1, &bs, &job->outputs[chunk],
+				 &job->crcs[chunk]);
+	}
+
+	deflate_lz77_context_free(&ctx);
+	deflate_lz77_tokens_free(&tokens);
+	xfree(bs.buf);
+
+	return NULL;
+}
+
+/**
+ * @brief Compress a buffer with deflate algorithm on several threads.
+ * 
+ * Input is split in chunks compressed in parallel, each chunk using previous 32 KiB as dictionary.
+ * Chunks end on a byte boundary (empty stored block), so they are just concatenated.
+ * 
+ * @param src 		input buffer
+ * @param src_len 	input buffer length
+ * @param dst_len 	output buffer length
+ * @param level 	compression level (from 1 = fastest to 12 = best compression, 10 to 12 = optimal parsing)
+ * @param nr_threads 	number of threads (0 = number of online processors)
+ *
+ * @return output buffer
+ */
+uint8_t *deflate_compress_parallel(uint8_t *src, uint32_t src_len, uint32_t *dst_len, int level, int nr_threads)
+{
+	struct deflate_parallel_job job;
 	struct byte_stream bs_out = { 0 };
-	uint16_t block_len;
-	int last_block = 0;
-	uint8_t *block;
+	uint32_t crc, chunk_len, i;
+	pthread_t *threads;
+	int nr_workers;
 
-	/* compress block by block */
-	for (block = src; block < src + src_len; block += block_len) {
-		/* compute block length */
-		block_len = DEFLATE_BLOCK_SIZE;
-		if (block + block_len >= src + src_len) {
-			block_len = src + src_len - block;
-			last_block = 1;
-		}
+	/* set job */
+	job.src = src;
+	job.src_len = src_len;
+	job.level = level;
+	job.nr_chunks = src_len ? (src_len - 1) / DEFLATE_PARALLEL_CHUNK_SIZE + 1 : 1;
+	job.next_chunk = 0;
+	job.outputs = (struct byte_stream *) xmalloc(sizeof(struct byte_stream) * job.nr_chunks);
+	job.crcs = (uint32_t *) xmalloc(sizeof(uint32_t) * job.nr_chunks);
+	memset(job.outputs, 0, sizeof(struct byte_stream) * job.nr_chunks);
+	pthread_mutex_init(&job.lock, NULL);
 
-		/* compress block */
-		bs = __compress_block(block, block_len, last_block, &bs_fix_huff, &bs_dyn_huff, &bs_no);
+	/* compute number of workers */
+	if (nr_threads <= 0)
+		nr_threads = sysconf(_SC_NPROCESSORS_ONLN);
+	if (nr_threads <= 0)
+		nr_threads = 1;
+	if ((uint32_t) nr_threads > job.nr_chunks)
+		nr_threads = job.nr_chunks;
 
-		/* copy bit stream to output buffer */
-		byte_stream_write(&bs_out, bs->buf, bs->byte_offset);
+	/* start workers (current thread is first worker) */
+	threads = (pthread_t *) xmalloc(sizeof(pthread_t) * nr_threads);
+	for (nr_workers = 1; nr_workers < nr_threads; nr_workers++)
+		if (pthread_create(&threads[nr_workers], NULL, __compress_worker, &job) != 0)
+			break;
+	__compress_worker(&job);
 
-		/* clear bit streams (remember last byte) */
-		bs_fix_huff.buf[0] = bs_dyn_huff.buf[0] = bs_no.buf[0] = bs->buf[bs->byte_offset];
-		bs_fix_huff.bit_offset = bs_dyn_huff.bit_offset = bs_no.bit_offset = bs->bit_offset;
-		bs_fix_huff.byte_offset = bs_dyn_huff.byte_offset = bs_no.byte_offset = 0;
+	/* wait for workers */
+	for (i = 1; i < (uint32_t) nr_workers; i++)
+		pthread_join(threads[i], NULL);
+
+	/* concatenate chunks and combine CRCs (CRC of empty buffer = 0) */
+	for (i = 0, crc = 0; i < job.nr_chunks; i++) {
+		chunk_len = i < job.nr_chunks - 1 ? DEFLATE_PARALLEL_CHUNK_SIZE : src_len - i * DEFLATE_PARALLEL_CHUNK_SIZE;
+		crc = crc32_combine(crc, job.crcs[i], chunk_len);
+		byte_stream_write(&bs_out, job.outputs[i].buf, job.outputs[i].size);
+		xfree(job.outputs[i].buf);
 	}
 
 	/* write crc */
-	byte_stream_write_u32(&bs_out, htole32(__crc32(src, src_len, ~0)));
+	byte_stream_write_u32(&bs_out, htole32(crc));
 
 	/* write uncompressed length */
 	byte_stream_write_u32(&bs_out, htole32(src_len));
 
-	/* free bit streams */
-	xfree(bs_fix_huff.buf);
-	xfree(bs_dyn_huff.buf);
-	xfree(bs_no.buf);
+	/* free job */
+	pthread_mutex_destroy(&job.lock);
+	xfree(job.outputs);
+	xfree(job.crcs);
+	xfree(threads);
 
 	/* set destination length */
 	*dst_len = bs_out.size;
@@ -157,32 +600,202 @@ uint8_t *deflate_compress(uint8_t *src, uint32_t src_len, uint32_t *dst_len)
 }
 
 /**
- * @brief Uncompress a buffer with deflate algorithm.
+ * @brief Init a streaming compressor.
  * 
- * @param src 		input buffer
+ * @param stream 	streaming compressor
+ * @param level 	compression level (from 1 = fastest to 12 = best compression, 10 to 12 = optimal parsing)
+ * @param write 	output sink (called with compressed bytes, returns a negative value on error)
+ * @param arg 		output sink argument
+ */
+void deflate_stream_init(struct deflate_stream *stream, int level, int (*write)(void *arg, uint8_t *buf, uint32_t len), void *arg)
+{
+	memset(stream, 0, sizeof(struct deflate_stream));
+	stream->level = level;
+	stream->write = write;
+	stream->arg = arg;
+
+	/* create lz77 context, tokens buffer and window */
+	deflate_lz77_context_init(&stream->ctx, level);
+	deflate_lz77_context_reset(&stream->ctx, UINT32_MAX);
+	deflate_lz77_tokens_init(&stream->tokens);
+	stream->window = (uint8_t *) xmalloc(DEFLATE_STREAM_WINDOW_SIZE);
+}
+
+/**
+ * @brief Write complete bytes of output bit stream to output sink (partial last byte is kept).
+ * 
+ * @param stream 	streaming compressor
+ * 
+ * @return 0 on success, -1 on output sink error
+ */
+static int __stream_output(struct deflate_stream *stream)
+{
+	struct bit_stream *bs = &stream->bs;
+
+	if (!bs->byte_offset)
+		return 0;
+
+	if (stream->write(stream->arg, bs->buf, bs->byte_offset) < 0)
+		return -1;
+
+	/* clear bit stream (remember last byte) */
+	bs->buf[0] = bs->buf[bs->byte_offset];
+	bs->byte_offset = 0;
+
+	return 0;
+}
+
+/**
+ * @brief Compress a block of pending input.
+ * 
+ * @param stream 	streaming compressor
+ * @param block_len 	block length
+ * @param last_block 	last block ?
+ * 
+ * @return 0 on success, -1 on output sink error
+ */
+static int __stream_compress_block(struct deflate_stream *stream, uint16_t block_len, int last_block)
+{
+	__compress_block(&stream->ctx, &stream->tokens, stream->window, stream->start, block_len, last_block, &stream->bs);
+	stream->crc = crc32_update(stream->crc, stream->window + stream->start, block_len);
+	stream->start += block_len;
+
+	return __stream_output(stream);
+}
+
+/**
+ * @brief Compress next input chunk (full blocks are compressed and written to output sink).
+ * 
+ * @param stream 	streaming compressor
+ * @param buf 		input chunk
+ * @param len 		input chunk length
+ * 
+ * @return 0 on success, -1 on output sink error
+ */
+int deflate_stream_update(struct deflate_stream *stream, uint8_t *buf, uint32_t len)
+{
+	uint32_t n;
+
+	stream->total_in += len;
+
+	while (len > 0) {
+		/* window is full : slide it (pending input is less than one block, so at least 32 KiB of history are kept) */
+		if (stream->end == DEFLATE_STREAM_WINDOW_SIZE) {
+			memmove(stream->window, stream->window + DEFLATE_STREAM_SLIDE_SIZE, stream->end - DEFLATE_STREAM_SLIDE_SIZE);
+			stream->start -= DEFLATE_STREAM_SLIDE_SIZE;
+			stream->end -= DEFLATE_STREAM_SLIDE_SIZE;
+			deflate_lz77_slide(&stream->ctx, DEFLATE_STREAM_SLIDE_SIZE);
+		}
+
+		/* copy input to window */
+		n = DEFLATE_STREAM_WINDOW_SIZE - stream->end;
+		if (n > len)
+			n = len;
+		memcpy(stream->window + stream->end, buf, n);
+		stream->end += n;
+		buf += n;
+		len -= n;
+
+		/* compress full blocks */
+		while (stream->end - stream->start >= DEFLATE_BLOCK_SIZE)
+			if (__stream_compress_block(stream, DEFLATE_BLOCK_SIZE, 0) < 0)
+				return -1;
+	}
+
+	return 0;
+}
+
+/**
+ * @brief Flush a streaming compressor : pending input is compressed and output ends on a byte boundary.
+ * 
+ * Sync flush keeps history, full flush forgets it (decompression can restart from this point).
+ * 
+ * @param stream 	streaming compressor
+ * @param mode 		flush mode (DEFLATE_NO_FLUSH, DEFLATE_SYNC_FLUSH or DEFLATE_FULL_FLUSH)
+ * 
+ * @return 0 on success, -1 on output sink error
+ */
+int deflate_stream_flush(struct deflate_stream *stream, int mode)
+{
+	if (mode == DEFLATE_NO_FLUSH)
+		return 0;
+
+	/* compress pending input */
+	if (stream->end > stream->start && __stream_compress_block(stream, stream->end - stream->start, 0) < 0)
+		return -1;
+
+	/* go to next byte with an empty stored block */
+	bit_stream_write_bits(&stream->bs, 0, 1, BIT_ORDER_LSB);
+	bit_stream_write_bits(&stream->bs, DEFLATE_COMPRESSION_NO, 2, BIT_ORDER_LSB);
+	deflate_no_compression_compress(NULL, 0, &stream->bs);
+	if (__stream_output(stream) < 0)
+		return -1;
+
+	/* full flush : forget history (next matches can't refer to previous input) */
+	if (mode == DEFLATE_FULL_FLUSH) {
+		deflate_lz77_context_reset(&stream->ctx, UINT32_MAX);
+		stream->start = stream->end = 0;
+	}
+
+	return 0;
+}
+
+/**
+ * @brief Finish a streaming compressor : compress last block and write CRC and length.
+ * 
+ * @param stream 	streaming compressor
+ * 
+ * @return 0 on success, -1 on output sink error
+ */
+int deflate_stream_finish(struct deflate_stream *stream)
+{
+	uint32_t trailer[2];
+
+	/* compress pending input as last block */
+	if (__stream_compress_block(stream, stream->end - stream->start, 1) < 0)
+		return -1;
+
+	/* write crc and uncompressed length */
+	trailer[0] = htole32(stream->crc);
+	trailer[1] = htole32(stream->total_in);
+	return stream->write(stream->arg, (uint8_t *) trailer, sizeof(trailer)) < 0 ? -1 : 0;
+}
+
+/**
+ * @brief Free a streaming compressor.
+ * 
+ * @param stream 	streaming compressor
+ */
+void deflate_stream_free(struct deflate_stream *stream)
+{
+	deflate_lz77_context_free(&stream->ctx);
+	deflate_lz77_tokens_free(&stream->tokens);
+	xfree(stream->window);
+	xfree(stream->bs.buf);
+}
+
+/**
+ * @brief Uncompress deflate blocks and check trailer.
+ * 
+ * @param src 		input buffer (ending with crc and uncompressed length)
  * @param src_len 	input buffer length
- * @param dst_len 	output buffer length
+ * @param dst 		output buffer
+ * @param dst_len 	output buffer length (read from trailer)
  *
- * @return output buffer
+ * @return 0 on success, -1 on corrupted input
  */
-uint8_t *deflate_uncompress(uint8_t *src, uint32_t src_len, uint32_t *dst_len)
+static int __uncompress(uint8_t *src, uint32_t src_len, uint8_t *dst, uint32_t dst_len)
 {
 	struct bit_stream bs_in = { 0 };
-	uint8_t *dst, *buf_out;
-	int last_block, type;
-	uint32_t crc;
+	uint8_t *buf_out = dst, *block;
+	uint32_t crc, dst_crc = 0;
+	int last_block, type, n;
 
-	/* read uncompressed length first */
-	*dst_len = le32toh(*((uint32_t *) (src + src_len - sizeof(uint32_t))));
+	/* skip uncompressed length and read crc */
 	src_len -= sizeof(uint32_t);
-
-	/* then read crc */
 	crc = le32toh(*((uint32_t *) (src + src_len - sizeof(uint32_t))));
 	src_len -= sizeof(uint32_t);
 
-	/* allocate output buffer */
-	dst = buf_out = (uint8_t *) xmalloc(*dst_len);
-
 	/* set input bit stream */
 	bs_in.buf = src;
 	bs_in.capacity = src_len;
@@ -192,34 +805,580 @@ uint8_t *deflate_uncompress(uint8_t *src, uint32_t src_len, uint32_t *dst_len)
 		/* get block header */
 		last_block = bit_stream_read_bits(&bs_in, 1, BIT_ORDER_LSB);
 		type = bit_stream_read_bits(&bs_in, 2, BIT_ORDER_LSB);
+		block = buf_out;
 
 		/* handle compression type */
 		switch (type) {
 			case DEFLATE_COMPRESSION_NO:
-				buf_out += deflate_no_compression_uncompress(&bs_in, buf_out);
+				n = deflate_no_compression_uncompress(&bs_in, buf_out, dst + dst_len);
 				break;
 			case DEFLATE_COMPRESSION_FIX_HUFFMAN:
-				buf_out += deflate_huffman_uncompress(&bs_in, buf_out, 0);
+				n = deflate_huffman_uncompress(&bs_in, dst, buf_out, dst + dst_len, 0);
 				break;
 			case DEFLATE_COMPRESSION_DYN_HUFFMAN:
-				buf_out += deflate_huffman_uncompress(&bs_in, buf_out, 1);
+				n = deflate_huffman_uncompress(&bs_in, dst, buf_out, dst + dst_len, 1);
 				break;
 			default:
-				goto err;
+				return -1;
 		}
+
+		/* corrupted block or block read past the end of input (bits after capacity are read as zeros) */
+		if (n < 0 || bit_stream_read_pos(&bs_in) > (uint64_t) src_len * 8)
+			return -1;
+		buf_out += n;
+
+		/* update crc while block is still in cache */
+		dst_crc = crc32_update(dst_crc, block, buf_out - block);
 	
 		/* last block : exit */
 		if (last_block)
 			break;
 	}
 
-	/* check crc */
-	if (__crc32(dst, *dst_len, ~0) != crc)
-		goto err;
+	/* check output length and crc */
+	return buf_out == dst + dst_len && dst_crc == crc ? 0 : -1;
+}
+
+/**
+ * @brief Uncompress a buffer with deflate algorithm.
+ * 
+ * @param src 		input buffer
+ * @param src_len 	input buffer length
+ * @param dst_len 	output buffer length
+ *
+ * @return output buffer, NULL on corrupted input
+ */
+uint8_t *deflate_uncompress(uint8_t *src, uint32_t src_len, uint32_t *dst_len)
+{
+	struct deflate_uncompress_context context;
+	uint8_t *dst;
+
+	/* uncompress with a temporary context */
+	deflate_uncompress_context_init(&context);
+	dst = deflate_uncompress_with_context(&context, src, src_len, dst_len);
+
+	/* keep output buffer */
+	if (dst)
+		context.buf = NULL;
+	deflate_uncompress_context_free(&context);
 
 	return dst;
-err:
-	*dst_len = 0;
-	xfree(dst);
-	return NULL;
+}
+
+/**
+ * @brief Init a decompression context.
+ * 
+ * @param context 	decompression context
+ */
+void deflate_uncompress_context_init(struct deflate_uncompress_context *context)
+{
+	context->buf = NULL;
+	context->capacity = 0;
+}
+
+/**
+ * @brief Uncompress a buffer with a decompression context (output buffer is reused).
+ * 
+ * @param context 	decompression context
+ * @param src 		input buffer
+ * @param src_len 	input buffer length
+ * @param dst_len 	output buffer length
+ *
+ * @return output buffer (owned by context, valid until next call), NULL on corrupted input
+ */
+uint8_t *deflate_uncompress_with_context(struct deflate_uncompress_context *context, uint8_t *src, uint32_t src_len, uint32_t *dst_len)
+{
+	/* input too short for trailer */
+	if (src_len < 2 * sizeof(uint32_t)) {
+		*dst_len = 0;
+		return NULL;
+	}
+
+	/* read uncompressed length first */
+	*dst_len = le32toh(*((uint32_t *) (src + src_len - sizeof(uint32_t))));
+
+	/* grow output buffer */
+	if (!context->buf || *dst_len > context->capacity) {
+		xfree(context->buf);
+		context->capacity = *dst_len;
+		context->buf = (uint8_t *) xmalloc(context->capacity);
+	}
+
+	/* uncompress */
+	if (__uncompress(src, src_len, context->buf, *dst_len) != 0) {
+		*dst_len = 0;
+		return NULL;
+	}
+
+	return context->buf;
+}
+
+/**
+ * @brief Uncompress a buffer with deflate algorithm into a caller buffer.
+ * 
+ * @param src 		input buffer
+ * @param src_len 	input buffer length
+ * @param dst 		output buffer
+ * @param dst_cap 	output buffer capacity
+ * @param dst_len 	output buffer length (needed length if output buffer is too small, 0 on corrupted input)
+ *
+ * @return 0 on success, -1 if output buffer is too small or on corrupted input
+ */
+int deflate_uncompress_into(uint8_t *src, uint32_t src_len, uint8_t *dst, uint32_t dst_cap, uint32_t *dst_len)
+{
+	/* input too short for trailer */
+	if (src_len < 2 * sizeof(uint32_t)) {
+		*dst_len = 0;
+		return -1;
+	}
+
+	/* read uncompressed length first */
+	*dst_len = le32toh(*((uint32_t *) (src + src_len - sizeof(uint32_t))));
+	if (*dst_len > dst_cap)
+		return -1;
+
+	/* uncompress */
+	if (__uncompress(src, src_len, dst, *dst_len) != 0) {
+		*dst_len = 0;
+		return -1;
+	}
+
+	return 0;
+}
+
+/**
+ * @brief Free a decompression context.
+ * 
+ * @param context 	decompression context
+ */
+void deflate_uncompress_context_free(struct deflate_uncompress_context *context)
+{
+	xfree(context->buf);
+}
+
+/**
+ * @brief Init a streaming decompressor.
+ * 
+ * @param stream 	streaming decompressor
+ * @param write 	output sink (called with uncompressed bytes, returns a negative value on error)
+ * @param arg 		output sink argument
+ */
+void deflate_uncompress_stream_init(struct deflate_uncompress_stream *stream, int (*write)(void *arg, uint8_t *buf, uint32_t len),
+				    void *arg)
+{
+	memset(stream, 0, sizeof(struct deflate_uncompress_stream));
+	stream->state = DEFLATE_UNCOMPRESS_HEADER;
+	stream->write = write;
+	stream->arg = arg;
+
+	/* create input buffer and window */
+	stream->bs.buf = (uint8_t *) xmalloc(DEFLATE_UNCOMPRESS_INPUT_SIZE);
+	stream->window = (uint8_t *) xmalloc(DEFLATE_UNCOMPRESS_WINDOW_SIZE);
+}
+
+/**
+ * @brief Get number of input bits consumed.
+ * 
+ * @param bs 		input bit stream
+ * 
+ * @return number of bits
+ */
+static inline uint64_t __uncompress_stream_pos(struct bit_stream *bs)
+{
+	return (uint64_t) bs->byte_offset * 8 - bs->bit_count;
+}
+
+/**
+ * @brief Append input to the input bit stream (consumed bytes are dropped).
+ * 
+ * @param stream 	streaming decompressor
+ * @param buf 		input chunk
+ * @param len 		input chunk length
+ * 
+ * @return number of bytes appended
+ */
+static uint32_t __uncompress_stream_append(struct deflate_uncompress_stream *stream, uint8_t *buf, uint32_t len)
+{
+	struct bit_stream *bs = &stream->bs;
+	uint64_t pos = __uncompress_stream_pos(bs);
+
+	/* drop consumed bytes */
+	memmove(bs->buf, bs->buf + (pos >> 3), bs->capacity - (pos >> 3));
+	bs->capacity -= pos >> 3;
+
+	/* append input */
+	if (len > DEFLATE_UNCOMPRESS_INPUT_SIZE - bs->capacity)
+		len = DEFLATE_UNCOMPRESS_INPUT_SIZE - bs->capacity;
+	memcpy(bs->buf + bs->capacity, buf, len);
+	bs->capacity += len;
+
+	/* reload bit buffer (it may hold zeros read past previous end) and skip consumed bits of first byte */
+	bs->byte_offset = 0;
+	bs->bit_buf = 0;
+	bs->bit_count = 0;
+	bit_stream_read_bits(bs, pos & 0x07, BIT_ORDER_LSB);
+
+	return len;
+}
+
+/**
+ * @brief Write pending output to output sink.
+ * 
+ * @param stream 	streaming decompressor
+ * 
+ * @return 0 on success, -1 on output sink error
+ */
+static int __uncompress_stream_output(struct deflate_uncompress_stream *stream)
+{
+	uint32_t len = stream->out_end - stream->out_start;
+
+	if (!len)
+		return 0;
+
+	stream->crc = crc32_update(stream->crc, stream->window + stream->out_start, len);
+	stream->total_out += len;
+	stream->out_start = stream->out_end;
+
+	return stream->write(stream->arg, stream->window + stream->out_end - len, len) < 0 ? -1 : 0;
+}
+
+/**
+ * @brief Make room for at least one match in the window (only last 32 KiB are kept).
+ * 
+ * @param stream 	streaming decompressor
+ * 
+ * @return 0 on success, -1 on output sink error
+ */
+static int __uncompress_stream_slide(struct deflate_uncompress_stream *stream)
+{
+	if (stream->out_end + DEFLATE_MAX_MATCH_LEN <= DEFLATE_UNCOMPRESS_WINDOW_SIZE)
+		return 0;
+
+	if (__uncompress_stream_output(stream) < 0)
+		return -1;
+
+	memmove(stream->window, stream->window + stream->out_end - DEFLATE_DICTIONARY_SIZE, DEFLATE_DICTIONARY_SIZE);
+	stream->out_start = stream->out_end = DEFLATE_DICTIONARY_SIZE;
+
+	return 0;
+}
+
+/**
+ * @brief Free current block huffman tables (fix tables are static).
+ * 
+ * @param stream 	streaming decompressor
+ */
+static void __uncompress_stream_free_tables(struct deflate_uncompress_stream *stream)
+{
+	if (stream->lit == &stream->table_lit) {
+		huffman_table_free(&stream->table_lit);
+		huffman_table_free(&stream->table_dist);
+	}
+
+	stream->lit = NULL;
+	stream->dist = NULL;
+}
+
+/**
+ * @brief Read a block header (and huffman tables or stored block length).
+ * 
+ * @param stream 	streaming decompressor
+ * 
+ * @return 0 on success, -1 on corrupted input
+ */
+static int __uncompress_stream_header(struct deflate_uncompress_stream *stream)
+{
+	struct bit_stream *bs = &stream->bs;
+	uint32_t len, nlen;
+
+	stream->last_block = bit_stream_read_bits(bs, 1, BIT_ORDER_LSB);
+
+	switch (bit_stream_read_bits(bs, 2, BIT_ORDER_LSB)) {
+		case DEFLATE_COMPRESSION_NO:
+			bit_stream_flush(bs);
+			len = bit_stream_read_bits(bs, 16, BIT_ORDER_LSB);
+			nlen = bit_stream_read_bits(bs, 16, BIT_ORDER_LSB);
+			if (len != (~nlen & 0xFFFF))
+				return -1;
+
+			stream->stored_len = len;
+			stream->state = DEFLATE_UNCOMPRESS_STORED;
+			return 0;
+		case DEFLATE_COMPRESSION_FIX_HUFFMAN:
+			stream->lit = &deflate_huffman_fix_table_lit;
+			stream->dist = &deflate_huffman_fix_table_dist;
+			stream->state = DEFLATE_UNCOMPRESS_HUFFMAN;
+			return 0;
+		case DEFLATE_COMPRESSION_DYN_HUFFMAN:
+			if (deflate_huffman_read_tables(bs, &stream->table_lit, &stream->table_dist) < 0)
+				return -1;
+			stream->lit = &stream->table_lit;
+			stream->dist = &stream->table_dist;
+			stream->state = DEFLATE_UNCOMPRESS_HUFFMAN;
+			return 0;
+		default:
+			return -1;
+	}
+}
+
+/**
+ * @brief Copy stored block content to the window.
+ * 
+ * @param stream 	streaming decompressor
+ */
+static void __uncompress_stream_stored(struct deflate_uncompress_stream *stream)
+{
+	struct bit_stream *bs = &stream->bs;
+	uint32_t n;
+
+	/* position is byte aligned : drop bit buffer and copy input buffer directly */
+	bs->byte_offset = __uncompress_stream_pos(bs) >> 3;
+	bs->bit_buf = 0;
+	bs->bit_count = 0;
+
+	/* copy available input */
+	n = bs->capacity - bs->byte_offset;
+	if (n > stream->stored_len)
+		n = stream->stored_len;
+	if (n > DEFLATE_UNCOMPRESS_WINDOW_SIZE - stream->out_end)
+		n = DEFLATE_UNCOMPRESS_WINDOW_SIZE - stream->out_end;
+
+	memcpy(stream->window + stream->out_end, bs->buf + bs->byte_offset, n);
+	stream->out_end += n;
+	bs->byte_offset += n;
+	stream->stored_len -= n;
+}
+
+/**
+ * @brief Decode a huffman symbol (literal, match or end of block).
+ * 
+ * @param stream 	streaming decompressor
+ * 
+ * @return literal/length symbol (256 = end of block), -1 on corrupted input
+ */
+static int __uncompress_stream_symbol(struct deflate_uncompress_stream *stream)
+{
+	struct bit_stream *bs = &stream->bs;
+	int literal, length, distance, index;
+
+	/* read next literal */
+	literal = huffman_table_read_symbol(bs, stream->lit);
+	if (literal < 0 || literal > 285)
+		return -1;
+
+	/* literal */
+	if (literal < 256) {
+		stream->window[stream->out_end++] = literal;
+		return literal;
+	}
+
+	/* end of block */
+	if (literal == 256)
+		return literal;
+
+	/* decode match */
+	length = deflate_huffman_decode_length(bs, literal - 257);
+	index = huffman_table_read_symbol(bs, stream->dist);
+	if (index < 0 || index >= NR_DISTANCES)
+		return -1;
+	distance = deflate_huffman_decode_distance(bs, index);
+	if ((uint32_t) distance > stream->out_end)
+		return -1;
+
+	/* duplicate pattern */
+	match_copy(stream->window + stream->out_end, distance, length, stream->window + DEFLATE_UNCOMPRESS_WINDOW_SIZE);
+	stream->out_end += length;
+
+	return literal;
+}
+
+/**
+ * @brief Read trailer (CRC and length) and check it.
+ * 
+ * @param stream 	streaming decompressor
+ * 
+ * @return 0 on success, -1 on corrupted input
+ */
+static int __uncompress_stream_trailer(struct deflate_uncompress_stream *stream)
+{
+	uint32_t crc, len;
+
+	bit_stream_flush(&stream->bs);
+	crc = bit_stream_read_bits(&stream->bs, 32, BIT_ORDER_LSB);
+	len = bit_stream_read_bits(&stream->bs, 32, BIT_ORDER_LSB);
+
+	/* all output must have been written to check it */
+	if (__uncompress_stream_output(stream) < 0)
+		return -1;
+
+	if (crc != stream->crc || len != stream->total_out)
+		return -1;
+
+	stream->state = DEFLATE_UNCOMPRESS_END;
+	return 0;
+}
+
+/**
+ * @brief Decode available input.
+ * 
+ * Block headers, symbols and trailer are decoded as a whole : a unit read past the end of input
+ * is rolled back and decoded again once more input is available.
+ * 
+ * @param stream 	streaming decompressor
+ * 
+ * @return 0 on success, -1 on error
+ */
+static int __uncompress_stream_decode(struct deflate_uncompress_stream *stream)
+{
+	struct bit_stream *bs = &stream->bs, saved;
+	uint64_t end = (uint64_t) bs->capacity * 8;
+	uint32_t out_end;
+	int ret;
+
+	for (;;) {
+		/* make room for next unit */
+		if (__uncompress_stream_slide(stream) < 0)
+			return -1;
+
+		/* remember position */
+		saved = *bs;
+		out_end = stream->out_end;
+
+		switch (stream->state) {
+			case DEFLATE_UNCOMPRESS_HEADER:
+				ret = __uncompress_stream_header(stream);
+
+				/* huffman tables may be corrupted or just truncated */
+				if (ret < 0 && end - __uncompress_stream_pos(&saved) < DEFLATE_MAX_HEADER_SIZE * 8)
+					goto wait;
+				if (ret < 0)
+					return -1;
+
+				/* truncated header */
+				if (__uncompress_stream_pos(bs) > end) {
+					if (stream->state == DEFLATE_UNCOMPRESS_HUFFMAN)
+						__uncompress_stream_free_tables(stream);
+					stream->state = DEFLATE_UNCOMPRESS_HEADER;
+					goto wait;
+				}
+				break;
+			case DEFLATE_UNCOMPRESS_STORED:
+				/* end of block */
+				if (!stream->stored_len) {
+					stream->state = stream->last_block ? DEFLATE_UNCOMPRESS_TRAILER : DEFLATE_UNCOMPRESS_HEADER;
+					break;
+				}
+
+				/* no progress : wait for more input */
+				__uncompress_stream_stored(stream);
+				if (stream->out_end == out_end)
+					return 0;
+				break;
+			case DEFLATE_UNCOMPRESS_HUFFMAN:
+				ret = __uncompress_stream_symbol(stream);
+
+				/* symbol may be corrupted or just truncated */
+				if (ret < 0 && end - __uncompress_stream_pos(&saved) < 64)
+					goto wait;
+				if (ret < 0)
+					return -1;
+
+				/* truncated symbol */
+				if (__uncompress_stream_pos(bs) > end)
+					goto wait;
+
+				/* end of block */
+				if (ret == 256) {
+					__uncompress_stream_free_tables(stream);
+					stream->state = stream->last_block ? DEFLATE_UNCOMPRESS_TRAILER : DEFLATE_UNCOMPRESS_HEADER;
+				}
+				break;
+			case DEFLATE_UNCOMPRESS_TRAILER:
+				/* wait for whole trailer (after byte alignment) */
+				if (end - __uncompress_stream_pos(bs) < (bs->bit_count & 0x07) + 64)
+					return 0;
+
+				return __uncompress_stream_trailer(stream);
+			default:
+				return 0;
+		}
+	}
+
+wait:
+	*bs = saved;
+	stream->out_end = out_end;
+	return 0;
+}
+
+/**
+ * @brief Uncompress next input chunk (uncompressed data is written to output sink).
+ * 
+ * @param stream 	streaming decompressor
+ * @param buf 		input chunk
+ * @param len 		input chunk length
+ * 
+ * @return 1 at end of stream, 0 if more input is needed (see deflate_uncompress_stream_finish), -1 on corrupted input or output sink error
+ */
+int deflate_uncompress_stream_update(struct deflate_uncompress_stream *stream, uint8_t *buf, uint32_t len)
+{
+	uint32_t n;
+
+	do {
+		if (stream->state == DEFLATE_UNCOMPRESS_END)
+			return 1;
+		if (stream->state == DEFLATE_UNCOMPRESS_ERROR)
+			return -1;
+
+		/* append as much input as possible and decode it */
+		n = __uncompress_stream_append(stream, buf, len);
+		buf += n;
+		len -= n;
+
+		/* corrupted input : stop decoding */
+		if (__uncompress_stream_decode(stream) < 0) {
+			if (stream->state == DEFLATE_UNCOMPRESS_HUFFMAN)
+				__uncompress_stream_free_tables(stream);
+			stream->state = DEFLATE_UNCOMPRESS_ERROR;
+		}
+	} while (len > 0);
+
+	/* write decoded data */
+	if (stream->state != DEFLATE_UNCOMPRESS_ERROR && __uncompress_stream_output(stream) < 0)
+		stream->state = DEFLATE_UNCOMPRESS_ERROR;
+
+	return stream->state == DEFLATE_UNCOMPRESS_END ? 1 : stream->state == DEFLATE_UNCOMPRESS_ERROR ? -1 : 0;
+}
+
+/**
+ * @brief Finish a streaming decompressor at end of input (a truncated stream can't be told apart from a corrupted one before).
+ * 
+ * @param stream 	streaming decompressor
+ * 
+ * @return 0 if the whole stream was decoded, -1 on truncated or corrupted input
+ */
+int deflate_uncompress_stream_finish(struct deflate_uncompress_stream *stream)
+{
+	if (stream->state == DEFLATE_UNCOMPRESS_END)
+		return 0;
+
+	/* input ended inside a block or before the trailer */
+	if (stream->state == DEFLATE_UNCOMPRESS_HUFFMAN)
+		__uncompress_stream_free_tables(stream);
+	stream->state = DEFLATE_UNCOMPRESS_ERROR;
+
+	return -1;
+}
+
+/**
+ * @brief Free a streaming decompressor.
+ * 
+ * @param stream 	streaming decompressor
+ */
+void deflate_uncompress_stream_free(struct deflate_uncompress_stream *stream)
+{
+	if (stream->state == DEFLATE_UNCOMPRESS_HUFFMAN)
+		__uncompress_stream_free_tables(stream);
+
+	xfree(stream->bs.buf);
+	xfree(stream->window);
 }
@@ -4,6 +4,84 @@
 #include <stdio.h>
 #include <stdint.h>
 
+#include "lz77.h"
+#include "../huffman/huffman_table.h"
+#include "../utils/bit_stream.h"
+#include "../utils/byte_stream.h"
+
+#define DEFLATE_LEVEL_MIN		1
+#define DEFLATE_LEVEL_MAX		12
+#define DEFLATE_LEVEL_DEFAULT		6
+
+#define DEFLATE_NO_FLUSH		0
+#define DEFLATE_SYNC_FLUSH		1
+#define DEFLATE_FULL_FLUSH		2
+
+/**
+ * @brief Compression context (one per thread).
+ * 
+ * Working memory (hash tables, tokens, optimal parsing buffers and output) is kept across calls and reset
+ * cheaply : once buffers have grown, compressing a message only allocates small per-block huffman tables
+ * (and block split state on levels 10 to 12).
+ */
+struct deflate_compress_context {
+	struct lz77_context		ctx;		/* LZ77 context (hash tables are scaled to each input) */
+	struct lz77_tokens		tokens;		/* LZ77 tokens buffer */
+	struct bit_stream		bs;		/* blocks output bits */
+	struct byte_stream		out;		/* compressed output (valid until next call) */
+};
+
+/**
+ * @brief Decompression context (one per thread) : output buffer is kept across calls.
+ */
+struct deflate_uncompress_context {
+	uint8_t *			buf;		/* uncompressed output (valid until next call) */
+	uint32_t			capacity;	/* output buffer capacity */
+};
+
+/**
+ * @brief Streaming compressor.
+ * 
+ * Input is copied in a window holding history (at least 32 KiB) and pending input (less than one block) :
+ * memory doesn't depend on input length.
+ */
+struct deflate_stream {
+	int				level;		/* compression level */
+	struct lz77_context		ctx;		/* LZ77 context */
+	struct lz77_tokens		tokens;		/* LZ77 tokens buffer */
+	uint8_t *			window;		/* history and pending input */
+	uint32_t			start;		/* pending input start */
+	uint32_t			end;		/* pending input end */
+	struct bit_stream		bs;		/* output bits (last byte may be partial) */
+	uint32_t			crc;		/* input CRC */
+	uint32_t			total_in;	/* input length (modulo 2^32) */
+	int				(*write)(void *, uint8_t *, uint32_t);	/* output sink */
+	void *				arg;		/* output sink argument */
+};
+
+/**
+ * @brief Streaming decompressor.
+ * 
+ * Output is decoded in a window keeping the last 32 KiB (matches history) : memory doesn't depend on input length.
+ */
+struct deflate_uncompress_stream {
+	int				state;		/* decoding state (block header, block content or trailer) */
+	int				last_block;	/* current block is the last one ? */
+	struct bit_stream		bs;		/* pending input */
+	uint8_t *			window;		/* history and pending output */
+	uint32_t			out_start;	/* pending output start */
+	uint32_t			out_end;	/* pending output end */
+	const struct huffman_table *	lit;		/* current block literals huffman table (fix or dynamic) */
+	const struct huffman_table *	dist;		/* current block distances huffman table (fix or dynamic) */
+	struct huffman_table		table_lit;	/* dynamic literals huffman table */
+	struct huffman_table		table_dist;	/* dynamic distances huffman table */
+	uint32_t			stored_len;	/* remaining length of current stored block */
+	uint32_t			crc;		/* output CRC */
+	uint32_t			total_out;	/* output length (modulo 2^32) */
+	int				(*write)(void *, uint8_t *, uint32_t);	/* output sink */
+	void *				arg;		/* output sink argument */
+};
+
 /**
  * @brief Compress a buffer with deflate algorithm.
  * 
@@ -16,14 +94,245 @@
 uint8_t *deflate_compress(uint8_t *src, uint32_t src_len, uint32_t *dst_len);
 
 /**
- * @brief Uncompress a buffer with deflate algorithm.
+ * @brief Compute maximum compressed length (size a caller buffer for deflate_compress_into).
+ * 
+ * @param len 		input buffer length
+ *
+ * @return maximum output buffer length
+ */
+uint32_t deflate_compress_bound(uint32_t len);
+
+/**
+ * @brief Compress a buffer with deflate algorithm into a caller buffer.
+ * 
+ * @param src 		input buffer
+ * @param src_len 	input buffer length
+ * @param dst 		output buffer
+ * @param dst_cap 	output buffer capacity
+ * @param dst_len 	output buffer length (needed length if output buffer is too small)
+ *
+ * @return 0 on success, -1 if output buffer is too small
+ */
+int deflate_compress_into(uint8_t *src, uint32_t src_len, uint8_t *dst, uint32_t dst_cap, uint32_t *dst_len);
+
+/**
+ * @brief Compress a buffer with deflate algorithm and a compression level.
  * 
  * @param src 		input buffer
  * @param src_len 	input buffer length
  * @param dst_len 	output buffer length
+ * @param level 	compression level (from 1 = fastest to 12 = best compression, 10 to 12 = optimal parsing)
  *
  * @return output buffer
  */
+uint8_t *deflate_compress_level(uint8_t *src, uint32_t src_len, uint32_t *dst_len, int level);
+
+/**
+ * @brief Compress a buffer with deflate algorithm and a compression level into a caller buffer.
+ * 
+ * @param src 		input buffer
+ * @param src_len 	input buffer length
+ * @param dst 		output buffer
+ * @param dst_cap 	output buffer capacity
+ * @param dst_len 	output buffer length (needed length if output buffer is too small)
+ * @param level 	compression level (from 1 = fastest to 12 = best compression, 10 to 12 = optimal parsing)
+ *
+ * @return 0 on success, -1 if output buffer is too small
+ */
+int deflate_compress_level_into(uint8_t *src, uint32_t src_len, uint8_t *dst, uint32_t dst_cap, uint32_t *dst_len, int level);
+
+/**
+ * @brief Init a compression context.
+ * 
+ * @param context 	compression context
+ * @param level 	compression level (from 1 = fastest to 12 = best compression, 10 to 12 = optimal parsing)
+ */
+void deflate_compress_context_init(struct deflate_compress_context *context, int level);
+
+/**
+ * @brief Compress a buffer with a compression context (input sized buffers are not reallocated once they have grown).
+ * 
+ * @param context 	compression context
+ * @param src 		input buffer
+ * @param src_len 	input buffer length
+ * @param dst_len 	output buffer length
+ *
+ * @return output buffer (owned by context, valid until next call)
+ */
+uint8_t *deflate_compress_with_context(struct deflate_compress_context *context, uint8_t *src, uint32_t src_len, uint32_t *dst_len);
+
+/**
+ * @brief Compress a buffer with a compression context into a caller buffer.
+ * 
+ * @param context 	compression context
+ * @param src 		input buffer
+ * @param src_len 	input buffer length
+ * @param dst 		output buffer
+ * @param dst_cap 	output buffer capacity
+ * @param dst_len 	output buffer length (needed length if output buffer is too small)
+ *
+ * @return 0 on success, -1 if output buffer is too small
+ */
+int deflate_compress_with_context_into(struct deflate_compress_context *context, uint8_t *src, uint32_t src_len, uint8_t *dst,
+				       uint32_t dst_cap, uint32_t *dst_len);
+
+/**
+ * @brief Free a compression context.
+ * 
+ * @param context 	compression context
+ */
+void deflate_compress_context_free(struct deflate_compress_context *context);
+
+/**
+ * @brief Compress a buffer with deflate algorithm on several threads.
+ * 
+ * Input is split in chunks compressed in parallel, each chunk using previous 32 KiB as dictionary.
+ * Chunks end on a byte boundary (empty stored block), so they are just concatenated.
+ * 
+ * @param src 		input buffer
+ * @param src_len 	input buffer length
+ * @param dst_len 	output buffer length
+ * @param level 	compression level (from 1 = fastest to 12 = best compression, 10 to 12 = optimal parsing)
+ * @param nr_threads 	number of threads (0 = number of online processors)
+ *
+ * @return output buffer
+ */
+uint8_t *deflate_compress_parallel(uint8_t *src, uint32_t src_len, uint32_t *dst_len, int level, int nr_threads);
+
+/**
+ * @brief Init a streaming compressor.
+ * 
+ * @param stream 	streaming compressor
+ * @param level 	compression level (from 1 = fastest to 12 = best compression, 10 to 12 = optimal parsing)
+ * @param write 	output sink (called with compressed bytes, returns a negative value on error)
+ * @param arg 		output sink argument
+ */
+void deflate_stream_init(struct deflate_stream *stream, int level, int (*write)(void *arg, uint8_t *buf, uint32_t len), void *arg);
+
+/**
+ * @brief Compress next input chunk (full blocks are compressed and written to output sink).
+ * 
+ * @param stream 	streaming compressor
+ * @param buf 		input chunk
+ * @param len 		input chunk length
+ * 
+ * @return 0 on success, -1 on output sink error
+ */
+int deflate_stream_update(struct deflate_stream *stream, uint8_t *buf, uint32_t len);
+
+/**
+ * @brief Flush a streaming compressor : pending input is compressed and output ends on a byte boundary.
+ * 
+ * Sync flush keeps history, full flush forgets it (decompression can restart from this point).
+ * 
+ * @param stream 	streaming compressor
+ * @param mode 		flush mode (DEFLATE_NO_FLUSH, DEFLATE_SYNC_FLUSH or DEFLATE_FULL_FLUSH)
+ * 
+ * @return 0 on success, -1 on output sink error
+ */
+int deflate_stream_flush(struct deflate_stream *stream, int mode);
+
+/**
+ * @brief Finish a streaming compressor : compress last block and write CRC and length.
+ * 
+ * @param stream 	streaming compressor
+ * 
+ * @return 0 on success, -1 on output sink error
+ */
+int deflate_stream_finish(struct deflate_stream *stream);
+
+/**
+ * @brief Free a streaming compressor.
+ * 
+ * @param stream 	streaming compressor
+ */
+void deflate_stream_free(struct deflate_stream *stream);
+
+/**
+ * @brief Uncompress a buffer with deflate algorithm.
+ * 
+ * @param src 		input buffer
+ * @param src_len 	input buffer length
+ * @param dst_len 	output buffer length
+ *
+ * @return output buffer, NULL on corrupted input
+ */
 uint8_t *deflate_uncompress(uint8_t *src, uint32_t src_len, uint32_t *dst_len);
 
+/**
+ * @brief Init a decompression context.
+ * 
+ * @param context 	decompression context
+ */
+void deflate_uncompress_context_init(struct deflate_uncompress_context *context);
+
+/**
+ * @brief Uncompress a buffer with a decompression context (output buffer is reused).
+ * 
+ * @param context 	decompression context
+ * @param src 		input buffer
+ * @param src_len 	input buffer length
+ * @param dst_len 	output buffer length
+ *
+ * @return output buffer (owned by context, valid until next call), NULL on corrupted input
+ */
+uint8_t *deflate_uncompress_with_context(struct deflate_uncompress_context *context, uint8_t *src, uint32_t src_len, uint32_t *dst_len);
+
+/**
+ * @brief Uncompress a buffer with deflate algorithm into a caller buffer.
+ * 
+ * @param src 		input buffer
+ * @param src_len 	input buffer length
+ * @param dst 		output buffer
+ * @param dst_cap 	output buffer capacity
+ * @param dst_len 	output buffer length (needed length if output buffer is too small, 0 on corrupted input)
+ *
+ * @return 0 on success, -1 if output buffer is too small or on corrupted input
+ */
+int deflate_uncompress_into(uint8_t *src, uint32_t src_len, uint8_t *dst, uint32_t dst_cap, uint32_t *dst_len);
+
+/**
+ * @brief Free a decompression context.
+ * 
+ * @param context 	decompression context
+ */
+void deflate_uncompress_context_free(struct deflate_uncompress_context *context);
+
+/**
+ * @brief Init a streaming decompressor.
+ * 
+ * @param stream 	streaming decompressor
+ * @param write 	output sink (called with uncompressed bytes, returns a negative value on error)
+ * @param arg 		output sink argument
+ */
+void deflate_uncompress_stream_init(struct deflate_uncompress_stream *stream, int (*write)(void *arg, uint8_t *buf, uint32_t len),
+				    void *arg);
+
+/**
+ * @brief Uncompress next input chunk (uncompressed data is written to output sink).
+ * 
+ * @param stream 	streaming decompressor
+ * @param buf 		input chunk
+ * @param len 		input chunk length
+ * 
+ * @return 1 at end of stream, 0 if more input is needed (see deflate_uncompress_stream_finish), -1 on corrupted input or output sink error
+ */
+int deflate_uncompress_stream_update(struct deflate_uncompress_stream *stream, uint8_t *buf, uint32_t len);
+
+/**
+ * @brief Finish a streaming decompressor at end of input (a truncated stream can't be told apart from a corrupted one before).
+ * 
+ * @param stream 	streaming decompressor
+ * 
+ * @return 0 if the whole stream was decoded, -1 on truncated or corrupted input
+ */
+int deflate_uncompress_stream_finish(struct deflate_uncompress_stream *stream);
+
+/**
+ * @brief Free a streaming decompressor.
+ * 
+ * @param stream 	streaming decompressor
+ */
+void deflate_uncompress_stream_free(struct deflate_uncompress_stream *stream);
+
 #endif
@@ -4,11 +4,11 @@
 
 #include "dyn_huffman.h"
 #include "huffman.h"
-#include "../huffman/huffman_tree.h"
-#include "../utils/heap.h"
 #include "../utils/mem.h"
 
-#define NR_LENGTHS_LEN		19
+#define NR_LENGTHS_LEN			19
+#define DEFLATE_MAX_BITS		15
+#define DEFLATE_MAX_LENGTHS_BITS	7
 
 /**
  * @brief Lengths orders.
@@ -20,40 +20,29 @@ static int __len_order[] = {
 /**
  * @brief Build dynamic huffman tables.
  * 
- * @param lz77_nodes		LZ77 nodes
+ * @param tokens		LZ77 tokens (with frequencies)
  * @param table_lit 		literals huffman table
  * @param table_dist 		distances huffman table
  */
-void deflate_huffman_build_dynamic_tables(struct lz77_node *lz77_nodes, struct huffman_table *table_lit, struct huffman_table *table_dist)
+void deflate_huffman_build_dynamic_tables(struct lz77_tokens *tokens, struct huffman_table *table_lit, struct huffman_table *table_dist)
 {
-	uint32_t freqs_lit[NR_LITERALS] = { 0 }, freqs_dist[NR_DISTANCES] = { 0 };
-	struct huffman_node *tree_lit, *tree_dist;
-	struct lz77_node *lz77_node;
-
-	/* compute literals and distances frequencies */
-	for (lz77_node = lz77_nodes; lz77_node != NULL; lz77_node = lz77_node->next) {
-		if (lz77_node->is_literal) {
-			freqs_lit[lz77_node->data.literal]++;
-		} else {
-			freqs_lit[257 + deflate_huffman_length_index(lz77_node->data.match.length)]++;
-			freqs_dist[deflate_huffman_distance_index(lz77_node->data.match.distance)]++;
-		}
-	}
-
-	/* add "end of block" character */
-	freqs_lit[256]++;
-
-	/* build huffman trees */
-	tree_lit = huffman_tree_create(freqs_lit, NR_LITERALS);
-	tree_dist = huffman_tree_create(freqs_dist, NR_DISTANCES);
-
-	/* build huffman tables */
-	huffman_table_build_from_tree(tree_lit, table_lit, NR_LITERALS);
-	huffman_table_build_from_tree(tree_dist, table_dist, NR_DISTANCES);
+	deflate_huffman_build_dynamic_tables_from_freqs(tokens->freqs_lit, tokens->freqs_dist, table_lit, table_dist);
+}
 
-	/* free huffman trees */
-	huffman_tree_free(tree_lit);
-	huffman_tree_free(tree_dist);
+/**
+ * @brief Build dynamic huffman tables from literals and distances frequencies.
+ * 
+ * @param freqs_lit		literals frequencies (including "end of block" character)
+ * @param freqs_dist		distances frequencies
+ * @param table_lit 		literals huffman table
+ * @param table_dist 		distances huffman table
+ */
+void deflate_huffman_build_dynamic_tables_from_freqs(uint32_t *freqs_lit, uint32_t *freqs_dist, struct huffman_table *table_lit,
+						     struct huffman_table *table_dist)
+{
+	/* build huffman tables (codes limited to 15 bits) */
+	huffman_table_build_from_freqs(freqs_lit, NR_LITERALS, DEFLATE_MAX_BITS, table_lit);
+	huffman_table_build_from_freqs(freqs_dist, NR_DISTANCES, DEFLATE_MAX_BITS, table_dist);
 }
 
 /**
@@ -67,7 +56,7 @@ void deflate_huffman_build_dynamic_tables(struct lz77_node *lz77_nodes, struct h
  */
 static uint32_t __pack_codes_len(uint32_t *codes_len, uint32_t nr_codes, uint32_t *codes_len_packed)
 {
-	uint32_t run_length, last, i, j, n;
+	uint32_t run_length, last, i, n, k;
 
 	for (i = 1, n = 0, run_length = 1, last = codes_len[0]; i <= nr_codes; i++) {
 		/* continue run length sequence */
@@ -87,39 +76,27 @@ static uint32_t __pack_codes_len(uint32_t *codes_len, uint32_t nr_codes, uint32_
 		 */
 		if (last == 0) {
 			/* repeat 0 length (from 11 to 138) */
-			for (j = 138; j >= 11;) {
-				if (run_length >= j) {
-					codes_len_packed[n++] = 18;
-					codes_len_packed[n++] = j - 11;
-					run_length -= j;
-				} else {
-					j--;
-				}
+			for (; run_length >= 11; run_length -= k) {
+				k = run_length < 138 ? run_length : 138;
+				codes_len_packed[n++] = 18;
+				codes_len_packed[n++] = k - 11;
 			}
 
 			/* repeat 0 length (from 3 to 10) */
-			while (j >= 3) {
-				if (run_length >= j) {
-					codes_len_packed[n++] = 17;
-					codes_len_packed[n++] = j - 3;
-					run_length -= j;
-				} else {
-					j--;
-				}
+			if (run_length >= 3) {
+				codes_len_packed[n++] = 17;
+				codes_len_packed[n++] = run_length - 3;
+				run_length = 0;
 			}
 
 			goto next;
 		}
 
 		/* repeat previous length from 3 to 6 */
-		for (j = 6; j >= 3;) {
-			if (run_length >= j) {
-				codes_len_packed[n++] = 16;
-				codes_len_packed[n++] = j - 3;
-				run_length -= j;
-			} else {
-				j--;
-			}
+		for (; run_length >= 3; run_length -= k) {
+			k = run_length < 6 ? run_length : 6;
+			codes_len_packed[n++] = 16;
+			codes_len_packed[n++] = k - 3;
 		}
 
 next:
@@ -147,10 +124,13 @@ next:
  * @param nr_distances		number of distances codes
  * @param table_len_codes 	huffman table
  * @param codes_len 		output literals and distances codes lengths
+ * 
+ * @return 0 on success, -1 on corrupted lengths
  */
-static void __unpack_codes_len(struct bit_stream *bs_in, uint32_t nr_literals, uint32_t nr_distances, struct huffman_table *table_len_codes, uint32_t *codes_len)
+static int __unpack_codes_len(struct bit_stream *bs_in, uint32_t nr_literals, uint32_t nr_distances, struct huffman_table *table_len_codes, uint32_t *codes_len)
 {
-	uint32_t symbol, i, j, n;
+	uint32_t i, j, n, len;
+	int symbol;
 
 	/* decode literals/distances tables */
 	for (i = 0; i < nr_literals + nr_distances; i++) {
@@ -159,47 +139,52 @@ static void __unpack_codes_len(struct bit_stream *bs_in, uint32_t nr_literals, u
 
 		switch (symbol) {
 			case 16:							/* repeat previous length (from 3 to 6 ) */
+				if (i == 0)
+					return -1;
+				len = codes_len[i - 1];
 				n = 3 + bit_stream_read_bits(bs_in, 2, BIT_ORDER_LSB);
-				for (j = 0; j < n; j++)
-					codes_len[i + j] = codes_len[i - 1];
-				i += n - 1;
 				break;
 			case 17:							/* repeat 0 length (from 3 to 10) */
+				len = 0;
 				n = 3 + bit_stream_read_bits(bs_in, 3, BIT_ORDER_LSB);
-				for (j = 0; j < n; j++)
-					codes_len[i + j] = 0;
-				i += n - 1;
 				break;
 			case 18:							/* repeat 0 length (from 11 to 138) */
+				len = 0;
 				n = 11 + bit_stream_read_bits(bs_in, 7, BIT_ORDER_LSB);
-				for (j = 0; j < n; j++)
-					codes_len[i + j] = 0;
-				i += n - 1;
 				break;
 			default:
+				if (symbol < 0)
+					return -1;
 				codes_len[i] = symbol;
-				break;
+				continue;
 		}
+
+		/* repeat must not go past last code */
+		if (i + n > nr_literals + nr_distances)
+			return -1;
+
+		for (j = 0; j < n; j++)
+			codes_len[i + j] = len;
+		i += n - 1;
 	}
+
+	return 0;
 }
 
 /**
- * @brief Write huffman tables.
+ * @brief Pack literals and distances codes lengths and build lengths huffman table.
  * 
- * @param bs_out 	output bit stream
  * @param table_lit 	huffman literals table
  * @param table_dist	huffman distances table
+ * @param lengths 	output packed codes lengths
+ * @param table_len 	output lengths huffman table
+ * 
+ * @return number of packed codes lengths
  */
-void deflate_huffman_write_tables(struct bit_stream *bs_out, struct huffman_table *table_lit, struct huffman_table *table_dist)
+static uint32_t __build_lengths_table(const struct huffman_table *table_lit, const struct huffman_table *table_dist, uint32_t *lengths,
+				      struct huffman_table *table_len)
 {
-	uint32_t lengths[NR_LITERALS + NR_DISTANCES] = { 0 }, freqs_len[NR_LENGTHS_LEN] = { 0 }, lengths_len, i;
-	struct huffman_table table_len;
-	struct huffman_node *tree_len;
-
-	/* write number of literals, distances and lengths */
-	bit_stream_write_bits(bs_out, NR_LITERALS - 257, 5, BIT_ORDER_LSB);
-	bit_stream_write_bits(bs_out, NR_DISTANCES - 1, 5, BIT_ORDER_LSB);
-	bit_stream_write_bits(bs_out, NR_LENGTHS_LEN - 4, 4, BIT_ORDER_LSB);
+	uint32_t freqs_len[NR_LENGTHS_LEN] = { 0 }, lengths_len, i;
 
 	/* pack codes lengths */
 	lengths_len = __pack_codes_len(table_lit->codes_len, table_lit->len, lengths);
@@ -214,9 +199,70 @@ void deflate_huffman_write_tables(struct bit_stream *bs_out, struct huffman_tabl
 			i++;
 	}
 
-	/* build huffman table */
-	tree_len = huffman_tree_create(freqs_len, NR_LENGTHS_LEN);
-	huffman_table_build_from_tree(tree_len, &table_len, NR_LENGTHS_LEN);
+	/* build huffman table (lengths are written on 3 bits) */
+	huffman_table_build_from_freqs(freqs_len, NR_LENGTHS_LEN, DEFLATE_MAX_LENGTHS_BITS, table_len);
+
+	return lengths_len;
+}
+
+/**
+ * @brief Compute length of huffman tables.
+ * 
+ * @param table_lit 	huffman literals table
+ * @param table_dist	huffman distances table
+ * 
+ * @return length in bits
+ */
+uint32_t deflate_huffman_tables_len(const struct huffman_table *table_lit, const struct huffman_table *table_dist)
+{
+	uint32_t lengths[NR_LITERALS + NR_DISTANCES] = { 0 }, lengths_len, len, i;
+	struct huffman_table table_len;
+
+	/* number of literals, distances and lengths + length codes lengths */
+	len = 5 + 5 + 4 + NR_LENGTHS_LEN * 3;
+
+	/* length codes */
+	lengths_len = __build_lengths_table(table_lit, table_dist, lengths, &table_len);
+	for (i = 0; i < lengths_len; i++) {
+		len += table_len.codes_len[lengths[i]];
+		if (lengths[i] == 16)
+			len += 2;
+		else if (lengths[i] == 17)
+			len += 3;
+		else if (lengths[i] == 18)
+			len += 7;
+
+		/* skip rle */
+		if (lengths[i] == 16 || lengths[i] == 17 || lengths[i] == 18)
+			i++;
+	}
+
+	/* free huffman table */
+	huffman_table_free(&table_len);
+
+	return len;
+}
+
+/**
+ * @brief Write huffman tables.
+ * 
+ * @param bs_out 	output bit stream
+ * @param table_lit 	huffman literals table
+ * @param table_dist	huffman distances table
+ */
+void deflate_huffman_write_tables(struct bit_stream *bs_out, const struct huffman_table *table_lit,
+				  const struct huffman_table *table_dist)
+{
+	uint32_t lengths[NR_LITERALS + NR_DISTANCES] = { 0 }, lengths_len, i;
+	struct huffman_table table_len;
+
+	/* write number of literals, distances and lengths */
+	bit_stream_write_bits(bs_out, NR_LITERALS - 257, 5, BIT_ORDER_LSB);
+	bit_stream_write_bits(bs_out, NR_DISTANCES - 1, 5, BIT_ORDER_LSB);
+	bit_stream_write_bits(bs_out, NR_LENGTHS_LEN - 4, 4, BIT_ORDER_LSB);
+
+	/* pack codes lengths and build lengths huffman table */
+	lengths_len = __build_lengths_table(table_lit, table_dist, lengths, &table_len);
 	
 	/* write length codes lengths */
 	for (i = 0; i < NR_LENGTHS_LEN; i++)
@@ -235,7 +281,6 @@ void deflate_huffman_write_tables(struct bit_stream *bs_out, struct huffman_tabl
 
 	/* free huffman table */
 	huffman_table_free(&table_len);
-	huffman_tree_free(tree_len);
 }
 
 /**
@@ -244,32 +289,42 @@ void deflate_huffman_write_tables(struct bit_stream *bs_out, struct huffman_tabl
  * @param bs_in 	input bit stream
  * @param table_lit 	huffman literals table
  * @param table_dist	huffman distances table
+ * 
+ * @return 0 on success, -1 on corrupted tables (no table is built)
  */
-void deflate_huffman_read_tables(struct bit_stream *bs_in, struct huffman_table *table_lit, struct huffman_table *table_dist)
+int deflate_huffman_read_tables(struct bit_stream *bs_in, struct huffman_table *table_lit, struct huffman_table *table_dist)
 {
-	uint32_t len_codes_len[NR_LENGTHS] = { 0 }, codes_len[NR_LITERALS + NR_DISTANCES] = { 0 };
+	uint32_t len_codes_len[NR_LENGTHS_LEN] = { 0 }, codes_len[NR_LITERALS + NR_DISTANCES] = { 0 };
 	uint32_t nr_literals, nr_distances, nr_lengths, i;
 	struct huffman_table table_len_codes;
+	int ret;
 
 	/* read number of literals, distances and lengths */
 	nr_literals = 257 + bit_stream_read_bits(bs_in, 5, BIT_ORDER_LSB);
 	nr_distances = 1 + bit_stream_read_bits(bs_in, 5, BIT_ORDER_LSB);
 	nr_lengths = 4 + bit_stream_read_bits(bs_in, 4, BIT_ORDER_LSB);
+	if (nr_literals > NR_LITERALS || nr_distances > NR_DISTANCES)
+		return -1;
 
 	/* read length codes lengths */
 	for (i = 0; i < nr_lengths; i++)
 		len_codes_len[__len_order[i]] = bit_stream_read_bits(bs_in, 3, BIT_ORDER_LSB);
 
-	/* build temporary huffman table */
-	huffman_table_build_from_lengths(len_codes_len, nr_lengths, &table_len_codes);
+	/* build temporary huffman table (all length codes, missing ones have no code) */
+	huffman_table_build_from_lengths(len_codes_len, NR_LENGTHS_LEN, &table_len_codes);
 
 	/* unpack literals/distances codes lengths */
-	__unpack_codes_len(bs_in, nr_literals, nr_distances, &table_len_codes, codes_len);
+	ret = __unpack_codes_len(bs_in, nr_literals, nr_distances, &table_len_codes, codes_len);
+
+	/* free temporary table */
+	huffman_table_free(&table_len_codes);
+
+	if (ret < 0)
+		return -1;
 
 	/* build huffman tables */
 	huffman_table_build_from_lengths(codes_len, nr_literals, table_lit);
 	huffman_table_build_from_lengths(&codes_len[nr_literals], nr_distances, table_dist);
 
-	/* free temporary table */
-	huffman_table_free(&table_len_codes);
+	return 0;
 }
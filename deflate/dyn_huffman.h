@@ -6,11 +6,32 @@
 /**
  * @brief Build dynamic huffman tables.
  * 
- * @param lz77_nodes		LZ77 nodes
+ * @param tokens		LZ77 tokens (with frequencies)
  * @param table_lit 		literals huffman table
  * @param table_dist 		distances huffman table
  */
-void deflate_huffman_build_dynamic_tables(struct lz77_node *lz77_nodes, struct huffman_table *table_lit, struct huffman_table *table_dist);
+void deflate_huffman_build_dynamic_tables(struct lz77_tokens *tokens, struct huffman_table *table_lit, struct huffman_table *table_dist);
+
+/**
+ * @brief Build dynamic huffman tables from literals and distances frequencies.
+ * 
+ * @param freqs_lit		literals frequencies (including "end of block" character)
+ * @param freqs_dist		distances frequencies
+ * @param table_lit 		literals huffman table
+ * @param table_dist 		distances huffman table
+ */
+void deflate_huffman_build_dynamic_tables_from_freqs(uint32_t *freqs_lit, uint32_t *freqs_dist, struct huffman_table *table_lit,
+						     struct huffman_table *table_dist);
+
+/**
+ * @brief Compute length of huffman tables.
+ * 
+ * @param table_lit 	huffman literals table
+ * @param table_dist	huffman distances table
+ * 
+ * @return length in bits
+ */
+uint32_t deflate_huffman_tables_len(const struct huffman_table *table_lit, const struct huffman_table *table_dist);
 
 /**
  * @brief Write huffman tables.
@@ -19,7 +40,8 @@ void deflate_huffman_build_dynamic_tables(struct lz77_node *lz77_nodes, struct h
  * @param table_lit 	huffman literals table
  * @param table_dist	huffman distances table
  */
-void deflate_huffman_write_tables(struct bit_stream *bs_out, struct huffman_table *table_lit, struct huffman_table *table_dist);
+void deflate_huffman_write_tables(struct bit_stream *bs_out, const struct huffman_table *table_lit,
+				  const struct huffman_table *table_dist);
 
 /**
  * @brief Read huffman tables.
@@ -27,7 +49,9 @@ void deflate_huffman_write_tables(struct bit_stream *bs_out, struct huffman_tabl
  * @param bs_in 	input bit stream
  * @param table_lit 	huffman literals table
  * @param table_dist	huffman distances table
+ * 
+ * @return 0 on success, -1 on corrupted tables (no table is built)
  */
-void deflate_huffman_read_tables(struct bit_stream *bs_in, struct huffman_table *table_lit, struct huffman_table *table_dist);
+int deflate_huffman_read_tables(struct bit_stream *bs_in, struct huffman_table *table_lit, struct huffman_table *table_dist);
 
 #endif
@@ -1,61 +1,188 @@
-#include <stdio.h>
-#include <string.h>
-
+/*
+ * Fix huffman tables never change : they are built at compile time and shared (read only) by all
+ * blocks and threads.
+ * 
+ * Literals/lengths codes :
+ * - values from 0 to 143 = codes from 48 to 191 on 8 bits
+ * - values from 144 to 255 = codes from 400 to 511 on 9 bits
+ * - values from 256 to 279 = codes from 0 to 23 on 7 bits
+ * - values from 280 to 285 = codes from 192 to 197 on 8 bits
+ * 
+ * Distances codes : distances from 0 to 29 = codes from 0 to 29 on 5 bits.
+ * 
+ * Decoding tables are indexed by the next 9 (literals) or 5 (distances) reversed bits, so they
+ * have no sub table : unused codes (286, 287, 30 and 31) are invalid.
+ * 
+ * Arrays are const (read only memory) : struct huffman_table members are not, since other tables
+ * are built at run time, so const is cast away in the tables below.
+ */
 #include "fix_huffman.h"
 #include "huffman.h"
-#include "../utils/mem.h"
 
 /**
- * @brief Build fix huffman tables.
- * 
- * @param table_lit 		literals huffman table
- * @param table_dist 		distances huffman table
- */
-void deflate_huffman_build_fix_tables(struct huffman_table *table_lit, struct huffman_table *table_dist)
-{
-	int i, j;
-
-	/* allocate huffman tables */
-	huffman_table_create(table_lit, NR_LITERALS);
-	huffman_table_create(table_dist, NR_DISTANCES);
-
-	/*
-	 * - values from 256 to 279 = codes from 0 to 23 on 7 bits
-	 */
-	for (i = 256, j = 0; i <= 279; i++, j++) {
-		table_lit->codes[i] = j;
-		table_lit->codes_len[i] = 7;
-	}
-
-	/*
-	 * - values from 0 to 143 = codes from 48 to 191 on 8 bits
-	 */
-	for (i = 0, j = 48; i <= 143; i++, j++) {
-		table_lit->codes[i] = j;
-		table_lit->codes_len[i] = 8;
-	}
-
-	/*
-	 * - values from 280 to 287 = codes from 192 to 199 on 8 bits
-	 */
-	for (i = 280, j = 192; i <= 285; i++, j++) {
-		table_lit->codes[i] = j;
-		table_lit->codes_len[i] = 8;
-	}
-
-	/*
-	 * - values from 144 to 255 = codes from 400 to 511 on 9 bits
-	 */
-	for (i = 144, j = 400; i <= 255; i++, j++) {
-		table_lit->codes[i] = j;
-		table_lit->codes_len[i] = 9;
-	}
-
-	/*
-	 * - distances from 0 to 29 = codes from 0 to 29 on 5 bits
-	 */
-	for (i = 0; i < NR_DISTANCES; i++) {
-		table_dist->codes[i] = i;
-		table_dist->codes_len[i] = 5;
-	}
-}
\ No newline at end of file
+ * @brief Fix literals/lengths codes.
+ */
+static const uint32_t fix_codes_lit[NR_LITERALS] = {
+	 48,  49,  50,  51,  52,  53,  54,  55,  56,  57,  58,  59,  60,  61,  62,  63,
+	 64,  65,  66,  67,  68,  69,  70,  71,  72,  73,  74,  75,  76,  77,  78,  79,
+	 80,  81,  82,  83,  84,  85,  86,  87,  88,  89,  90,  91,  92,  93,  94,  95,
+	 96,  97,  98,  99, 100, 101, 102, 103, 104, 105, 106, 107, 108, 109, 110, 111,
+	112, 113, 114, 115, 116, 117, 118, 119, 120, 121, 122, 123, 124, 125, 126, 127,
+	128, 129, 130, 131, 132, 133, 134, 135, 136, 137, 138, 139, 140, 141, 142, 143,
+	144, 145, 146, 147, 148, 149, 150, 151, 152, 153, 154, 155, 156, 157, 158, 159,
+	160, 161, 162, 163, 164, 165, 166, 167, 168, 169, 170, 171, 172, 173, 174, 175,
+	176, 177, 178, 179, 180, 181, 182, 183, 184, 185, 186, 187, 188, 189, 190, 191,
+	400, 401, 402, 403, 404, 405, 406, 407, 408, 409, 410, 411, 412, 413, 414, 415,
+	416, 417, 418, 419, 420, 421, 422, 423, 424, 425, 426, 427, 428, 429, 430, 431,
+	432, 433, 434, 435, 436, 437, 438, 439, 440, 441, 442, 443, 444, 445, 446, 447,
+	448, 449, 450, 451, 452, 453, 454, 455, 456, 457, 458, 459, 460, 461, 462, 463,
+	464, 465, 466, 467, 468, 469, 470, 471, 472, 473, 474, 475, 476, 477, 478, 479,
+	480, 481, 482, 483, 484, 485, 486, 487, 488, 489, 490, 491, 492, 493, 494, 495,
+	496, 497, 498, 499, 500, 501, 502, 503, 504, 505, 506, 507, 508, 509, 510, 511,
+	  0,   1,   2,   3,   4,   5,   6,   7,   8,   9,  10,  11,  12,  13,  14,  15,
+	 16,  17,  18,  19,  20,  21,  22,  23, 192, 193, 194, 195, 196, 197
+};
+
+/**
+ * @brief Fix literals/lengths codes lengths.
+ */
+static const uint32_t fix_codes_len_lit[NR_LITERALS] = {
+	8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8,
+	8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8,
+	8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8,
+	8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8,
+	8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8,
+	8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8,
+	8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8,
+	8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8,
+	8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8,
+	9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9,
+	9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9,
+	9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9,
+	9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9,
+	9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9,
+	9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9,
+	9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9, 9,
+	7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
+	7, 7, 7, 7, 7, 7, 7, 7, 8, 8, 8, 8, 8, 8
+};
+
+/**
+ * @brief Fix literals/lengths decoding table.
+ */
+static const uint32_t fix_lookup_lit[1 << FIX_HUFFMAN_LIT_BITS] = {
+	0x01000007, 0x00500008, 0x00100008, 0x01180008, 0x01100007, 0x00700008, 0x00300008, 0x00c00009,
+	0x01080007, 0x00600008, 0x00200008, 0x00a00009, 0x00000008, 0x00800008, 0x00400008, 0x00e00009,
+	0x01040007, 0x00580008, 0x00180008, 0x00900009, 0x01140007, 0x00780008, 0x00380008, 0x00d00009,
+	0x010c0007, 0x00680008, 0x00280008, 0x00b00009, 0x00080008, 0x00880008, 0x00480008, 0x00f00009,
+	0x01020007, 0x00540008, 0x00140008, 0x011c0008, 0x01120007, 0x00740008, 0x00340008, 0x00c80009,
+	0x010a0007, 0x00640008, 0x00240008, 0x00a80009, 0x00040008, 0x00840008, 0x00440008, 0x00e80009,
+	0x01060007, 0x005c0008, 0x001c0008, 0x00980009, 0x01160007, 0x007c0008, 0x003c0008, 0x00d80009,
+	0x010e0007, 0x006c0008, 0x002c0008, 0x00b80009, 0x000c0008, 0x008c0008, 0x004c0008, 0x00f80009,
+	0x01010007, 0x00520008, 0x00120008, 0x011a0008, 0x01110007, 0x00720008, 0x00320008, 0x00c40009,
+	0x01090007, 0x00620008, 0x00220008, 0x00a40009, 0x00020008, 0x00820008, 0x00420008, 0x00e40009,
+	0x01050007, 0x005a0008, 0x001a0008, 0x00940009, 0x01150007, 0x007a0008, 0x003a0008, 0x00d40009,
+	0x010d0007, 0x006a0008, 0x002a0008, 0x00b40009, 0x000a0008, 0x008a0008, 0x004a0008, 0x00f40009,
+	0x01030007, 0x00560008, 0x00160008, 0x00000200, 0x01130007, 0x00760008, 0x00360008, 0x00cc0009,
+	0x010b0007, 0x00660008, 0x00260008, 0x00ac0009, 0x00060008, 0x00860008, 0x00460008, 0x00ec0009,
+	0x01070007, 0x005e0008, 0x001e0008, 0x009c0009, 0x01170007, 0x007e0008, 0x003e0008, 0x00dc0009,
+	0x010f0007, 0x006e0008, 0x002e0008, 0x00bc0009, 0x000e0008, 0x008e0008, 0x004e0008, 0x00fc0009,
+	0x01000007, 0x00510008, 0x00110008, 0x01190008, 0x01100007, 0x00710008, 0x00310008, 0x00c20009,
+	0x01080007, 0x00610008, 0x00210008, 0x00a20009, 0x00010008, 0x00810008, 0x00410008, 0x00e20009,
+	0x01040007, 0x00590008, 0x00190008, 0x00920009, 0x01140007, 0x00790008, 0x00390008, 0x00d20009,
+	0x010c0007, 0x00690008, 0x00290008, 0x00b20009, 0x00090008, 0x00890008, 0x00490008, 0x00f20009,
+	0x01020007, 0x00550008, 0x00150008, 0x011d0008, 0x01120007, 0x00750008, 0x00350008, 0x00ca0009,
+	0x010a0007, 0x00650008, 0x00250008, 0x00aa0009, 0x00050008, 0x00850008, 0x00450008, 0x00ea0009,
+	0x01060007, 0x005d0008, 0x001d0008, 0x009a0009, 0x01160007, 0x007d0008, 0x003d0008, 0x00da0009,
+	0x010e0007, 0x006d0008, 0x002d0008, 0x00ba0009, 0x000d0008, 0x008d0008, 0x004d0008, 0x00fa0009,
+	0x01010007, 0x00530008, 0x00130008, 0x011b0008, 0x01110007, 0x00730008, 0x00330008, 0x00c60009,
+	0x01090007, 0x00630008, 0x00230008, 0x00a60009, 0x00030008, 0x00830008, 0x00430008, 0x00e60009,
+	0x01050007, 0x005b0008, 0x001b0008, 0x00960009, 0x01150007, 0x007b0008, 0x003b0008, 0x00d60009,
+	0x010d0007, 0x006b0008, 0x002b0008, 0x00b60009, 0x000b0008, 0x008b0008, 0x004b0008, 0x00f60009,
+	0x01030007, 0x00570008, 0x00170008, 0x00000200, 0x01130007, 0x00770008, 0x00370008, 0x00ce0009,
+	0x010b0007, 0x00670008, 0x00270008, 0x00ae0009, 0x00070008, 0x00870008, 0x00470008, 0x00ee0009,
+	0x01070007, 0x005f0008, 0x001f0008, 0x009e0009, 0x01170007, 0x007f0008, 0x003f0008, 0x00de0009,
+	0x010f0007, 0x006f0008, 0x002f0008, 0x00be0009, 0x000f0008, 0x008f0008, 0x004f0008, 0x00fe0009,
+	0x01000007, 0x00500008, 0x00100008, 0x01180008, 0x01100007, 0x00700008, 0x00300008, 0x00c10009,
+	0x01080007, 0x00600008, 0x00200008, 0x00a10009, 0x00000008, 0x00800008, 0x00400008, 0x00e10009,
+	0x01040007, 0x00580008, 0x00180008, 0x00910009, 0x01140007, 0x00780008, 0x00380008, 0x00d10009,
+	0x010c0007, 0x00680008, 0x00280008, 0x00b10009, 0x00080008, 0x00880008, 0x00480008, 0x00f10009,
+	0x01020007, 0x00540008, 0x00140008, 0x011c0008, 0x01120007, 0x00740008, 0x00340008, 0x00c90009,
+	0x010a0007, 0x00640008, 0x00240008, 0x00a90009, 0x00040008, 0x00840008, 0x00440008, 0x00e90009,
+	0x01060007, 0x005c0008, 0x001c0008, 0x00990009, 0x01160007, 0x007c0008, 0x003c0008, 0x00d90009,
+	0x010e0007, 0x006c0008, 0x002c0008, 0x00b90009, 0x000c0008, 0x008c0008, 0x004c0008, 0x00f90009,
+	0x01010007, 0x00520008, 0x00120008, 0x011a0008, 0x01110007, 0x00720008, 0x00320008, 0x00c50009,
+	0x01090007, 0x00620008, 0x00220008, 0x00a50009, 0x00020008, 0x00820008, 0x00420008, 0x00e50009,
+	0x01050007, 0x005a0008, 0x001a0008, 0x00950009, 0x01150007, 0x007a0008, 0x003a0008, 0x00d50009,
+	0x010d0007, 0x006a0008, 0x002a0008, 0x00b50009, 0x000a0008, 0x008a0008, 0x004a0008, 0x00f50009,
+	0x01030007, 0x00560008, 0x00160008, 0x00000200, 0x01130007, 0x00760008, 0x00360008, 0x00cd0009,
+	0x010b0007, 0x00660008, 0x00260008, 0x00ad0009, 0x00060008, 0x00860008, 0x00460008, 0x00ed0009,
+	0x01070007, 0x005e0008, 0x001e0008, 0x009d0009, 0x01170007, 0x007e0008, 0x003e0008, 0x00dd0009,
+	0x010f0007, 0x006e0008, 0x002e0008, 0x00bd0009, 0x000e0008, 0x008e0008, 0x004e0008, 0x00fd0009,
+	0x01000007, 0x00510008, 0x00110008, 0x01190008, 0x01100007, 0x00710008, 0x00310008, 0x00c30009,
+	0x01080007, 0x00610008, 0x00210008, 0x00a30009, 0x00010008, 0x00810008, 0x00410008, 0x00e30009,
+	0x01040007, 0x00590008, 0x00190008, 0x00930009, 0x01140007, 0x00790008, 0x00390008, 0x00d30009,
+	0x010c0007, 0x00690008, 0x00290008, 0x00b30009, 0x00090008, 0x00890008, 0x00490008, 0x00f30009,
+	0x01020007, 0x00550008, 0x00150008, 0x011d0008, 0x01120007, 0x00750008, 0x00350008, 0x00cb0009,
+	0x010a0007, 0x00650008, 0x00250008, 0x00ab0009, 0x00050008, 0x00850008, 0x00450008, 0x00eb0009,
+	0x01060007, 0x005d0008, 0x001d0008, 0x009b0009, 0x01160007, 0x007d0008, 0x003d0008, 0x00db0009,
+	0x010e0007, 0x006d0008, 0x002d0008, 0x00bb0009, 0x000d0008, 0x008d0008, 0x004d0008, 0x00fb0009,
+	0x01010007, 0x00530008, 0x00130008, 0x011b0008, 0x01110007, 0x00730008, 0x00330008, 0x00c70009,
+	0x01090007, 0x00630008, 0x00230008, 0x00a70009, 0x00030008, 0x00830008, 0x00430008, 0x00e70009,
+	0x01050007, 0x005b0008, 0x001b0008, 0x00970009, 0x01150007, 0x007b0008, 0x003b0008, 0x00d70009,
+	0x010d0007, 0x006b0008, 0x002b0008, 0x00b70009, 0x000b0008, 0x008b0008, 0x004b0008, 0x00f70009,
+	0x01030007, 0x00570008, 0x00170008, 0x00000200, 0x01130007, 0x00770008, 0x00370008, 0x00cf0009,
+	0x010b0007, 0x00670008, 0x00270008, 0x00af0009, 0x00070008, 0x00870008, 0x00470008, 0x00ef0009,
+	0x01070007, 0x005f0008, 0x001f0008, 0x009f0009, 0x01170007, 0x007f0008, 0x003f0008, 0x00df0009,
+	0x010f0007, 0x006f0008, 0x002f0008, 0x00bf0009, 0x000f0008, 0x008f0008, 0x004f0008, 0x00ff0009
+};
+
+/**
+ * @brief Fix distances codes.
+ */
+static const uint32_t fix_codes_dist[NR_DISTANCES] = {
+	 0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14,
+	15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29
+};
+
+/**
+ * @brief Fix distances codes lengths.
+ */
+static const uint32_t fix_codes_len_dist[NR_DISTANCES] = {
+	5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5,
+	5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5
+};
+
+/**
+ * @brief Fix distances decoding table.
+ */
+static const uint32_t fix_lookup_dist[1 << FIX_HUFFMAN_DIST_BITS] = {
+	0x00000005, 0x00100005, 0x00080005, 0x00180005, 0x00040005, 0x00140005, 0x000c0005, 0x001c0005,
+	0x00020005, 0x00120005, 0x000a0005, 0x001a0005, 0x00060005, 0x00160005, 0x000e0005, 0x00000200,
+	0x00010005, 0x00110005, 0x00090005, 0x00190005, 0x00050005, 0x00150005, 0x000d0005, 0x001d0005,
+	0x00030005, 0x00130005, 0x000b0005, 0x001b0005, 0x00070005, 0x00170005, 0x000f0005, 0x00000200
+};
+
+/**
+ * @brief Fix huffman literals/lengths table.
+ */
+const struct huffman_table deflate_huffman_fix_table_lit = {
+	.len		= NR_LITERALS,
+	.codes		= (uint32_t *) fix_codes_lit,
+	.codes_len	= (uint32_t *) fix_codes_len_lit,
+	.lookup		= (uint32_t *) fix_lookup_lit,
+	.lookup_bits	= FIX_HUFFMAN_LIT_BITS,
+	.max_bits	= FIX_HUFFMAN_LIT_BITS,
+};
+
+/**
+ * @brief Fix huffman distances table.
+ */
+const struct huffman_table deflate_huffman_fix_table_dist = {
+	.len		= NR_DISTANCES,
+	.codes		= (uint32_t *) fix_codes_dist,
+	.codes_len	= (uint32_t *) fix_codes_len_dist,
+	.lookup		= (uint32_t *) fix_lookup_dist,
+	.lookup_bits	= FIX_HUFFMAN_DIST_BITS,
+	.max_bits	= FIX_HUFFMAN_DIST_BITS,
+};
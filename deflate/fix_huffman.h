@@ -3,12 +3,11 @@
 
 #include "huffman.h"
 
-/**
- * @brief Build fix huffman tables.
- * 
- * @param table_lit 		literals huffman table
- * @param table_dist 		distances huffman table
- */
-void deflate_huffman_build_fix_tables(struct huffman_table *table_lit, struct huffman_table *table_dist);
+#define FIX_HUFFMAN_LIT_BITS		9
+#define FIX_HUFFMAN_DIST_BITS		5
+
+/* fix huffman tables (built at compile time, read only) */
+extern const struct huffman_table deflate_huffman_fix_table_lit;
+extern const struct huffman_table deflate_huffman_fix_table_dist;
 
 #endif
\ No newline at end of file
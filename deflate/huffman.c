@@ -3,6 +3,7 @@
 #include "huffman.h"
 #include "fix_huffman.h"
 #include "dyn_huffman.h"
+#include "../utils/match_copy.h"
 
 /**
  * @brief Fix huffman lengths.
@@ -41,200 +42,267 @@ static int huffman_distances_extra_bits[] = {
 };
 
 /**
- * @brief Get huffman distance index.
- * 
- * @param distance	distance
+ * @brief Length index of each length (0 to 2 are unused).
  */
-int deflate_huffman_distance_index(int distance)
-{
-	int i;
-
-	for (i = 1; i < NR_DISTANCES; i++)
-		if (distance < huffman_distances[i])
-			break;
+const uint8_t deflate_huffman_length_indexes[LZ77_MAX_LEN + 1] = {
+	 0,  0,  0,  0,  1,  2,  3,  4,  5,  6,  7,  8,  8,  9,  9, 10,
+	10, 11, 11, 12, 12, 12, 12, 13, 13, 13, 13, 14, 14, 14, 14, 15,
+	15, 15, 15, 16, 16, 16, 16, 16, 16, 16, 16, 17, 17, 17, 17, 17,
+	17, 17, 17, 18, 18, 18, 18, 18, 18, 18, 18, 19, 19, 19, 19, 19,
+	19, 19, 19, 20, 20, 20, 20, 20, 20, 20, 20, 20, 20, 20, 20, 20,
+	20, 20, 20, 21, 21, 21, 21, 21, 21, 21, 21, 21, 21, 21, 21, 21,
+	21, 21, 21, 22, 22, 22, 22, 22, 22, 22, 22, 22, 22, 22, 22, 22,
+	22, 22, 22, 23, 23, 23, 23, 23, 23, 23, 23, 23, 23, 23, 23, 23,
+	23, 23, 23, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24,
+	24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24,
+	24, 24, 24, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25,
+	25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25,
+	25, 25, 25, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26,
+	26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26,
+	26, 26, 26, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27,
+	27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27,
+	27, 27, 28
+};
 
-	return i - 1;
-}
+/**
+ * @brief Distance index of each distance - 1 : distances 1 to 256 first, then (distance - 1) >> 7 for longer distances.
+ */
+const uint8_t deflate_huffman_distance_indexes[512] = {
+	 0,  1,  2,  3,  4,  4,  5,  5,  6,  6,  6,  6,  7,  7,  7,  7,
+	 8,  8,  8,  8,  8,  8,  8,  8,  9,  9,  9,  9,  9,  9,  9,  9,
+	10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10,
+	11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11,
+	12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12,
+	12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12,
+	13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13,
+	13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13,
+	14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14,
+	14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14,
+	14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14,
+	14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14,
+	15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15,
+	15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15,
+	15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15,
+	15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15,
+	 0, 14, 16, 17, 18, 18, 19, 19, 20, 20, 20, 20, 21, 21, 21, 21,
+	22, 22, 22, 22, 22, 22, 22, 22, 23, 23, 23, 23, 23, 23, 23, 23,
+	24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24,
+	25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25,
+	26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26,
+	26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26,
+	27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27,
+	27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27,
+	28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28,
+	28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28,
+	28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28,
+	28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28,
+	29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29,
+	29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29,
+	29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29,
+	29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29
+};
 
 /**
- * @brief Get huffman length index.
+ * @brief Get huffman distance extra bits.
  * 
- * @param length	length
+ * @param index		distance index
  * 
- * @return index
+ * @return number of extra bits
  */
-int deflate_huffman_length_index(int length)
+int deflate_huffman_distance_extra_bits(int index)
 {
-	int i;
-
-	for (i = 1; i < NR_LENGTHS; i++)
-		if (length < huffman_lengths[i])
-			break;
-
-	return i - 1;
+	return huffman_distances_extra_bits[index];
 }
 
 /**
- * @brief Decode a distance literal.
+ * @brief Get huffman length extra bits.
  * 
- * @param bs_in		input bit stream
- * @param index		index
+ * @param index		length index
  * 
- * @return distance
+ * @return number of extra bits
  */
-static int __decode_distance(struct bit_stream *bs_in, int index)
+int deflate_huffman_length_extra_bits(int index)
 {
-	return huffman_distances[index] + bit_stream_read_bits(bs_in, huffman_distances_extra_bits[index], BIT_ORDER_LSB);
+	return huffman_lengths_extra_bits[index];
 }
 
 /**
- * @brief Decode a length literal.
- *
+ * @brief Decode a distance (read extra bits).
+ * 
  * @param bs_in		input bit stream
- * @param index		index
+ * @param index		distance index
  * 
- * @return length
+ * @return distance
  */
-static int __decode_length(struct bit_stream *bs_in, int index)
+int deflate_huffman_decode_distance(struct bit_stream *bs_in, int index)
 {
-	return huffman_lengths[index] + bit_stream_read_bits(bs_in, huffman_lengths_extra_bits[index], BIT_ORDER_LSB);
+	return huffman_distances[index] + bit_stream_read_bits_lsb(bs_in, huffman_distances_extra_bits[index]);
 }
 
 /**
- * @brief Write a literal.
+ * @brief Decode a length (read extra bits).
  * 
- * @param literal 		literal
- * @param table			huffman table
- * @param bs_out 		output bit stream
- */
-static void __write_literal(uint8_t literal, struct huffman_table *table, struct bit_stream *bs_out)
-{
-	bit_stream_write_bits(bs_out, table->codes[literal], table->codes_len[literal], BIT_ORDER_MSB);
-}
-
-/**
- * @brief Write a distance.
+ * @param bs_in		input bit stream
+ * @param index		length index
  * 
- * @param distance 		distance
- * @param table			huffman table
- * @param bs_out 		output bit stream
+ * @return length
  */
-static void __write_distance(int distance, struct huffman_table *table, struct bit_stream *bs_out)
+int deflate_huffman_decode_length(struct bit_stream *bs_in, int index)
 {
-	/* get distance index */
-	int i = deflate_huffman_distance_index(distance);
-	
-	/* write distance index */
-	bit_stream_write_bits(bs_out, table->codes[i], table->codes_len[i], BIT_ORDER_MSB);
-
-	/* write distance extra bits */
-	bit_stream_write_bits(bs_out, distance - huffman_distances[i], huffman_distances_extra_bits[i], BIT_ORDER_LSB);
+	return huffman_lengths[index] + bit_stream_read_bits_lsb(bs_in, huffman_lengths_extra_bits[index]);
 }
 
 /**
- * @brief Write a length.
+ * @brief Compute length of LZ77 tokens encoded with huffman alphabet (from tokens frequencies).
  * 
- * @param length 		length
- * @param table		huffman table
- * @param bs_out 		output bit stream
+ * @param tokens 		LZ77 tokens
+ * @param table_lit 		literals huffman table
+ * @param table_dist 		distances huffman table
+ * 
+ * @return length in bits (without huffman tables, with "end of block" character)
  */
-static void __write_length(int length, struct huffman_table *table, struct bit_stream *bs_out)
+uint32_t deflate_huffman_compressed_len(struct lz77_tokens *tokens, const struct huffman_table *table_lit,
+					const struct huffman_table *table_dist)
 {
-	/* get length index */
-	int i = deflate_huffman_length_index(length);
+	uint32_t len = 0, i;
+
+	/* literals, "end of block" character and lengths */
+	for (i = 0; i < 257; i++)
+		len += tokens->freqs_lit[i] * table_lit->codes_len[i];
+	for (i = 0; i < NR_LENGTHS; i++)
+		len += tokens->freqs_lit[257 + i] * (table_lit->codes_len[257 + i] + huffman_lengths_extra_bits[i]);
 
-	/* write length index */
-	bit_stream_write_bits(bs_out, table->codes[i + 257], table->codes_len[i + 257], BIT_ORDER_MSB);
+	/* distances */
+	for (i = 0; i < NR_DISTANCES; i++)
+		len += tokens->freqs_dist[i] * (table_dist->codes_len[i] + huffman_distances_extra_bits[i]);
 
-	/* write length extra bits */
-	bit_stream_write_bits(bs_out, length - huffman_lengths[i], huffman_lengths_extra_bits[i], BIT_ORDER_LSB);
+	return len;
 }
 
 /**
- * @brief Compress LZ77 nodes with huffman alphabet.
+ * @brief Compress LZ77 tokens with huffman alphabet.
+ * 
+ * Codes are reversed once (they are written Most Significant bit first) : a whole match (length code,
+ * length extra bits, distance code, distance extra bits = at most 48 bits) is written at once.
  * 
- * @param lz77_nodes 		LZ77 nodes
+ * @param tokens 		LZ77 tokens
+ * @param table_lit 		literals huffman table
+ * @param table_dist 		distances huffman table
  * @param bs_out 		output bit stream
- * @param dynamic		use dynamic alphabet ?
+ * @param dynamic		use dynamic alphabet ? (tables are written before tokens)
  */
-void deflate_huffman_compress(struct lz77_node *lz77_nodes, struct bit_stream *bs_out, int dynamic)
+void deflate_huffman_compress(struct lz77_tokens *tokens, const struct huffman_table *table_lit, const struct huffman_table *table_dist,
+			      struct bit_stream *bs_out, int dynamic)
 {
-	struct huffman_table table_lit, table_dist;
-	struct lz77_node *node;
-
-	/* build huffman tables */
-	if (dynamic)
-		deflate_huffman_build_dynamic_tables(lz77_nodes, &table_lit, &table_dist);
-	else
-		deflate_huffman_build_fix_tables(&table_lit, &table_dist);
+	uint32_t codes_lit[NR_LITERALS], codes_dist[NR_DISTANCES], token, length, distance, li, di, nr_bits, i;
+	uint64_t bits;
 
 	/* write huffman tables */
 	if (dynamic)
-		deflate_huffman_write_tables(bs_out, &table_lit, &table_dist);
-
-	/* compress each lz77 node */
-	for (node = lz77_nodes; node != NULL; node = node->next) {
-		if (node->is_literal) {
-			__write_literal(node->data.literal, &table_lit, bs_out);
-		} else {
-			__write_length(node->data.match.length, &table_lit, bs_out);
-			__write_distance(node->data.match.distance, &table_dist, bs_out);
+		deflate_huffman_write_tables(bs_out, table_lit, table_dist);
+
+	/* reverse codes once */
+	for (i = 0; i < NR_LITERALS; i++)
+		codes_lit[i] = bit_stream_reverse_bits(table_lit->codes[i], table_lit->codes_len[i]);
+	for (i = 0; i < NR_DISTANCES; i++)
+		codes_dist[i] = bit_stream_reverse_bits(table_dist->codes[i], table_dist->codes_len[i]);
+
+	/* compress each lz77 token */
+	for (i = 0; i < tokens->size; i++) {
+		token = tokens->tokens[i];
+		if (lz77_token_is_literal(token)) {
+			bit_stream_write_bits_lsb(bs_out, codes_lit[token], table_lit->codes_len[token]);
+			continue;
 		}
+
+		/* length code and extra bits */
+		length = lz77_token_length(token);
+		li = deflate_huffman_length_index(length);
+		bits = codes_lit[257 + li] | (uint64_t) (length - huffman_lengths[li]) << table_lit->codes_len[257 + li];
+		nr_bits = table_lit->codes_len[257 + li] + huffman_lengths_extra_bits[li];
+
+		/* distance code and extra bits */
+		distance = lz77_token_distance(token);
+		di = deflate_huffman_distance_index(distance);
+		bits |= (codes_dist[di] | (uint64_t) (distance - huffman_distances[di]) << table_dist->codes_len[di]) << nr_bits;
+		nr_bits += table_dist->codes_len[di] + huffman_distances_extra_bits[di];
+
+		bit_stream_write_bits_lsb(bs_out, bits, nr_bits);
 	}
 
 	/* write end of block */
-	bit_stream_write_bits(bs_out, table_lit.codes[256], table_lit.codes_len[256], BIT_ORDER_MSB);
-
-	/* free huffman tables */
-	huffman_table_free(&table_lit);
-	huffman_table_free(&table_dist);
+	bit_stream_write_bits_lsb(bs_out, codes_lit[256], table_lit->codes_len[256]);
 }
 
 /**
  * @brief Uncompress LZ77 nodes with huffman alphabet.
  * 
  * @param bs_in 		input bit stream
- * @param buf_out 		output buffer
+ * @param buf_start 		output buffer start (matches can't reach before it)
+ * @param buf_out 		output buffer (current position)
+ * @param buf_end 		output buffer end
  * @param dynamic		use dynamic alphabet ?
  *
- * @return number of bytes written to output buffer
+ * @return number of bytes written to output buffer, -1 on corrupted input
  */
-int deflate_huffman_uncompress(struct bit_stream *bs_in, uint8_t *buf_out, int dynamic)
+int deflate_huffman_uncompress(struct bit_stream *bs_in, uint8_t *buf_start, uint8_t *buf_out, uint8_t *buf_end, int dynamic)
 {
-	struct huffman_table table_lit, table_dist;
-	int literal, length, distance, n, i;
-
-	/* build huffman tables */
-	if (dynamic)
-		deflate_huffman_read_tables(bs_in, &table_lit, &table_dist);
-	else
-		deflate_huffman_build_fix_tables(&table_lit, &table_dist);
+	const struct huffman_table *table_lit = &deflate_huffman_fix_table_lit, *table_dist = &deflate_huffman_fix_table_dist;
+	struct huffman_table table_dyn_lit, table_dyn_dist;
+	int literal, length, distance, index, n, ret = -1;
+
+	/* read dynamic huffman tables */
+	if (dynamic) {
+		if (deflate_huffman_read_tables(bs_in, &table_dyn_lit, &table_dyn_dist) < 0)
+			return -1;
+		table_lit = &table_dyn_lit;
+		table_dist = &table_dyn_dist;
+	}
 
 	/* uncompress */
 	for (n = 0;;) {
 		/* read next literal */
-		literal = huffman_table_read_symbol(bs_in, &table_lit);
+		literal = huffman_table_read_symbol(bs_in, table_lit);
 
 		/* end of block */
-		if (literal == 256)
+		if (literal == 256) {
+			ret = n;
+			break;
+		}
+
+		/* invalid code */
+		if (literal < 0 || literal > 285)
 			break;
 
 		/* literal : just add it to output buffer */
 		if (literal < 256) {
+			if (buf_out + n >= buf_end)
+				break;
 			buf_out[n++] = literal;
 			continue;
 		}
 
 		/* decode lz77 length */
-		length = __decode_length(bs_in, literal - 257);
+		length = deflate_huffman_decode_length(bs_in, literal - 257);
 
 		/* decode lz77 distance */
-		distance = __decode_distance(bs_in, huffman_table_read_symbol(bs_in, &table_dist));
+		index = huffman_table_read_symbol(bs_in, table_dist);
+		if (index < 0 || index >= NR_DISTANCES)
+			break;
+		distance = deflate_huffman_decode_distance(bs_in, index);
+
+		/* duplicate pattern (match must stay in output buffer) */
+		if (distance > buf_out + n - buf_start || length > buf_end - buf_out - n)
+			break;
+		match_copy(buf_out + n, distance, length, buf_end);
+		n += length;
+	}
 
-		/* duplicate pattern */
-		for (i = 0; i < length; i++, n++)
-			buf_out[n] = buf_out[n - distance];
+	/* free dynamic huffman tables */
+	if (dynamic) {
+		huffman_table_free(&table_dyn_lit);
+		huffman_table_free(&table_dyn_dist);
 	}
 
-	return n;
+	return ret;
 }
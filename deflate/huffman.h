@@ -5,16 +5,22 @@
 #include "../huffman/huffman_table.h"
 #include "../utils/bit_stream.h"
 
-#define NR_LITERALS		286
-#define NR_LENGTHS 		29
-#define NR_DISTANCES		30
+/* length and distance indexes lookup tables */
+extern const uint8_t deflate_huffman_length_indexes[LZ77_MAX_LEN + 1];
+extern const uint8_t deflate_huffman_distance_indexes[512];
 
 /**
  * @brief Get huffman distance index.
  * 
  * @param distance	distance
+ * 
+ * @return index
  */
-int deflate_huffman_distance_index(int distance);
+static inline int deflate_huffman_distance_index(int distance)
+{
+	distance--;
+	return distance < 256 ? deflate_huffman_distance_indexes[distance] : deflate_huffman_distance_indexes[256 + (distance >> 7)];
+}
 
 /**
  * @brief Get huffman length index.
@@ -23,26 +29,84 @@ int deflate_huffman_distance_index(int distance);
  * 
  * @return index
  */
-int deflate_huffman_length_index(int length);
+static inline int deflate_huffman_length_index(int length)
+{
+	return deflate_huffman_length_indexes[length];
+}
+
+/**
+ * @brief Get huffman distance extra bits.
+ * 
+ * @param index		distance index
+ * 
+ * @return number of extra bits
+ */
+int deflate_huffman_distance_extra_bits(int index);
+
+/**
+ * @brief Get huffman length extra bits.
+ * 
+ * @param index		length index
+ * 
+ * @return number of extra bits
+ */
+int deflate_huffman_length_extra_bits(int index);
+
+/**
+ * @brief Decode a distance (read extra bits).
+ * 
+ * @param bs_in		input bit stream
+ * @param index		distance index
+ * 
+ * @return distance
+ */
+int deflate_huffman_decode_distance(struct bit_stream *bs_in, int index);
+
+/**
+ * @brief Decode a length (read extra bits).
+ * 
+ * @param bs_in		input bit stream
+ * @param index		length index
+ * 
+ * @return length
+ */
+int deflate_huffman_decode_length(struct bit_stream *bs_in, int index);
 
 /**
- * @brief Compress LZ77 nodes with huffman alphabet.
+ * @brief Compute length of LZ77 tokens encoded with huffman alphabet (from tokens frequencies).
+ * 
+ * @param tokens 		LZ77 tokens
+ * @param table_lit 		literals huffman table
+ * @param table_dist 		distances huffman table
  * 
- * @param lz77_nodes 		LZ77 nodes
+ * @return length in bits (without huffman tables, with "end of block" character)
+ */
+uint32_t deflate_huffman_compressed_len(struct lz77_tokens *tokens, const struct huffman_table *table_lit,
+					const struct huffman_table *table_dist);
+
+/**
+ * @brief Compress LZ77 tokens with huffman alphabet.
+ * 
+ * @param tokens 		LZ77 tokens
+ * @param table_lit 		literals huffman table
+ * @param table_dist 		distances huffman table
  * @param bs_out 		output bit stream
- * @param dynamic		use dynamic alphabet ?
+ * @param dynamic		use dynamic alphabet ? (tables are written before tokens)
  */
-void deflate_huffman_compress(struct lz77_node *lz77_nodes, struct bit_stream *bs_out, int dynamic);
+void deflate_huffman_compress(struct lz77_tokens *tokens, const struct huffman_table *table_lit, const struct huffman_table *table_dist,
+			      struct bit_stream *bs_out, int dynamic);
 
 /**
  * @brief Uncompress LZ77 nodes with huffman alphabet.
  * 
  * @param bs_in 		input bit stream
- * @param buf_out 		output buffer
+ * @param buf_start 		output buffer start (matches can't reach before it)
+ * @param buf_out 		output buffer (current position)
+ * @param buf_end 		output buffer end
  * @param dynamic		use dynamic alphabet ?
  *
- * @return number of bytes written to output buffer
+ * @return number of bytes written to output buffer, -1 on corrupted input
  */
-int deflate_huffman_uncompress(struct bit_stream *bs_in, uint8_t *buf_out, int dynamic);
+int deflate_huffman_uncompress(struct bit_stream *bs_in, uint8_t *buf_start, uint8_t *buf_out, uint8_t *buf_end, int dynamic);
 
 #endif
@@ -4,254 +4,875 @@
  *   - if a match is found, pattern offset and length are written
  *   - otherwiser, literal is written
  */
+#include <assert.h>
 #include <string.h>
 #include <endian.h>
 
 #include "lz77.h"
+#include "deflate.h"
+#include "huffman.h"
 #include "../utils/bit_stream.h"
 #include "../utils/mem.h"
 
-#define LZ77_MIN_LEN			3
-#define LZ77_MAX_LEN			258
-#define LZ77_MAX_DIST			32768
-#define LZ77_HASH_SIZE			32768
+#define LZ77_WINDOW_MASK		(LZ77_MAX_DIST - 1)
+#define LZ77_TOO_FAR			4096
+#define LZ77_HASH_MULTIPLIER		0x9E3779B1
+#define LZ77_BT_HASH3_BITS		15
+#define LZ77_MIN_HASH_BITS		8
+#define LZ77_BT_NIL			UINT32_MAX
+#define LZ77_TOKENS_MIN_CAPACITY	0x10000
 
 /**
- * @brief Hash table node.
+ * @brief Compression levels parameters.
  */
-struct hash_node {
-	int 			index;
-	struct hash_node *	next;
+static const struct lz77_config lz77_configs[] = {
+	/* good	lazy	nice	chain	hash bits	optimal passes	match finder		block split */
+	{ 4,	0,	8,	4,	12,		0,		LZ77_HASH_CHAINS,		0 },		/* level 1 (greedy) */
+	{ 4,	0,	16,	8,	13,		0,		LZ77_HASH_CHAINS,		0 },		/* level 2 (greedy) */
+	{ 4,	0,	32,	32,	14,		0,		LZ77_HASH_CHAINS,		0 },		/* level 3 (greedy) */
+	{ 4,	4,	16,	16,	14,		0,		LZ77_HASH_CHAINS,		0 },		/* level 4 */
+	{ 8,	16,	32,	32,	15,		0,		LZ77_HASH_CHAINS,		0 },		/* level 5 */
+	{ 8,	16,	128,	128,	15,		0,		LZ77_HASH_CHAINS,		0 },		/* level 6 */
+	{ 8,	32,	128,	256,	15,		0,		LZ77_HASH_CHAINS,		0 },		/* level 7 */
+	{ 32,	128,	258,	1024,	16,		0,		LZ77_HASH_CHAINS,		0 },		/* level 8 */
+	{ 32,	258,	258,	4096,	16,		0,		LZ77_HASH_CHAINS,		0 },		/* level 9 */
+	{ 32,	258,	258,	32,	16,		2,		LZ77_BINARY_TREES,	1 },		/* level 10 (optimal) */
+	{ 32,	258,	258,	64,	16,		4,		LZ77_BINARY_TREES,	1 },		/* level 11 (optimal) */
+	{ 32,	258,	258,	128,	16,		8,		LZ77_BINARY_TREES,	1 },		/* level 12 (optimal) */
 };
 
 /**
- * @brief Add a node to a hash table.
+ * @brief Get compression level parameters.
  * 
- * @param hash_nodes 		nodes
- * @param nr_hash_nodes		number of nodes in hash table
- * @param index 		node index
- * @param head 			head of nodes
+ * @param level 	compression level (clamped to 1..12)
  * 
- * @return new node
+ * @return parameters
  */
-static struct hash_node *__hash_add_node(struct hash_node *hash_nodes, uint32_t *nr_hash_nodes, uint32_t index, struct hash_node *head)
+const struct lz77_config *deflate_lz77_config(int level)
 {
-	struct hash_node *node;
+	if (level < DEFLATE_LEVEL_MIN)
+		level = DEFLATE_LEVEL_MIN;
+	if (level > DEFLATE_LEVEL_MAX)
+		level = DEFLATE_LEVEL_MAX;
 
-	/* get next free node */
-	node = &hash_nodes[*nr_hash_nodes];
-	*nr_hash_nodes += 1;
+	return &lz77_configs[level - DEFLATE_LEVEL_MIN];
+}
+
+/**
+ * @brief Hash next 3 characters (4 bytes are loaded, last one is masked).
+ * 
+ * @param s 		characters to hash
+ * @param hash_bits	hash bits
+ * 
+ * @return hash code
+ */
+static inline uint32_t __lz77_hash(uint8_t *s, uint32_t hash_bits)
+{
+	uint32_t v;
 
-	/* set node */
-	node->index = index;
-	node->next = head;
+	memcpy(&v, s, sizeof(uint32_t));
+	v = le32toh(v) & 0xFFFFFF;
 
-	return node;
+	return (v * LZ77_HASH_MULTIPLIER) >> (32 - hash_bits);
 }
 
 /**
- * @brief Hash 3 characters.
+ * @brief Hash next 4 characters.
  * 
- * @param s 	characters to hash
+ * @param s 		characters to hash
+ * @param hash_bits	hash bits
  * 
  * @return hash code
  */
-static inline int __lz77_hash(uint8_t *s)
+static inline uint32_t __lz77_hash4(uint8_t *s, uint32_t hash_bits)
 {
-	int h, i;
+	uint32_t v;
 
-	for (i = 1, h = *s++; i < LZ77_MIN_LEN; i++)
-		h = (h << 5) - h + *s++;
+	memcpy(&v, s, sizeof(uint32_t));
 
-	return h % LZ77_HASH_SIZE;
+	return (le32toh(v) * LZ77_HASH_MULTIPLIER) >> (32 - hash_bits);
 }
 
 /**
- * @brief Create a LZ77 literal node.
+ * @brief Insert a position in hash chains.
  * 
- * @param c 	literal
+ * @param hash 		hash chains
+ * @param src 		input buffer
+ * @param pos 		position
+ */
+static inline void __lz77_insert(struct lz77_hash *hash, uint8_t *src, uint32_t pos)
+{
+	uint32_t h = __lz77_hash(src + pos, hash->hash_bits);
+
+	hash->prev[pos & LZ77_WINDOW_MASK] = hash->head[h];
+	hash->head[h] = pos;
+}
+
+/**
+ * @brief Reset hash chains for a new input (only positions of this input are cleared).
  * 
- * @return LZ77 node
+ * @param hash 		hash chains
+ * @param hash_bits 	hash table bits (<= bits given at init)
+ * @param len 		input length
  */
-static struct lz77_node *__lz77_create_literal_node(uint8_t c)
+static void __lz77_hash_reset(struct lz77_hash *hash, uint32_t hash_bits, uint32_t len)
 {
-	struct lz77_node *node;
+	hash->hash_bits = hash_bits;
+	memset(hash->head, 0, sizeof(uint16_t) << hash_bits);
+	memset(hash->prev, 0, sizeof(uint16_t) * (len < LZ77_MAX_DIST ? len : LZ77_MAX_DIST));
+}
 
-	node = (struct lz77_node *) xmalloc(sizeof(struct lz77_node));
-	node->is_literal = 1;
-	node->data.literal = c;
-	node->next = NULL;
+/**
+ * @brief Init hash chains (tables are cleared by deflate_lz77_context_reset).
+ * 
+ * @param hash 		hash chains
+ * @param hash_bits 	hash table bits
+ */
+void deflate_lz77_hash_init(struct lz77_hash *hash, uint32_t hash_bits)
+{
+	hash->hash_bits = hash_bits;
+	hash->head = (uint16_t *) xmalloc(sizeof(uint16_t) << hash_bits);
+	hash->prev = (uint16_t *) xmalloc(sizeof(uint16_t) * LZ77_MAX_DIST);
+}
 
-	return node;
+/**
+ * @brief Free hash chains.
+ * 
+ * @param hash 		hash chains
+ */
+void deflate_lz77_hash_free(struct lz77_hash *hash)
+{
+	xfree(hash->head);
+	xfree(hash->prev);
 }
 
 /**
- * @brief Create a LZ77 match node.
+ * @brief Compute match length.
  * 
- * @param distance	distance from current position
- * @param length	match length
+ * @param s1 		first buffer
+ * @param s2 		second buffer
+ * @param max 		maximum length
  * 
- * @return LZ77 node
+ * @return match length
  */
-static struct lz77_node *__lz77_create_match_node(int distance, uint32_t length)
+static inline uint32_t __lz77_match_length(uint8_t *s1, uint8_t *s2, uint32_t max)
 {
-	struct lz77_node *node;
+	uint64_t w1, w2;
+	uint32_t len = 0;
+
+	/* compare 8 bytes at once */
+	while (len + sizeof(uint64_t) <= max) {
+		memcpy(&w1, s1 + len, sizeof(uint64_t));
+		memcpy(&w2, s2 + len, sizeof(uint64_t));
+		if (w1 != w2)
+			return len + (__builtin_ctzll(le64toh(w1) ^ le64toh(w2)) >> 3);
+		len += sizeof(uint64_t);
+	}
 
-	node = (struct lz77_node *) xmalloc(sizeof(struct lz77_node));
-	node->is_literal = 0;
-	node->data.match.distance = distance;
-	node->data.match.length = length;
-	node->next = NULL;
+	/* compare last bytes */
+	while (len < max && s1[len] == s2[len])
+		len++;
 
-	return node;
+	return len;
 }
 
 /**
- * @brief Find best match.
+ * @brief Find longest match in hash chain of current position.
+ * 
+ * @param hash 			hash chains
+ * @param config 		compression level parameters
+ * @param src 			input buffer
+ * @param src_len 		input buffer length
+ * @param pos 			current position
+ * @param prev_len 		length to beat (previous match length)
+ * @param match_distance	output match distance
  * 
- * @param match 		hash match
- * @param buf 			input buffer
- * @param len 			input buffer length
- * @param ptr 			current pointer in input buffer
- *
- * @return LZ77 node (match or literal)
+ * @return match length (0 if no match longer than prev_len found)
  */
-static struct lz77_node *__lz77_best_match(struct hash_node *hash_match, uint8_t *buf, int len, uint8_t *ptr)
+static uint32_t __lz77_longest_match(struct lz77_hash *hash, const struct lz77_config *config, uint8_t *src, uint32_t src_len,
+				     uint32_t pos, uint32_t prev_len, uint32_t *match_distance)
 {
-	uint32_t max, len_max = 0, i;
-	struct hash_node *match_max;
-	uint8_t *match_buf;
+	uint32_t max, max_dist, chain, dist, next_dist, len, best_len = prev_len;
+	uint8_t *ptr = src + pos, *match;
 
-	/* compute maximum match length */
-	max = len - (ptr - buf);
+	/* compute maximum match length and distance */
+	max = src_len - pos;
 	if (max > LZ77_MAX_LEN)
 		max = LZ77_MAX_LEN;
+	max_dist = pos < LZ77_MAX_DIST ? pos : LZ77_MAX_DIST;
 
-	/* for each match */
-	for (; hash_match != NULL; hash_match = hash_match->next) {
-		match_buf = buf + hash_match->index;
+	/* previous match can't be improved */
+	if (prev_len >= max)
+		return 0;
 
-		/* match too far */
-		if (ptr - match_buf > LZ77_MAX_DIST)
-			break;
+	/* previous match is already good : search less */
+	chain = config->max_chain;
+	if (prev_len >= config->good_length)
+		chain >>= 2;
+
+	/* walk through hash chain */
+	dist = (uint16_t) (pos - hash->head[__lz77_hash(ptr, hash->hash_bits)]);
+	for (; chain > 0 && dist > 0 && dist <= max_dist; chain--) {
+		match = ptr - dist;
 
 		/* no way to improve best match */
-		if (len_max >= max || match_buf[len_max] != ptr[len_max])
-			continue;
+		if (match[best_len] == ptr[best_len] && (len = __lz77_match_length(match, ptr, max)) > best_len) {
+			best_len = len;
+			*match_distance = dist;
+
+			/* match long enough */
+			if (best_len >= config->nice_length || best_len >= max)
+				break;
+		}
+
+		/* go to previous position (chain must go backward, otherwise it is stale) */
+		next_dist = (uint16_t) (pos - hash->prev[(pos - dist) & LZ77_WINDOW_MASK]);
+		if (next_dist <= dist)
+			break;
+		dist = next_dist;
+	}
+
+	return best_len > prev_len ? best_len : 0;
+}
+
+/**
+ * @brief Find all matches of current position (and add it to hash chains).
+ * 
+ * @param hash 			hash chains
+ * @param config 		compression level parameters
+ * @param src 			input buffer
+ * @param src_len 		input buffer length
+ * @param pos 			current position
+ * @param matches 		output matches (at most LZ77_MAX_MATCHES)
+ * 
+ * @return number of matches
+ */
+uint32_t deflate_lz77_find_matches(struct lz77_hash *hash, const struct lz77_config *config, uint8_t *src, uint32_t src_len,
+				   uint32_t pos, struct lz77_match *matches)
+{
+	uint32_t max, max_dist, chain, dist, next_dist, len, best_len = LZ77_MIN_LEN - 1, n = 0;
+	uint8_t *ptr = src + pos, *match;
 
-		/* compute match length */
-		for (i = 0; match_buf[i] == ptr[i] && i < max; i++);
+	/* hash needs 4 bytes */
+	if (pos + sizeof(uint32_t) > src_len)
+		return 0;
 
-		/* update maximum match length */
-		if (i > len_max) {
-			len_max = i;
-			match_max = hash_match;
+	/* compute maximum match length and distance */
+	max = src_len - pos;
+	if (max > LZ77_MAX_LEN)
+		max = LZ77_MAX_LEN;
+	max_dist = pos < LZ77_MAX_DIST ? pos : LZ77_MAX_DIST;
+
+	/* walk through hash chain */
+	dist = (uint16_t) (pos - hash->head[__lz77_hash(ptr, hash->hash_bits)]);
+	for (chain = config->max_chain; chain > 0 && dist > 0 && dist <= max_dist; chain--) {
+		match = ptr - dist;
+
+		/* keep only longer matches (closest distance for each length) */
+		if (match[best_len] == ptr[best_len] && (len = __lz77_match_length(match, ptr, max)) > best_len) {
+			best_len = len;
+			matches[n].distance = dist;
+			matches[n].length = len;
+			n++;
+
+			/* match long enough */
+			if (best_len >= config->nice_length || best_len >= max)
+				break;
 		}
+
+		/* go to previous position (chain must go backward, otherwise it is stale) */
+		next_dist = (uint16_t) (pos - hash->prev[(pos - dist) & LZ77_WINDOW_MASK]);
+		if (next_dist <= dist)
+			break;
+		dist = next_dist;
 	}
 
-	/* match too short : create a literal */
-	if (len_max < LZ77_MIN_LEN)
-		return __lz77_create_literal_node(*ptr);
+	/* add current position to hash chains */
+	__lz77_insert(hash, src, pos);
 
-	/* create a match node */
-	return __lz77_create_match_node(ptr - (buf + match_max->index), len_max);
+	return n;
 }
 
 /**
- * @brief Skip 'len' bytes (and hash skipped bytes).
+ * @brief Reset binary trees for a new input.
  * 
- * @param buf 		input buffer
- * @param nodes 	hash nodes
- * @param nr_hash_nodes	number of hash nodes
- * @param hash_table 	hash table
- * @param ptr 		current pointer in input buffer
- * @param len 		number of bytes to skip
+ * @param bt 		binary trees
+ * @param hash_bits 	hash table bits (<= bits given at init)
+ */
+static void __lz77_bt_reset(struct lz77_bt *bt, uint32_t hash_bits)
+{
+	uint32_t i;
+
+	bt->hash_bits = hash_bits;
+	bt->hash3_bits = hash_bits < LZ77_BT_HASH3_BITS ? hash_bits : LZ77_BT_HASH3_BITS;
+	bt->next_pos = 0;
+
+	/* empty trees (children are always set on insertion) */
+	for (i = 0; i < 1U << bt->hash3_bits; i++)
+		bt->head3[i] = LZ77_BT_NIL;
+	for (i = 0; i < 1U << hash_bits; i++)
+		bt->head[i] = LZ77_BT_NIL;
+}
+
+/**
+ * @brief Init binary trees (trees are emptied by deflate_lz77_context_reset).
  * 
- * @return number of bytes skipped
+ * @param bt 		binary trees
+ * @param hash_bits 	hash table bits
  */
-static int __lz77_skip(uint8_t *buf, struct hash_node *hash_nodes, uint32_t *nr_hash_nodes, struct hash_node **hash_table, uint8_t *ptr, uint32_t len)
+void deflate_lz77_bt_init(struct lz77_bt *bt, uint32_t hash_bits)
 {
-	uint32_t i, index;
+	bt->hash_bits = hash_bits;
+	bt->hash3_bits = LZ77_BT_HASH3_BITS;
+	bt->next_pos = 0;
+	bt->head3 = (uint32_t *) xmalloc(sizeof(uint32_t) << LZ77_BT_HASH3_BITS);
+	bt->head = (uint32_t *) xmalloc(sizeof(uint32_t) << hash_bits);
+	bt->child = (uint32_t *) xmalloc(sizeof(uint32_t) * 2 * LZ77_MAX_DIST);
+}
 
-	/* hash skipped bytes */
-	for (i = 0; i < len; i++) {
-		index = __lz77_hash(&ptr[i]);
-		hash_table[index] = __hash_add_node(hash_nodes, nr_hash_nodes, ptr + i - buf, hash_table[index]);
+/**
+ * @brief Free binary trees.
+ * 
+ * @param bt 		binary trees
+ */
+void deflate_lz77_bt_free(struct lz77_bt *bt)
+{
+	xfree(bt->head3);
+	xfree(bt->head);
+	xfree(bt->child);
+}
+
+/**
+ * @brief Check if a binary tree node is in the window of current position.
+ * 
+ * @param node 		node position
+ * @param pos 		current position
+ * 
+ * @return 1 if node is in the window (distance < window size)
+ */
+static inline int __lz77_bt_in_window(uint32_t node, uint32_t pos)
+{
+	return node != LZ77_BT_NIL && pos - node < LZ77_MAX_DIST;
+}
+
+/**
+ * @brief Descend a binary tree.
+ * 
+ * @param bt 			binary trees
+ * @param config 		compression level parameters
+ * @param src 			input buffer
+ * @param pos 			current position
+ * @param max 			maximum match length
+ * @param best_len 		length to beat
+ * @param matches 		output matches (NULL to insert only)
+ * @param insert 		insert current position (needs LZ77_MAX_LEN bytes of lookahead) ?
+ * 
+ * @return number of matches
+ */
+static uint32_t __lz77_bt_descend(struct lz77_bt *bt, const struct lz77_config *config, uint8_t *src, uint32_t pos,
+				  uint32_t max, uint32_t best_len, struct lz77_match *matches, int insert)
+{
+	uint32_t nice, depth, h, len, best_lt_len = 0, best_gt_len = 0, n = 0, lt, gt;
+	uint32_t node, *pending_lt = &lt, *pending_gt = &gt, *children;
+	uint8_t *ptr = src + pos, *match;
+
+	/* a descent stops on nice length */
+	nice = config->nice_length < max ? config->nice_length : max;
+
+	/* current position becomes the root */
+	h = __lz77_hash4(ptr, bt->hash_bits);
+	node = bt->head[h];
+	if (insert) {
+		bt->head[h] = pos;
+		pending_lt = &bt->child[2 * (pos & LZ77_WINDOW_MASK)];
+		pending_gt = pending_lt + 1;
 	}
 
-	return len;
+	/*
+	 * Descend from root : each node shares at least min(best_lt_len, best_gt_len) bytes
+	 * with current position, so comparison starts from there.
+	 */
+	for (depth = config->max_chain, len = 0; __lz77_bt_in_window(node, pos) && depth > 0; depth--) {
+		match = src + node;
+		children = &bt->child[2 * (node & LZ77_WINDOW_MASK)];
+
+		/* extend match */
+		if (match[len] == ptr[len]) {
+			len += 1 + __lz77_match_length(match + len + 1, ptr + len + 1, max - len - 1);
+
+			/* new longest match */
+			if (len > best_len && matches) {
+				best_len = len;
+				matches[n].distance = pos - node;
+				matches[n].length = len;
+				n++;
+			}
+
+			/* match long enough : node is replaced by current position */
+			if (len >= nice) {
+				*pending_lt = children[0];
+				*pending_gt = children[1];
+				return n;
+			}
+		}
+
+		/* go to lesser or greater subtree */
+		if (match[len] < ptr[len]) {
+			*pending_lt = node;
+			pending_lt = &children[1];
+			node = *pending_lt;
+			best_lt_len = len;
+			if (best_gt_len < len)
+				len = best_gt_len;
+		} else {
+			*pending_gt = node;
+			pending_gt = &children[0];
+			node = *pending_gt;
+			best_gt_len = len;
+			if (best_lt_len < len)
+				len = best_lt_len;
+		}
+
+		/* search only : don't modify tree */
+		if (!insert) {
+			pending_lt = &lt;
+			pending_gt = &gt;
+		}
+	}
+
+	/* end of descent : cut remaining subtrees */
+	*pending_lt = LZ77_BT_NIL;
+	*pending_gt = LZ77_BT_NIL;
+
+	return n;
 }
 
 /**
- * @brief Compress a buffer with LZ77 algorithm.
+ * @brief Find all matches of current position with binary trees (and add it to binary trees).
  * 
- * @param buf 			input buffer
- * @param len 			input buffer length
+ * @param bt 			binary trees
+ * @param config 		compression level parameters
+ * @param src 			input buffer
+ * @param src_len 		input buffer length
+ * @param pos 			current position
+ * @param matches 		output matches (at most LZ77_MAX_MATCHES)
  * 
- * @return output LZ77 nodes
+ * @return number of matches
  */
-struct lz77_node *deflate_lz77_compress(uint8_t *src, uint32_t src_len)
+uint32_t deflate_lz77_bt_find_matches(struct lz77_bt *bt, const struct lz77_config *config, uint8_t *src, uint32_t src_len,
+				      uint32_t pos, struct lz77_match *matches)
 {
-	struct lz77_node *lz77_head = NULL, *lz77_tail = NULL;
-	struct hash_node **hash_table, *hash_nodes, *hash_match;
-	uint32_t i, index, nr_hash_nodes;
-	struct lz77_node *lz77_node;
-	uint8_t *ptr;
+	uint32_t max, h, node, n = 0;
+	uint8_t *ptr = src + pos;
+
+	/* hash needs 4 bytes */
+	if (pos + sizeof(uint32_t) > src_len)
+		return 0;
+
+	/* length 3 match (last position with same 3 bytes hash) */
+	h = __lz77_hash(ptr, bt->hash3_bits);
+	node = bt->head3[h];
+	bt->head3[h] = pos;
+	if (__lz77_bt_in_window(node, pos) && memcmp(src + node, ptr, LZ77_MIN_LEN) == 0) {
+		matches[n].distance = pos - node;
+		matches[n].length = LZ77_MIN_LEN;
+		n++;
+	}
+
+	/* not enough lookahead : search only */
+	if (pos + LZ77_MAX_LEN > src_len) {
+		max = src_len - pos;
+		return n + __lz77_bt_descend(bt, config, src, pos, max, n ? LZ77_MIN_LEN : LZ77_MIN_LEN - 1, matches + n, 0);
+	}
+
+	/* insert previous positions which had not enough lookahead */
+	for (; bt->next_pos < pos; bt->next_pos++)
+		if (pos - bt->next_pos < LZ77_MAX_DIST)
+			__lz77_bt_descend(bt, config, src, bt->next_pos, LZ77_MAX_LEN, 0, NULL, 1);
+
+	/* find matches and insert current position */
+	bt->next_pos = pos + 1;
+	return n + __lz77_bt_descend(bt, config, src, pos, LZ77_MAX_LEN, n ? LZ77_MIN_LEN : LZ77_MIN_LEN - 1, matches + n, 1);
+}
+
+/**
+ * @brief Init a tokens buffer.
+ * 
+ * @param tokens 	tokens buffer
+ */
+void deflate_lz77_tokens_init(struct lz77_tokens *tokens)
+{
+	tokens->capacity = LZ77_TOKENS_MIN_CAPACITY;
+	tokens->tokens = (uint32_t *) xmalloc(sizeof(uint32_t) * tokens->capacity);
+	deflate_lz77_tokens_reset(tokens);
+}
+
+/**
+ * @brief Reset a tokens buffer (keep memory for next block).
+ * 
+ * @param tokens 	tokens buffer
+ */
+void deflate_lz77_tokens_reset(struct lz77_tokens *tokens)
+{
+	tokens->size = 0;
+	memset(tokens->freqs_lit, 0, sizeof(tokens->freqs_lit));
+	memset(tokens->freqs_dist, 0, sizeof(tokens->freqs_dist));
 
-	/* create nodes array */
-	hash_nodes = (struct hash_node *) xmalloc(sizeof(struct hash_node) * src_len);
-	nr_hash_nodes = 0;
+	/* every block ends with "end of block" character */
+	tokens->freqs_lit[256] = 1;
+}
+
+/**
+ * @brief Free a tokens buffer.
+ * 
+ * @param tokens 	tokens buffer
+ */
+void deflate_lz77_tokens_free(struct lz77_tokens *tokens)
+{
+	xfree(tokens->tokens);
+}
 
-	/* create hash table */
-	hash_table = (struct hash_node **) xmalloc(sizeof(struct hash_node *) * LZ77_HASH_SIZE);
-	for (i = 0; i < LZ77_HASH_SIZE; i++)
-		hash_table[i] = NULL;
+/**
+ * @brief Add a token (grow buffer if needed).
+ * 
+ * @param tokens 	tokens buffer
+ * @param token 	token
+ */
+static inline void __lz77_tokens_add(struct lz77_tokens *tokens, uint32_t token)
+{
+	if (tokens->size >= tokens->capacity) {
+		tokens->capacity *= 2;
+		tokens->tokens = (uint32_t *) xrealloc(tokens->tokens, sizeof(uint32_t) * tokens->capacity);
+	}
 
-	/* find matching patterns */
-	for (ptr = src; ptr + LZ77_MIN_LEN - 1 - src < src_len; ptr++) {
-		/* compute next 3 characters hash */
-		index = __lz77_hash(ptr);
+	tokens->tokens[tokens->size++] = token;
+}
 
-		/* add it to hash table */
-		hash_match = hash_table[index];
-		hash_table[index] = __hash_add_node(hash_nodes, &nr_hash_nodes, ptr - src, hash_match);
+/**
+ * @brief Add a literal token.
+ * 
+ * @param tokens 	tokens buffer
+ * @param c 		literal
+ */
+void deflate_lz77_add_literal(struct lz77_tokens *tokens, uint8_t c)
+{
+	__lz77_tokens_add(tokens, lz77_token_literal(c));
+	tokens->freqs_lit[c]++;
+}
 
-		/* find best match */
-		lz77_node = __lz77_best_match(hash_match, src, src_len, ptr);
+/**
+ * @brief Add a match token.
+ * 
+ * @param tokens 	tokens buffer
+ * @param distance	distance from current position
+ * @param length	match length
+ */
+void deflate_lz77_add_match(struct lz77_tokens *tokens, uint32_t distance, uint32_t length)
+{
+	__lz77_tokens_add(tokens, lz77_token_match(distance, length));
+	tokens->freqs_lit[257 + deflate_huffman_length_index(length)]++;
+	tokens->freqs_dist[deflate_huffman_distance_index(distance)]++;
+}
 
-		/* add node to list */
-		if (!lz77_head) {
-			lz77_head = lz77_node;
-			lz77_tail = lz77_node;
+/**
+ * @brief Get a slice of a tokens buffer (slice shares tokens, frequencies are computed).
+ * 
+ * @param tokens 	tokens buffer
+ * @param first 	first token
+ * @param last 		last token (excluded)
+ * @param slice 	output slice
+ * 
+ * @return number of input bytes covered by slice
+ */
+uint32_t deflate_lz77_tokens_slice(struct lz77_tokens *tokens, uint32_t first, uint32_t last, struct lz77_tokens *slice)
+{
+	uint32_t len = 0, token, i;
+
+	slice->tokens = tokens->tokens + first;
+	slice->size = slice->capacity = last - first;
+	memset(slice->freqs_lit, 0, sizeof(slice->freqs_lit));
+	memset(slice->freqs_dist, 0, sizeof(slice->freqs_dist));
+	slice->freqs_lit[256] = 1;
+
+	for (i = 0; i < slice->size; i++) {
+		token = slice->tokens[i];
+		if (lz77_token_is_literal(token)) {
+			slice->freqs_lit[token]++;
+			len++;
 		} else {
-			lz77_tail->next = lz77_node;
-			lz77_tail = lz77_node;
+			slice->freqs_lit[257 + deflate_huffman_length_index(lz77_token_length(token))]++;
+			slice->freqs_dist[deflate_huffman_distance_index(lz77_token_distance(token))]++;
+			len += lz77_token_length(token);
 		}
+	}
+
+	return len;
+}
+
+/**
+ * @brief Greedy parsing : take longest match at each position.
+ * 
+ * @param hash 		hash chains
+ * @param config 	compression level parameters
+ * @param src 		input buffer
+ * @param start 	block start (previous bytes are history)
+ * @param end 		block end
+ * @param tokens 	output tokens
+ */
+static void __lz77_compress_greedy(struct lz77_hash *hash, const struct lz77_config *config, uint8_t *src, uint32_t start, uint32_t end,
+				   struct lz77_tokens *tokens)
+{
+	uint32_t pos, len, distance, i;
+
+	/* find matching patterns (hash loads 4 bytes) */
+	for (pos = start; pos < end;) {
+		len = 0;
 
-		/* skip match */
-		if (lz77_node->is_literal == 0)
-			ptr += __lz77_skip(src, hash_nodes, &nr_hash_nodes, hash_table, ptr, lz77_node->data.match.length - 1);
+		/* find longest match and add current position to hash chains */
+		if (pos + sizeof(uint32_t) <= end) {
+			len = __lz77_longest_match(hash, config, src, end, pos, 0, &distance);
+			__lz77_insert(hash, src, pos);
+		}
+
+		/* match too short : create a literal */
+		if (len < LZ77_MIN_LEN) {
+			deflate_lz77_add_literal(tokens, src[pos++]);
+			continue;
+		}
+
+		/* create a match */
+		deflate_lz77_add_match(tokens, distance, len);
+
+		/* hash skipped bytes */
+		for (i = 1; i < len && pos + i + sizeof(uint32_t) <= end; i++)
+			__lz77_insert(hash, src, pos + i);
+
+		pos += len;
 	}
+}
 
-	/* add remaining bytes */
-	for (; ptr - src < src_len; ptr++) {
-		/* create a literal node */
-		lz77_node = __lz77_create_literal_node(*ptr);
+/**
+ * @brief Lazy parsing : a match is emitted only if next position has no longer match
+ * (otherwise a literal is emitted and next match is considered).
+ * 
+ * @param hash 		hash chains
+ * @param config 	compression level parameters
+ * @param src 		input buffer
+ * @param start 	block start (previous bytes are history)
+ * @param end 		block end
+ * @param tokens 	output tokens
+ */
+static void __lz77_compress_lazy(struct lz77_hash *hash, const struct lz77_config *config, uint8_t *src, uint32_t start, uint32_t end,
+				 struct lz77_tokens *tokens)
+{
+	uint32_t pos, len, distance = 0, prev_len = 0, prev_distance = 0, i;
+	int match_available = 0;
 
-		/* add node to list */
-		if (!lz77_head) {
-			lz77_head = lz77_node;
-			lz77_tail = lz77_node;
-		} else {
-			lz77_tail->next = lz77_node;
-			lz77_tail = lz77_node;
+	for (pos = start; pos < end;) {
+		len = 0;
+
+		/* find a longer match than previous one (unless previous one is long enough) */
+		if (pos + sizeof(uint32_t) <= end) {
+			if (prev_len < config->max_lazy)
+				len = __lz77_longest_match(hash, config, src, end, pos, prev_len, &distance);
+			__lz77_insert(hash, src, pos);
+
+			/* short and far matches are not worth it */
+			if (len < LZ77_MIN_LEN || (len == LZ77_MIN_LEN && distance > LZ77_TOO_FAR))
+				len = 0;
 		}
+
+		/* previous match is better : emit it */
+		if (prev_len >= LZ77_MIN_LEN && len <= prev_len) {
+			deflate_lz77_add_match(tokens, prev_distance, prev_len);
+
+			/* hash skipped bytes (previous match started at previous position) */
+			for (i = 1; i < prev_len - 1 && pos + i + sizeof(uint32_t) <= end; i++)
+				__lz77_insert(hash, src, pos + i);
+
+			pos += prev_len - 1;
+			prev_len = 0;
+			match_available = 0;
+			continue;
+		}
+
+		/* emit previous character as a literal */
+		if (match_available)
+			deflate_lz77_add_literal(tokens, src[pos - 1]);
+
+		/* remember current match */
+		prev_len = len;
+		prev_distance = distance;
+		match_available = 1;
+		pos++;
 	}
 
-	/* free hash table and nodes */
-	xfree(hash_table);
-	xfree(hash_nodes);
+	/* emit last character */
+	if (match_available)
+		deflate_lz77_add_literal(tokens, src[pos - 1]);
+}
 
-	/* return lz77 nodes */
-	return lz77_head;
-}
\ No newline at end of file
+/**
+ * @brief Init a LZ77 context (it must be reset before each input).
+ * 
+ * @param ctx 			LZ77 context
+ * @param level 		compression level
+ */
+void deflate_lz77_context_init(struct lz77_context *ctx, int level)
+{
+	ctx->config = deflate_lz77_config(level);
+	memset(&ctx->optimal, 0, sizeof(struct lz77_optimal));
+
+	/* create match finder */
+	if (ctx->config->match_finder == LZ77_BINARY_TREES)
+		deflate_lz77_bt_init(&ctx->bt, ctx->config->hash_bits);
+	else
+		deflate_lz77_hash_init(&ctx->hash, ctx->config->hash_bits);
+}
+
+/**
+ * @brief Reset a LZ77 context for a new input (context memory is reused).
+ * 
+ * Hash tables are scaled to input length (one bucket per position at most) : small inputs
+ * only clear and touch the beginning of the tables.
+ * 
+ * @param ctx 			LZ77 context
+ * @param len 			input length (UINT32_MAX if unknown)
+ */
+void deflate_lz77_context_reset(struct lz77_context *ctx, uint32_t len)
+{
+	uint32_t hash_bits = LZ77_MIN_HASH_BITS;
+
+	/* smallest table with one bucket per position (but not larger than level table) */
+	while (hash_bits < ctx->config->hash_bits && (1U << hash_bits) < len)
+		hash_bits++;
+
+	if (ctx->config->match_finder == LZ77_BINARY_TREES)
+		__lz77_bt_reset(&ctx->bt, hash_bits);
+	else
+		__lz77_hash_reset(&ctx->hash, hash_bits, len);
+}
+
+/**
+ * @brief Free a LZ77 context.
+ * 
+ * @param ctx 			LZ77 context
+ */
+void deflate_lz77_context_free(struct lz77_context *ctx)
+{
+	if (ctx->config->match_finder == LZ77_BINARY_TREES)
+		deflate_lz77_bt_free(&ctx->bt);
+	else
+		deflate_lz77_hash_free(&ctx->hash);
+
+	/* free optimal parsing working memory */
+	xfree(ctx->optimal.matches);
+	xfree(ctx->optimal.offsets);
+	xfree(ctx->optimal.cost);
+	xfree(ctx->optimal.paths);
+}
+
+/**
+ * @brief Prime a LZ77 context with a dictionary (matches of next blocks may refer to it).
+ * 
+ * @param ctx 			LZ77 context
+ * @param src 			input buffer
+ * @param start 		dictionary start
+ * @param end 			dictionary end
+ */
+void deflate_lz77_prime(struct lz77_context *ctx, uint8_t *src, uint32_t start, uint32_t end)
+{
+	uint32_t pos;
+
+	/* binary trees : positions are inserted on next search (it needs lookahead) */
+	if (ctx->config->match_finder == LZ77_BINARY_TREES) {
+		ctx->bt.next_pos = start;
+		return;
+	}
+
+	/* hash chains : insert all positions */
+	for (pos = start; pos + sizeof(uint32_t) <= end; pos++)
+		__lz77_insert(&ctx->hash, src, pos);
+}
+
+/**
+ * @brief Add a block which was not parsed (stored raw) to the match finder (matches of next blocks may refer to it).
+ * 
+ * @param ctx 			LZ77 context
+ * @param src 			input buffer
+ * @param start 		block start
+ * @param end 			block end
+ */
+void deflate_lz77_skip(struct lz77_context *ctx, uint8_t *src, uint32_t start, uint32_t end)
+{
+	uint32_t pos;
+
+	/* binary trees : skipped positions are inserted on next search */
+	if (ctx->config->match_finder == LZ77_BINARY_TREES)
+		return;
+
+	/* hash chains : insert positions next blocks can reach */
+	pos = end - start > LZ77_MAX_DIST ? end - LZ77_MAX_DIST : start;
+	for (; pos + sizeof(uint32_t) <= end; pos++)
+		__lz77_insert(&ctx->hash, src, pos);
+}
+
+/**
+ * @brief Slide a binary tree position.
+ * 
+ * @param node 		node position
+ * @param shift 	number of bytes slid
+ * 
+ * @return new position (LZ77_BT_NIL if it left the buffer)
+ */
+static inline uint32_t __lz77_bt_slide(uint32_t node, uint32_t shift)
+{
+	return node != LZ77_BT_NIL && node >= shift ? node - shift : LZ77_BT_NIL;
+}
+
+/**
+ * @brief Slide a LZ77 context (input buffer was moved shift bytes backward).
+ * 
+ * Hash chains store positions on 16 bits, so they don't change if shift is a multiple of 65536.
+ * Binary trees positions are rebased (children ring is indexed by position modulo window size).
+ * 
+ * @param ctx 			LZ77 context
+ * @param shift 		number of bytes slid (multiple of 65536)
+ */
+void deflate_lz77_slide(struct lz77_context *ctx, uint32_t shift)
+{
+	struct lz77_bt *bt = &ctx->bt;
+	uint32_t i;
+
+	if (ctx->config->match_finder != LZ77_BINARY_TREES)
+		return;
+
+	for (i = 0; i < 1U << bt->hash3_bits; i++)
+		bt->head3[i] = __lz77_bt_slide(bt->head3[i], shift);
+	for (i = 0; i < 1U << bt->hash_bits; i++)
+		bt->head[i] = __lz77_bt_slide(bt->head[i], shift);
+	for (i = 0; i < 2 * LZ77_MAX_DIST; i++)
+		bt->child[i] = __lz77_bt_slide(bt->child[i], shift);
+
+	bt->next_pos = bt->next_pos >= shift ? bt->next_pos - shift : 0;
+}
+
+/**
+ * @brief Compress a block with LZ77 algorithm (greedy and lazy levels, optimal levels use deflate_optimal_compress).
+ * 
+ * @param ctx 			LZ77 context (match finder state is kept from previous blocks)
+ * @param src 			input buffer
+ * @param start 		block start (matches may refer to the previous 32 KiB)
+ * @param end 			block end
+ * @param tokens 		output tokens (and frequencies)
+ */
+void deflate_lz77_compress(struct lz77_context *ctx, uint8_t *src, uint32_t start, uint32_t end, struct lz77_tokens *tokens)
+{
+	/* hash chains are only set up for hash chains configs */
+	assert(ctx->config->match_finder == LZ77_HASH_CHAINS);
+
+	if (ctx->config->max_lazy)
+		__lz77_compress_lazy(&ctx->hash, ctx->config, src, start, end, tokens);
+	else
+		__lz77_compress_greedy(&ctx->hash, ctx->config, src, start, end, tokens);
+}
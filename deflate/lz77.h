@@ -4,6 +4,76 @@
 #include <stdio.h>
 #include <stdint.h>
 
+#define LZ77_MIN_LEN			3
+#define LZ77_MAX_LEN			258
+#define LZ77_MAX_DIST			32768
+#define LZ77_MAX_MATCHES		(LZ77_MAX_LEN - LZ77_MIN_LEN + 1)
+
+#define LZ77_HASH_CHAINS		0
+#define LZ77_BINARY_TREES		1
+
+#define NR_LITERALS			286
+#define NR_LENGTHS 			29
+#define NR_DISTANCES			30
+
+/*
+ * Token (32 bits) :
+ * - literal : bits 0 to 7 = literal
+ * - match : bits 0 to 15 = distance, bits 16 to 24 = length
+ */
+#define lz77_token_literal(c)				(c)
+#define lz77_token_match(distance, length)		(((length) << 16) | (distance))
+#define lz77_token_is_literal(token)			((token) < (1 << 16))
+#define lz77_token_distance(token)			((token) & 0xFFFF)
+#define lz77_token_length(token)			((token) >> 16)
+
+/**
+ * @brief LZ77 compression level parameters.
+ */
+struct lz77_config {
+	uint32_t			good_length;	/* reduce search when previous match has this length */
+	uint32_t			max_lazy;	/* don't look for a longer match after a match of this length (0 = greedy parsing) */
+	uint32_t			nice_length;	/* stop search when a match of this length is found */
+	uint32_t			max_chain;	/* maximum hash chain (or binary tree) depth */
+	uint32_t			hash_bits;	/* hash table bits */
+	uint32_t			optimal_passes;	/* optimal parsing passes (0 = greedy/lazy parsing) */
+	uint32_t			match_finder;	/* optimal parsing match finder (hash chains or binary trees) */
+	uint32_t			block_split;	/* split blocks where symbols statistics change (0 = fixed size blocks) */
+};
+
+/**
+ * @brief Hash chains.
+ * 
+ * Positions are stored on 16 bits : a stored position is the most recent position with these
+ * low 16 bits, so it is turned back into a distance from current position. Stale entries only
+ * give wrong candidates, which are rejected when bytes are compared.
+ */
+struct lz77_hash {
+	uint16_t *			head;		/* last position of each hash */
+	uint16_t *			prev;		/* previous position with same hash (ring indexed by position) */
+	uint32_t 			hash_bits;	/* hash bits */
+};
+
+/**
+ * @brief Binary trees (one per hash bucket).
+ * 
+ * Each tree is sorted on the strings starting at its positions, newest position at the root : one
+ * descent from the root finds all matches and inserts current position. Children are stored in a ring
+ * indexed by position, so memory is bounded to the window. Length 3 matches are found with a separate
+ * hash table (last position only).
+ * 
+ * Inserting a position needs LZ77_MAX_LEN bytes of lookahead to keep trees sorted : positions closer to
+ * the end of a block are only searched, and inserted when next block is available.
+ */
+struct lz77_bt {
+	uint32_t *			head3;		/* last position of each 3 bytes hash */
+	uint32_t *			head;		/* root of each 4 bytes hash tree */
+	uint32_t *			child;		/* left and right children of each position */
+	uint32_t 			hash_bits;	/* hash bits */
+	uint32_t 			hash3_bits;	/* 3 bytes hash bits */
+	uint32_t			next_pos;	/* next position to insert */
+};
+
 /**
  * @brief LZ77 match.
  */
@@ -13,32 +83,217 @@ struct lz77_match {
 };
 
 /**
- * @brief LZ77 node (literal or match).
+ * @brief LZ77 tokens of a block (buffer is reused across blocks).
+ */
+struct lz77_tokens {
+	uint32_t *			tokens;
+	uint32_t			size;
+	uint32_t			capacity;
+	uint32_t			freqs_lit[NR_LITERALS];		/* literals/lengths frequencies (accumulated while parsing) */
+	uint32_t			freqs_dist[NR_DISTANCES];	/* distances frequencies (accumulated while parsing) */
+};
+
+/**
+ * @brief Optimal parsing working memory (grown to the largest block, kept across blocks).
+ */
+struct lz77_optimal {
+	struct lz77_match *		matches;		/* matches of all positions */
+	uint32_t			matches_capacity;	/* matches capacity */
+	uint32_t *			offsets;		/* first match of each position */
+	uint32_t *			cost;			/* cheapest cost of each position */
+	uint16_t *			paths;			/* current and best paths (lengths and distances) */
+	uint32_t			capacity;		/* number of positions */
+};
+
+/**
+ * @brief LZ77 context (match finder state, kept across blocks).
  */
-struct lz77_node {
-	int 				is_literal;
-	union {
-		uint8_t 		literal;
-		struct lz77_match 	match;
-	} data;
-	struct lz77_node *		next;
+struct lz77_context {
+	const struct lz77_config *	config;		/* compression level parameters */
+	struct lz77_hash		hash;		/* hash chains */
+	struct lz77_bt			bt;		/* binary trees (optimal parsing) */
+	struct lz77_optimal		optimal;	/* optimal parsing working memory */
 };
 
 /**
- * @brief Compress a buffer with LZ77 algorithm.
+ * @brief Get compression level parameters.
+ * 
+ * @param level 	compression level (clamped to 1..12)
+ * 
+ * @return parameters
+ */
+const struct lz77_config *deflate_lz77_config(int level);
+
+/**
+ * @brief Init hash chains (tables are cleared by deflate_lz77_context_reset).
+ * 
+ * @param hash 		hash chains
+ * @param hash_bits 	hash table bits
+ */
+void deflate_lz77_hash_init(struct lz77_hash *hash, uint32_t hash_bits);
+
+/**
+ * @brief Free hash chains.
+ * 
+ * @param hash 		hash chains
+ */
+void deflate_lz77_hash_free(struct lz77_hash *hash);
+
+/**
+ * @brief Find all matches of current position (and add it to hash chains).
+ * 
+ * @param hash 			hash chains
+ * @param config 		compression level parameters
+ * @param src 			input buffer
+ * @param src_len 		input buffer length
+ * @param pos 			current position
+ * @param matches 		output matches (at most LZ77_MAX_MATCHES)
+ * 
+ * @return number of matches
+ */
+uint32_t deflate_lz77_find_matches(struct lz77_hash *hash, const struct lz77_config *config, uint8_t *src, uint32_t src_len,
+				   uint32_t pos, struct lz77_match *matches);
+
+/**
+ * @brief Init binary trees (trees are emptied by deflate_lz77_context_reset).
  * 
- * @param buf 			input buffer
- * @param len 			input buffer length
+ * @param bt 		binary trees
+ * @param hash_bits 	hash table bits
+ */
+void deflate_lz77_bt_init(struct lz77_bt *bt, uint32_t hash_bits);
+
+/**
+ * @brief Free binary trees.
+ * 
+ * @param bt 		binary trees
+ */
+void deflate_lz77_bt_free(struct lz77_bt *bt);
+
+/**
+ * @brief Find all matches of current position with binary trees (and add it to binary trees).
+ * 
+ * @param bt 			binary trees
+ * @param config 		compression level parameters
+ * @param src 			input buffer
+ * @param src_len 		input buffer length
+ * @param pos 			current position
+ * @param matches 		output matches (at most LZ77_MAX_MATCHES)
+ * 
+ * @return number of matches
+ */
+uint32_t deflate_lz77_bt_find_matches(struct lz77_bt *bt, const struct lz77_config *config, uint8_t *src, uint32_t src_len,
+				      uint32_t pos, struct lz77_match *matches);
+
+/**
+ * @brief Init a tokens buffer.
+ * 
+ * @param tokens 	tokens buffer
+ */
+void deflate_lz77_tokens_init(struct lz77_tokens *tokens);
+
+/**
+ * @brief Reset a tokens buffer (keep memory for next block).
+ * 
+ * @param tokens 	tokens buffer
+ */
+void deflate_lz77_tokens_reset(struct lz77_tokens *tokens);
+
+/**
+ * @brief Free a tokens buffer.
+ * 
+ * @param tokens 	tokens buffer
+ */
+void deflate_lz77_tokens_free(struct lz77_tokens *tokens);
+
+/**
+ * @brief Add a literal token.
+ * 
+ * @param tokens 	tokens buffer
+ * @param c 		literal
+ */
+void deflate_lz77_add_literal(struct lz77_tokens *tokens, uint8_t c);
+
+/**
+ * @brief Add a match token.
+ * 
+ * @param tokens 	tokens buffer
+ * @param distance	distance from current position
+ * @param length	match length
+ */
+void deflate_lz77_add_match(struct lz77_tokens *tokens, uint32_t distance, uint32_t length);
+
+/**
+ * @brief Get a slice of a tokens buffer (slice shares tokens, frequencies are computed).
+ * 
+ * @param tokens 	tokens buffer
+ * @param first 	first token
+ * @param last 		last token (excluded)
+ * @param slice 	output slice
+ * 
+ * @return number of input bytes covered by slice
+ */
+uint32_t deflate_lz77_tokens_slice(struct lz77_tokens *tokens, uint32_t first, uint32_t last, struct lz77_tokens *slice);
+
+/**
+ * @brief Init a LZ77 context (it must be reset before each input).
+ * 
+ * @param ctx 			LZ77 context
+ * @param level 		compression level
+ */
+void deflate_lz77_context_init(struct lz77_context *ctx, int level);
+
+/**
+ * @brief Reset a LZ77 context for a new input (context memory is reused).
+ * 
+ * @param ctx 			LZ77 context
+ * @param len 			input length (UINT32_MAX if unknown)
+ */
+void deflate_lz77_context_reset(struct lz77_context *ctx, uint32_t len);
+
+/**
+ * @brief Free a LZ77 context.
+ * 
+ * @param ctx 			LZ77 context
+ */
+void deflate_lz77_context_free(struct lz77_context *ctx);
+
+/**
+ * @brief Prime a LZ77 context with a dictionary (matches of next blocks may refer to it).
+ * 
+ * @param ctx 			LZ77 context
+ * @param src 			input buffer
+ * @param start 		dictionary start
+ * @param end 			dictionary end
+ */
+void deflate_lz77_prime(struct lz77_context *ctx, uint8_t *src, uint32_t start, uint32_t end);
+
+/**
+ * @brief Add a block which was not parsed (stored raw) to the match finder (matches of next blocks may refer to it).
+ * 
+ * @param ctx 			LZ77 context
+ * @param src 			input buffer
+ * @param start 		block start
+ * @param end 			block end
+ */
+void deflate_lz77_skip(struct lz77_context *ctx, uint8_t *src, uint32_t start, uint32_t end);
+
+/**
+ * @brief Slide a LZ77 context (input buffer was moved shift bytes backward).
  * 
- * @return output LZ77 nodes
+ * @param ctx 			LZ77 context
+ * @param shift 		number of bytes slid (multiple of 65536)
  */
-struct lz77_node *deflate_lz77_compress(uint8_t *src, uint32_t src_len);
+void deflate_lz77_slide(struct lz77_context *ctx, uint32_t shift);
 
 /**
- * @brief Free LZ77 nodes.
+ * @brief Compress a block with LZ77 algorithm (greedy and lazy levels, optimal levels use deflate_optimal_compress).
  * 
- * @param node 		LZ77 nodes
+ * @param ctx 			LZ77 context (match finder state is kept from previous blocks)
+ * @param src 			input buffer
+ * @param start 		block start (matches may refer to the previous 32 KiB)
+ * @param end 			block end
+ * @param tokens 		output tokens (and frequencies)
  */
-void deflate_lz77_free_nodes(struct lz77_node *node);
+void deflate_lz77_compress(struct lz77_context *ctx, uint8_t *src, uint32_t start, uint32_t end, struct lz77_tokens *tokens);
 
-#endif
\ No newline at end of file
+#endif
@@ -11,8 +11,6 @@
  */
 void deflate_no_compression_compress(uint8_t *block, uint16_t len, struct bit_stream *bs_out)
 {
-	uint32_t i;
-
 	/* go to next byte */
 	bit_stream_flush(bs_out);
 
@@ -22,9 +20,8 @@ void deflate_no_compression_compress(uint8_t *block, uint16_t len, struct bit_st
 	/* write one's complement of length */
 	bit_stream_write_bits(bs_out, ~len, 16, BIT_ORDER_LSB);
 
-	/* write block */
-	for (i = 0; i < len; i++)
-		bit_stream_write_bits(bs_out, block[i], 8, BIT_ORDER_LSB);
+	/* write block (stream is on a byte boundary) */
+	bit_stream_write_bytes(bs_out, block, len);
 }
 
 /**
@@ -32,12 +29,13 @@ void deflate_no_compression_compress(uint8_t *block, uint16_t len, struct bit_st
  * 
  * @param bs_in 	input bit stream
  * @param buf_out 	output buffer
+ * @param buf_end 	output buffer end
  * 
- * @return block length
+ * @return number of bytes written to output buffer, -1 on corrupted input
  */
-int deflate_no_compression_uncompress(struct bit_stream *bs_in, uint8_t *buf_out)
+int deflate_no_compression_uncompress(struct bit_stream *bs_in, uint8_t *buf_out, uint8_t *buf_end)
 {
-	uint16_t len, i;
+	uint16_t len, nlen;
 
 	/* go to next byte */
 	bit_stream_flush(bs_in);
@@ -45,12 +43,13 @@ int deflate_no_compression_uncompress(struct bit_stream *bs_in, uint8_t *buf_out
 	/* read length */
 	len = bit_stream_read_bits(bs_in, 16, BIT_ORDER_LSB);
 
-	/* ignore one's complement of length */
-	bit_stream_read_bits(bs_in, 16, BIT_ORDER_LSB);
+	/* check one's complement of length */
+	nlen = bit_stream_read_bits(bs_in, 16, BIT_ORDER_LSB);
+	if (len != (~nlen & 0xFFFF) || len > buf_end - buf_out)
+		return -1;
 
-	/* read block */
-	for (i = 0; i < len; i++)
-		buf_out[i] = bit_stream_read_bits(bs_in, 8, BIT_ORDER_LSB);
+	/* read block (stream is on a byte boundary) */
+	bit_stream_read_bytes(bs_in, buf_out, len);
 
 	return len;
 }
@@ -19,9 +19,10 @@ void deflate_no_compression_compress(uint8_t *block, uint16_t len, struct bit_st
  * 
  * @param bs_in 	input bit stream
  * @param buf_out 	output buffer
+ * @param buf_end 	output buffer end
  * 
- * @return block length
+ * @return number of bytes written to output buffer, -1 on corrupted input
  */
-int deflate_no_compression_uncompress(struct bit_stream *bs_in, uint8_t *buf_out);
+int deflate_no_compression_uncompress(struct bit_stream *bs_in, uint8_t *buf_out, uint8_t *buf_end);
 
 #endif
@@ -0,0 +1,305 @@
+/*
+ * Optimal parsing = choose the cheapest sequence of literals and matches of a block :
+ * 1 - find all matches of every position (closest distance for each length)
+ * 2 - estimate cost (in bits) of every literal, length and distance from huffman tables
+ * 3 - find the cheapest path from block start to block end (positions are nodes, literals and matches are edges)
+ * 4 - build huffman tables from chosen path frequencies and go back to step 2
+ * 
+ * First pass uses fix huffman tables costs. Tables and parse converge in a few passes : best parse is kept.
+ */
+#include <string.h>
+
+#include "optimal.h"
+#include "huffman.h"
+#include "fix_huffman.h"
+#include "dyn_huffman.h"
+#include "../utils/mem.h"
+
+#define OPTIMAL_UNUSED_SYMBOL_BITS	15
+
+/**
+ * @brief Symbols costs (in bits).
+ */
+struct optimal_costs {
+	uint32_t			literals[256];			/* literal code */
+	uint32_t			lengths[LZ77_MAX_LEN + 1];	/* length code + extra bits */
+	uint32_t			distances[NR_DISTANCES];	/* distance code + extra bits */
+};
+
+/**
+ * @brief Path through a block (edge ending at each position).
+ */
+struct optimal_path {
+	uint16_t *			length;		/* 1 = literal */
+	uint16_t *			distance;
+};
+
+/**
+ * @brief Grow optimal parsing working memory (only if block is larger than all previous ones).
+ * 
+ * @param opt 		optimal parsing working memory
+ * @param block_len 	block length
+ */
+static void __optimal_grow(struct lz77_optimal *opt, uint32_t block_len)
+{
+	if (block_len + 1 <= opt->capacity)
+		return;
+
+	opt->capacity = block_len + 1;
+	opt->offsets = (uint32_t *) xrealloc(opt->offsets, sizeof(uint32_t) * opt->capacity);
+	opt->cost = (uint32_t *) xrealloc(opt->cost, sizeof(uint32_t) * opt->capacity);
+	opt->paths = (uint16_t *) xrealloc(opt->paths, sizeof(uint16_t) * 4 * opt->capacity);
+
+	if (opt->matches_capacity < block_len + LZ77_MAX_MATCHES) {
+		opt->matches_capacity = block_len + LZ77_MAX_MATCHES;
+		opt->matches = (struct lz77_match *) xrealloc(opt->matches, sizeof(struct lz77_match) * opt->matches_capacity);
+	}
+}
+
+/**
+ * @brief Find matches of all positions of a block.
+ * 
+ * Matches of position i are matches[offsets[i]] to matches[offsets[i + 1] - 1].
+ * 
+ * @param ctx 		LZ77 context (output matches are indexed from block start)
+ * @param src 		input buffer
+ * @param start 	block start
+ * @param end 		block end
+ */
+static void __optimal_find_matches(struct lz77_context *ctx, uint8_t *src, uint32_t start, uint32_t end)
+{
+	struct lz77_optimal *opt = &ctx->optimal;
+	struct lz77_match matches[LZ77_MAX_MATCHES];
+	uint32_t pos, size = 0, n;
+
+	for (pos = start; pos < end; pos++) {
+		opt->offsets[pos - start] = size;
+
+		/* find matches */
+		if (ctx->config->match_finder == LZ77_BINARY_TREES)
+			n = deflate_lz77_bt_find_matches(&ctx->bt, ctx->config, src, end, pos, matches);
+		else
+			n = deflate_lz77_find_matches(&ctx->hash, ctx->config, src, end, pos, matches);
+
+		/* grow matches if needed */
+		if (size + n > opt->matches_capacity) {
+			opt->matches_capacity *= 2;
+			opt->matches = (struct lz77_match *) xrealloc(opt->matches, sizeof(struct lz77_match) * opt->matches_capacity);
+		}
+
+		/* add matches */
+		memcpy(opt->matches + size, matches, sizeof(struct lz77_match) * n);
+		size += n;
+	}
+
+	opt->offsets[end - start] = size;
+}
+
+/**
+ * @brief Get cost of a symbol.
+ * 
+ * @param table 	huffman table
+ * @param symbol 	symbol
+ * 
+ * @return cost (in bits)
+ */
+static inline uint32_t __optimal_symbol_cost(const struct huffman_table *table, uint32_t symbol)
+{
+	return table->codes_len[symbol] ? table->codes_len[symbol] : OPTIMAL_UNUSED_SYMBOL_BITS;
+}
+
+/**
+ * @brief Compute symbols costs from huffman tables.
+ * 
+ * @param table_lit 	literals huffman table
+ * @param table_dist 	distances huffman table
+ * @param costs 	output costs
+ */
+static void __optimal_set_costs(const struct huffman_table *table_lit, const struct huffman_table *table_dist, struct optimal_costs *costs)
+{
+	uint32_t i;
+	int index;
+
+	/* literals */
+	for (i = 0; i < 256; i++)
+		costs->literals[i] = __optimal_symbol_cost(table_lit, i);
+
+	/* lengths */
+	for (i = LZ77_MIN_LEN; i <= LZ77_MAX_LEN; i++) {
+		index = deflate_huffman_length_index(i);
+		costs->lengths[i] = __optimal_symbol_cost(table_lit, 257 + index) + deflate_huffman_length_extra_bits(index);
+	}
+
+	/* distances */
+	for (i = 0; i < NR_DISTANCES; i++)
+		costs->distances[i] = __optimal_symbol_cost(table_dist, i) + deflate_huffman_distance_extra_bits(i);
+}
+
+/**
+ * @brief Find cheapest path through a block.
+ * 
+ * @param src 		input buffer
+ * @param src_len 	input buffer length
+ * @param opt 		optimal parsing working memory (matches of all positions and cheapest cost of each position)
+ * @param costs 	symbols costs
+ * @param path 		output path
+ */
+static void __optimal_parse(uint8_t *src, uint32_t src_len, struct lz77_optimal *opt, struct optimal_costs *costs,
+			    struct optimal_path *path)
+{
+	uint32_t *cost = opt->cost, pos, len, c, c_dist, i;
+	struct lz77_match *match;
+
+	/* reset costs */
+	cost[0] = 0;
+	for (pos = 1; pos <= src_len; pos++)
+		cost[pos] = UINT32_MAX;
+
+	for (pos = 0; pos < src_len; pos++) {
+		/* literal edge */
+		c = cost[pos] + costs->literals[src[pos]];
+		if (c < cost[pos + 1]) {
+			cost[pos + 1] = c;
+			path->length[pos + 1] = 1;
+			path->distance[pos + 1] = 0;
+		}
+
+		/* match edges (lengths between previous match length and this one use this distance) */
+		for (i = opt->offsets[pos], len = LZ77_MIN_LEN; i < opt->offsets[pos + 1]; i++) {
+			match = &opt->matches[i];
+			c_dist = cost[pos] + costs->distances[deflate_huffman_distance_index(match->distance)];
+
+			for (; len <= match->length; len++) {
+				c = c_dist + costs->lengths[len];
+				if (c < cost[pos + len]) {
+					cost[pos + len] = c;
+					path->length[pos + len] = len;
+					path->distance[pos + len] = match->distance;
+				}
+			}
+		}
+	}
+}
+
+/**
+ * @brief Compute frequencies of a path.
+ * 
+ * @param src 		input buffer
+ * @param src_len 	input buffer length
+ * @param path 		path
+ * @param freqs_lit 	output literals frequencies
+ * @param freqs_dist 	output distances frequencies
+ */
+static void __optimal_path_freqs(uint8_t *src, uint32_t src_len, struct optimal_path *path, uint32_t *freqs_lit, uint32_t *freqs_dist)
+{
+	uint32_t pos;
+
+	memset(freqs_lit, 0, sizeof(uint32_t) * NR_LITERALS);
+	memset(freqs_dist, 0, sizeof(uint32_t) * NR_DISTANCES);
+
+	/* walk path backward */
+	for (pos = src_len; pos > 0; pos -= path->length[pos]) {
+		if (path->length[pos] == 1) {
+			freqs_lit[src[pos - 1]]++;
+		} else {
+			freqs_lit[257 + deflate_huffman_length_index(path->length[pos])]++;
+			freqs_dist[deflate_huffman_distance_index(path->distance[pos])]++;
+		}
+	}
+
+	/* add "end of block" character */
+	freqs_lit[256]++;
+}
+
+/**
+ * @brief Compute cost of a path.
+ * 
+ * @param src 		input buffer
+ * @param src_len 	input buffer length
+ * @param path 		path
+ * @param costs 	symbols costs
+ * 
+ * @return cost (in bits)
+ */
+static uint64_t __optimal_path_cost(uint8_t *src, uint32_t src_len, struct optimal_path *path, struct optimal_costs *costs)
+{
+	uint64_t cost = 0;
+	uint32_t pos;
+
+	for (pos = src_len; pos > 0; pos -= path->length[pos]) {
+		if (path->length[pos] == 1)
+			cost += costs->literals[src[pos - 1]];
+		else
+			cost += costs->lengths[path->length[pos]] + costs->distances[deflate_huffman_distance_index(path->distance[pos])];
+	}
+
+	return cost;
+}
+
+/**
+ * @brief Compress a block with LZ77 algorithm and optimal parsing.
+ * 
+ * @param ctx 			LZ77 context (match finder state is kept from previous blocks)
+ * @param src 			input buffer
+ * @param start 		block start (matches may refer to the previous 32 KiB)
+ * @param end 			block end
+ * @param tokens 		output tokens (and frequencies)
+ */
+void deflate_optimal_compress(struct lz77_context *ctx, uint8_t *src, uint32_t start, uint32_t end, struct lz77_tokens *tokens)
+{
+	uint32_t freqs_lit[NR_LITERALS], freqs_dist[NR_DISTANCES], block_len = end - start, pass, pos, first, i, j, tmp;
+	struct lz77_optimal *opt = &ctx->optimal;
+	struct optimal_path path, best_path;
+	struct huffman_table table_lit, table_dist;
+	uint64_t path_cost, best_cost = UINT64_MAX;
+	struct optimal_costs costs;
+	uint8_t *block = src + start;
+
+	/* working buffers are kept in context */
+	__optimal_grow(opt, block_len);
+	path.length = opt->paths;
+	path.distance = opt->paths + opt->capacity;
+	best_path.length = opt->paths + 2 * opt->capacity;
+	best_path.distance = opt->paths + 3 * opt->capacity;
+
+	/* find matches once */
+	__optimal_find_matches(ctx, src, start, end);
+
+	/* first pass uses fix huffman costs */
+	__optimal_set_costs(&deflate_huffman_fix_table_lit, &deflate_huffman_fix_table_dist, &costs);
+
+	for (pass = 0; pass < ctx->config->optimal_passes; pass++) {
+		/* find cheapest path with current costs */
+		__optimal_parse(block, block_len, opt, &costs, &path);
+
+		/* update costs with this path huffman tables */
+		__optimal_path_freqs(block, block_len, &path, freqs_lit, freqs_dist);
+		deflate_huffman_build_dynamic_tables_from_freqs(freqs_lit, freqs_dist, &table_lit, &table_dist);
+		__optimal_set_costs(&table_lit, &table_dist, &costs);
+		huffman_table_free(&table_lit);
+		huffman_table_free(&table_dist);
+
+		/* keep best path */
+		path_cost = __optimal_path_cost(block, block_len, &path, &costs);
+		if (path_cost < best_cost) {
+			best_cost = path_cost;
+			memcpy(best_path.length, path.length, sizeof(uint16_t) * (block_len + 1));
+			memcpy(best_path.distance, path.distance, sizeof(uint16_t) * (block_len + 1));
+		}
+	}
+
+	/* create lz77 tokens (path is walked backward) */
+	for (pos = block_len, first = tokens->size; pos > 0; pos -= best_path.length[pos]) {
+		if (best_path.length[pos] == 1)
+			deflate_lz77_add_literal(tokens, block[pos - 1]);
+		else
+			deflate_lz77_add_match(tokens, best_path.distance[pos], best_path.length[pos]);
+	}
+
+	/* put tokens back in order */
+	for (i = first, j = tokens->size; i + 1 < j; i++, j--) {
+		tmp = tokens->tokens[i];
+		tokens->tokens[i] = tokens->tokens[j - 1];
+		tokens->tokens[j - 1] = tmp;
+	}
+}
@@ -0,0 +1,19 @@
+#ifndef _DEFLATE_OPTIMAL_H_
+#define _DEFLATE_OPTIMAL_H_
+
+#include <stdint.h>
+
+#include "lz77.h"
+
+/**
+ * @brief Compress a block with LZ77 algorithm and optimal parsing.
+ * 
+ * @param ctx 			LZ77 context (match finder state is kept from previous blocks)
+ * @param src 			input buffer
+ * @param start 		block start (matches may refer to the previous 32 KiB)
+ * @param end 			block end
+ * @param tokens 		output tokens (and frequencies)
+ */
+void deflate_optimal_compress(struct lz77_context *ctx, uint8_t *src, uint32_t start, uint32_t end, struct lz77_tokens *tokens);
+
+#endif
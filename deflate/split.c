@@ -0,0 +1,181 @@
+/*
+ * Block splitting = end blocks where symbols statistics change, so each part gets its own huffman tables :
+ * 1 - cut block tokens in small chunks
+ * 2 - estimate cost (in bits) of each chunk and of each pair of adjacent chunks, with best compression method
+ * 3 - merge the pair which saves most bits and go back to step 2, until no merge saves bits
+ * 
+ * Remaining boundaries are the ones where new huffman tables pay for their header.
+ */
+#include <string.h>
+
+#include "split.h"
+#include "huffman.h"
+#include "fix_huffman.h"
+#include "dyn_huffman.h"
+#include "../utils/mem.h"
+
+#define SPLIT_CHUNK_TOKENS		512
+
+/**
+ * @brief Sub block.
+ */
+struct split_block {
+	struct lz77_tokens		tokens;		/* tokens slice (with frequencies) */
+	uint32_t			len;		/* input length */
+	uint32_t			cost;		/* cost (in bits) */
+	uint32_t			merge_cost;	/* cost of this block merged with next one (in bits) */
+};
+
+/**
+ * @brief Estimate cost of a block (best of fix huffman, dynamic huffman and no compression).
+ * 
+ * @param tokens 		block tokens (with frequencies)
+ * @param len 			block input length
+ * 
+ * @return cost (in bits)
+ */
+static uint32_t __split_cost(struct lz77_tokens *tokens, uint32_t len)
+{
+	struct huffman_table table_dyn_lit, table_dyn_dist;
+	uint32_t cost, dyn_cost, no_cost;
+
+	/* fix huffman */
+	cost = deflate_huffman_compressed_len(tokens, &deflate_huffman_fix_table_lit, &deflate_huffman_fix_table_dist);
+
+	/* dynamic huffman (with tables) */
+	deflate_huffman_build_dynamic_tables(tokens, &table_dyn_lit, &table_dyn_dist);
+	dyn_cost = deflate_huffman_tables_len(&table_dyn_lit, &table_dyn_dist)
+		   + deflate_huffman_compressed_len(tokens, &table_dyn_lit, &table_dyn_dist);
+	huffman_table_free(&table_dyn_lit);
+	huffman_table_free(&table_dyn_dist);
+
+	/* no compression (length, one's complement of length and block) */
+	no_cost = 32 + len * 8;
+
+	/* keep best compression method */
+	if (dyn_cost < cost)
+		cost = dyn_cost;
+	if (no_cost < cost)
+		cost = no_cost;
+
+	/* add block header */
+	return 3 + cost;
+}
+
+/**
+ * @brief Merge two adjacent blocks.
+ * 
+ * @param a 		first block
+ * @param b 		second block
+ * @param merged 	output merged tokens (with frequencies)
+ */
+static void __split_merge(struct split_block *a, struct split_block *b, struct lz77_tokens *merged)
+{
+	uint32_t i;
+
+	merged->tokens = a->tokens.tokens;
+	merged->size = merged->capacity = a->tokens.size + b->tokens.size;
+
+	for (i = 0; i < NR_LITERALS; i++)
+		merged->freqs_lit[i] = a->tokens.freqs_lit[i] + b->tokens.freqs_lit[i];
+	for (i = 0; i < NR_DISTANCES; i++)
+		merged->freqs_dist[i] = a->tokens.freqs_dist[i] + b->tokens.freqs_dist[i];
+
+	/* only one "end of block" character */
+	merged->freqs_lit[256] = 1;
+}
+
+/**
+ * @brief Compute cost of a block merged with next one.
+ * 
+ * @param blocks 		blocks
+ * @param i 			block index
+ */
+static void __split_set_merge_cost(struct split_block *blocks, uint32_t i)
+{
+	struct lz77_tokens merged;
+
+	__split_merge(&blocks[i], &blocks[i + 1], &merged);
+	blocks[i].merge_cost = __split_cost(&merged, blocks[i].len + blocks[i + 1].len);
+}
+
+/**
+ * @brief Split LZ77 tokens of a block in sub blocks (each one will get its own huffman tables).
+ * 
+ * @param tokens 		LZ77 tokens (with frequencies)
+ * @param ends 			output sub blocks ends (at most DEFLATE_SPLIT_MAX_BLOCKS tokens indexes)
+ * 
+ * @return number of sub blocks
+ */
+uint32_t deflate_split_block(struct lz77_tokens *tokens, uint32_t *ends)
+{
+	uint32_t chunk_size, nr_blocks, first, last, gain, best_gain, best, i;
+	struct split_block *blocks;
+
+	/* compute chunk size */
+	chunk_size = SPLIT_CHUNK_TOKENS;
+	if (tokens->size > chunk_size * DEFLATE_SPLIT_MAX_BLOCKS)
+		chunk_size = (tokens->size - 1) / DEFLATE_SPLIT_MAX_BLOCKS + 1;
+
+	/* small block : don't split */
+	if (tokens->size <= chunk_size) {
+		ends[0] = tokens->size;
+		return 1;
+	}
+
+	/* cut tokens in chunks */
+	nr_blocks = (tokens->size - 1) / chunk_size + 1;
+	blocks = (struct split_block *) xmalloc(sizeof(struct split_block) * nr_blocks);
+	for (i = 0, first = 0; i < nr_blocks; i++, first = last) {
+		last = first + chunk_size < tokens->size ? first + chunk_size : tokens->size;
+		blocks[i].len = deflate_lz77_tokens_slice(tokens, first, last, &blocks[i].tokens);
+		blocks[i].cost = __split_cost(&blocks[i].tokens, blocks[i].len);
+	}
+
+	/* compute merge costs */
+	for (i = 0; i + 1 < nr_blocks; i++)
+		__split_set_merge_cost(blocks, i);
+
+	for (;;) {
+		/* find merge which saves most bits */
+		for (i = 0, best = nr_blocks, best_gain = 0; i + 1 < nr_blocks; i++) {
+			if (blocks[i].merge_cost > blocks[i].cost + blocks[i + 1].cost)
+				continue;
+
+			gain = blocks[i].cost + blocks[i + 1].cost - blocks[i].merge_cost;
+			if (best == nr_blocks || gain > best_gain) {
+				best = i;
+				best_gain = gain;
+			}
+		}
+
+		/* no merge saves bits */
+		if (best == nr_blocks)
+			break;
+
+		/* merge blocks */
+		__split_merge(&blocks[best], &blocks[best + 1], &blocks[best].tokens);
+		blocks[best].len += blocks[best + 1].len;
+		blocks[best].cost = blocks[best].merge_cost;
+		blocks[best].merge_cost = blocks[best + 1].merge_cost;
+		memmove(&blocks[best + 1], &blocks[best + 2], sizeof(struct split_block) * (nr_blocks - best - 2));
+		nr_blocks--;
+
+		/* update merge costs of merged block neighbours */
+		if (best > 0)
+			__split_set_merge_cost(blocks, best - 1);
+		if (best + 1 < nr_blocks)
+			__split_set_merge_cost(blocks, best);
+	}
+
+	/* set sub blocks ends */
+	for (i = 0, last = 0; i < nr_blocks; i++) {
+		last += blocks[i].tokens.size;
+		ends[i] = last;
+	}
+
+	/* free memory */
+	xfree(blocks);
+
+	return nr_blocks;
+}
@@ -0,0 +1,20 @@
+#ifndef _DEFLATE_SPLIT_H_
+#define _DEFLATE_SPLIT_H_
+
+#include <stdint.h>
+
+#include "lz77.h"
+
+#define DEFLATE_SPLIT_MAX_BLOCKS	128
+
+/**
+ * @brief Split LZ77 tokens of a block in sub blocks (each one will get its own huffman tables).
+ * 
+ * @param tokens 		LZ77 tokens (with frequencies)
+ * @param ends 			output sub blocks ends (at most DEFLATE_SPLIT_MAX_BLOCKS tokens indexes)
+ * 
+ * @return number of sub blocks
+ */
+uint32_t deflate_split_block(struct lz77_tokens *tokens, uint32_t *ends);
+
+#endif
@@ -1,110 +1,174 @@
 /*
  * Huffman encoding = lossless data compression method, working at alphabet level :
  * 1 - parse all file to compute frequency of each character
- * 2 - build huffman tree (min heap) based on frequencies
- *	-> every letter is a leaf in the heap
+ * 2 - compute optimal codes lengths, limited to HUFFMAN_MAX_BITS (package-merge)
  *	-> more frequent letters have shortest code
- * 3 - build binary code of every letter
- * 4 - write header in compressed file = every letter with its frequency = dictionnary (so decompressor will be able to rebuild the tree)
+ * 3 - build canonical code of every letter (codes are fully defined by their lengths)
+ * 4 - write header in compressed file = every letter with its code length = dictionnary (so decompressor will be able to rebuild the codes)
  * 5 - encode file = replace each letter with binary code
+ * 
+ * Decompressor uses a flat lookup table indexed by the next HUFFMAN_MAX_BITS bits : each entry
+ * decodes one or two characters at once.
  */
 
 #include <string.h>
 #include <endian.h>
 
 #include "huffman.h"
-#include "huffman_tree.h"
+#include "huffman_table.h"
 #include "../utils/mem.h"
-#include "../utils/heap.h"
 #include "../utils/bit_stream.h"
 
 #define NR_CHARACTERS		256
+#define HUFFMAN_MAX_BITS	11
+#define HUFFMAN_LOOKUP_SIZE	(1 << HUFFMAN_MAX_BITS)
+#define HUFFMAN_MAX_HEADER_SIZE	(2 * sizeof(uint32_t) + NR_CHARACTERS * 2 * sizeof(uint8_t))
 
+/*
+ * Lookup table entry :
+ * - bits 0 to 15 : first and second characters
+ * - bits 16 to 19 : first character code length
+ * - bits 20 to 24 : number of bits to consume
+ * - bits 25 to 26 : number of decoded characters
+ */
+#define lookup_entry(c1, c2, len1, nr_bits, nr_chars)	((c1) | ((c2) << 8) | ((len1) << 16) | ((nr_bits) << 20) | ((nr_chars) << 25))
+#define lookup_c1(entry)				((entry) & 0xFF)
+#define lookup_c2(entry)				(((entry) >> 8) & 0xFF)
+#define lookup_len1(entry)				(((entry) >> 16) & 0x0F)
+#define lookup_nr_bits(entry)				(((entry) >> 20) & 0x1F)
+#define lookup_nr_chars(entry)				(((entry) >> 25) & 0x03)
 
 /**
  * @brief Write huffman header (= dictionnary).
  * 
  * @param src_len	input buffer length
- * @param nodes 	huffman nodes
- * @param header_len	output header length
+ * @param codes_len 	codes lengths
+ * @param bs_out	output bit stream
  */
-static uint8_t *__write_huffman_header(uint32_t src_len, struct huffman_node **nodes, uint32_t *header_len)
+static void __write_huffman_header(uint32_t src_len, uint32_t *codes_len, struct bit_stream *bs_out)
 {
-	uint8_t *header, *buf_out;
+	uint8_t header[HUFFMAN_MAX_HEADER_SIZE], *buf_out;
 	uint32_t i, n;
 
-	/* count number of nodes */
+	/* count number of characters */
 	for (i = 0, n = 0; i < NR_CHARACTERS; i++)
-		if (nodes[i])
+		if (codes_len[i])
 			n++;
 
-	/* allocate header */
-	*header_len = sizeof(uint32_t) + sizeof(uint32_t) + n * (sizeof(uint32_t) + sizeof(uint32_t));
-	header = buf_out = (uint8_t *) xmalloc(*header_len);
+	/* set header */
+	buf_out = header;
 
 	/* write input buffer length */
 	*((uint32_t *) buf_out) = htole32(src_len);
 	buf_out += sizeof(uint32_t);
 
-	/* write number of nodes */
+	/* write number of characters */
 	*((uint32_t *) buf_out) = htole32(n);
 	buf_out += sizeof(uint32_t);
 
 	/* write dictionnary */
 	for (i = 0; i < NR_CHARACTERS; i++) {
-		if (!nodes[i])
+		if (!codes_len[i])
 			continue;
 
 		/* write value */
-		*((uint32_t *) buf_out) = htole32(nodes[i]->val);
-		buf_out += sizeof(uint32_t);
+		*buf_out++ = i;
 
-		/* write frequency */
-		*((uint32_t *) buf_out) = htole32(nodes[i]->freq);
-		buf_out += sizeof(uint32_t);
+		/* write code length */
+		*buf_out++ = codes_len[i];
 	}
 
-	return header;
+	/* copy header to output */
+	bit_stream_write_bytes(bs_out, header, buf_out - header);
 }
 
 /**
  * @brief Read huffman header (= dictionnary).
  * 
  * @param buf_in	input buffer
- * @param freqs 	output characters frequencies
+ * @param src_len 	input buffer length
+ * @param codes_len 	output codes lengths
  * @param dst_len	output destination length
  * 
- * @return length of this header
+ * @return length of this header, -1 on corrupted input
  */
-static uint32_t __read_huffman_header(uint8_t *buf_in, uint32_t *freqs, uint32_t *dst_len)
+static int __read_huffman_header(uint8_t *buf_in, uint32_t src_len, uint32_t *codes_len, uint32_t *dst_len)
 {
-	uint32_t i, n, freq;
-	uint32_t val;
+	uint32_t i, n, header_len;
+	uint8_t val;
+
+	/* input too short for destination length and number of characters */
+	if (src_len < 2 * sizeof(uint32_t))
+		return -1;
 
 	/* read destination length */
 	*dst_len = le32toh(*((uint32_t *) buf_in));
 	buf_in += sizeof(uint32_t);
 
-	/* read number of nodes */
+	/* read number of characters */
 	n = le32toh(*((uint32_t *) buf_in));
 	buf_in += sizeof(uint32_t);
+	if (n > NR_CHARACTERS || n * (sizeof(uint8_t) + sizeof(uint8_t)) > src_len - 2 * sizeof(uint32_t))
+		return -1;
 
-	/* read nodes */
+	/* read characters */
 	for (i = 0; i < n; i++) {
 		/* read value */
-		val = le32toh(*((uint32_t *) buf_in));
-		buf_in += sizeof(uint32_t);
-
-		/* read frequency */
-		freq = le32toh(*((uint32_t *) buf_in));
-		buf_in += sizeof(uint32_t);
+		val = *buf_in++;
 
-		/* set frequency */
-		freqs[val] = freq;
+		/* read code length */
+		codes_len[val] = *buf_in++;
+		if (codes_len[val] > HUFFMAN_MAX_BITS)
+			return -1;
 	}
 
+	/* codes are at least 1 bit long : content can't hold more characters than bits */
+	header_len = sizeof(uint32_t) + sizeof(uint32_t) + n * (sizeof(uint8_t) + sizeof(uint8_t));
+	if (*dst_len > (uint64_t) (src_len - header_len) * 8)
+		return -1;
+
 	/* return length of this header */
-	return sizeof(uint32_t) + sizeof(uint32_t) + n * (sizeof(uint32_t) + sizeof(uint32_t));
+	return header_len;
+}
+
+/**
+ * @brief Build decoding lookup table.
+ * 
+ * @param table 	huffman table
+ * @param lookup 	output lookup table
+ */
+static void __build_lookup(struct huffman_table *table, uint32_t *lookup)
+{
+	uint32_t single[HUFFMAN_LOOKUP_SIZE], rev, len, i, j;
+	uint32_t c1, len1, c2, len2;
+
+	/* invalid codes (corrupted input) : decode character 0 and skip all bits, so decoding always progresses */
+	for (i = 0; i < HUFFMAN_LOOKUP_SIZE; i++)
+		single[i] = lookup_entry(0, 0, HUFFMAN_MAX_BITS, HUFFMAN_MAX_BITS, 1);
+
+	/* one character per entry (indexed by reversed codes, since codes are read Most Significant bit first) */
+	for (i = 0; i < NR_CHARACTERS; i++) {
+		len = table->codes_len[i];
+		if (!len)
+			continue;
+
+		rev = bit_stream_reverse_bits(table->codes[i], len);
+		for (j = rev; j < HUFFMAN_LOOKUP_SIZE; j += 1 << len)
+			single[j] = lookup_entry(i, 0, len, len, 1);
+	}
+
+	/* add a second character if its code fits in remaining bits */
+	for (i = 0; i < HUFFMAN_LOOKUP_SIZE; i++) {
+		c1 = lookup_c1(single[i]);
+		len1 = lookup_len1(single[i]);
+		c2 = lookup_c1(single[i >> len1]);
+		len2 = lookup_len1(single[i >> len1]);
+
+		if (len1 + len2 <= HUFFMAN_MAX_BITS)
+			lookup[i] = lookup_entry(c1, c2, len1, len1 + len2, 2);
+		else
+			lookup[i] = single[i];
+	}
 }
 
 /**
@@ -112,72 +176,98 @@ static uint32_t __read_huffman_header(uint8_t *buf_in, uint32_t *freqs, uint32_t
  * 
  * @param src 		input buffer
  * @param src_len 	input buffer length
- * @param nodes 	huffman nodes
+ * @param table 	huffman table
  * @param bs_out 	output bit stream
  */
-static void __write_huffman_content(uint8_t *src, uint32_t src_len, struct huffman_node **nodes, struct bit_stream *bs_out)
+static void __write_huffman_content(uint8_t *src, uint32_t src_len, struct huffman_table *table, struct bit_stream *bs_out)
 {
-	struct huffman_node *node;
-	uint32_t i;
+	uint32_t codes[NR_CHARACTERS], i;
 
-	for (i = 0; i < src_len; i++) {
-		/* get huffman node */
-		node = nodes[src[i]];
+	/* reverse codes once (codes are written Most Significant bit first) */
+	for (i = 0; i < NR_CHARACTERS; i++)
+		codes[i] = bit_stream_reverse_bits(table->codes[i], table->codes_len[i]);
 
-		/* write huffman code */
-		bit_stream_write_bits(bs_out, node->huffman_code, node->nr_bits, BIT_ORDER_MSB);
-	}
+	for (i = 0; i < src_len; i++)
+		bit_stream_write_bits_lsb(bs_out, codes[src[i]], table->codes_len[src[i]]);
 }
 
 /**
- * @brief Decode a huffman node value.
+ * @brief Decode input buffer with huffman codes.
  * 
  * @param bs_in 	input bit stream
- * @param root	 	huffman tree
- *
- * @return huffman value
+ * @param dst 		output buffer
+ * @param dst_len	output buffer length
+ * @param lookup 	lookup table
+ * 
+ * @return 0 on success, -1 if input is read past its end
  */
-static int __read_huffman_val(struct bit_stream *bs_in, struct huffman_node *root)
+static int __read_huffman_content(struct bit_stream *bs_in, uint8_t *dst, uint32_t dst_len, uint32_t *lookup)
 {
-	struct huffman_node *node;
-	uint32_t bit;
+	uint32_t entry, i;
 
-	for (node = root;;) {
-		bit = bit_stream_read_bits(bs_in, 1, BIT_ORDER_MSB);
+	/* decode one or two characters per lookup (stop once the bit buffer only holds padding) */
+	for (i = 0; i + 1 < dst_len; i += lookup_nr_chars(entry)) {
+		if (bs_in->byte_offset > bs_in->capacity + sizeof(uint64_t))
+			return -1;
 
-		/* walk through the tree */
-		if (bit)
-			node = node->right;
-		else
-			node = node->left;
+		entry = lookup[bit_stream_peek_bits_lsb(bs_in, HUFFMAN_MAX_BITS)];
+		bit_stream_consume_bits(bs_in, lookup_nr_bits(entry));
+		dst[i] = lookup_c1(entry);
+		dst[i + 1] = lookup_c2(entry);
+	}
 
-		if (__huffman_leaf(node))
-			return node->val;
+	/* decode last character */
+	if (i < dst_len) {
+		entry = lookup[bit_stream_peek_bits_lsb(bs_in, HUFFMAN_MAX_BITS)];
+		bit_stream_consume_bits(bs_in, lookup_len1(entry));
+		dst[i] = lookup_c1(entry);
 	}
 
-	return -1;
+	return 0;
 }
 
 /**
- * @brief Decode input buffer with huffman codes.
+ * @brief Compress a buffer with huffman algorithm to a bit stream.
  * 
- * @param bs_in 	input bit stream
- * @param dst 		output buffer
- * @param dst_len	output buffer length
- * @param root 		huffman tree
+ * @param src 		input buffer
+ * @param src_len 	input buffer length
+ * @param bs_out 	output bit stream
  */
-static void __read_huffman_content(struct bit_stream *bs_in, uint8_t *dst, uint32_t dst_len, struct huffman_node *root)
+static void __huffman_compress(uint8_t *src, uint32_t src_len, struct bit_stream *bs_out)
 {
-	uint32_t val, i;
+	uint32_t i, freqs[NR_CHARACTERS] = { 0 };
+	struct huffman_table table;
 
-	/* decode each character */
-	for (i = 0; i < dst_len; i++) {
-		/* get next character */
-		val = __read_huffman_val(bs_in, root);
+	/* compute characters frequencies */
+	for (i = 0; i < src_len; i++)
+		freqs[src[i]]++;
 
-		/* literal */
-		dst[i] = val;
-	}
+	/* build canonical huffman codes (with limited lengths) */
+	huffman_table_build_from_freqs(freqs, NR_CHARACTERS, HUFFMAN_MAX_BITS, &table);
+
+	/* write huffman header (= write dictionnary with codes lengths) */
+	__write_huffman_header(src_len, table.codes_len, bs_out);
+
+	/* write huffman content (= encode input buffer) */
+	__write_huffman_content(src, src_len, &table, bs_out);
+
+	/* flush last byte */
+	bit_stream_flush(bs_out);
+
+	/* free huffman table */
+	huffman_table_free(&table);
+}
+
+/**
+ * @brief Compute maximum compressed length (header with every character used, then HUFFMAN_MAX_BITS bits per character).
+ * 
+ * @param len 		input buffer length
+ * 
+ * @return maximum output buffer length
+ */
+uint32_t huffman_compress_bound(uint32_t len)
+{
+	return HUFFMAN_MAX_HEADER_SIZE + len + (len * (HUFFMAN_MAX_BITS - 8) + 7) / 8;
 }
 
 /**
@@ -186,45 +276,86 @@ static void __read_huffman_content(struct bit_stream *bs_in, uint8_t *dst, uint3
  * @param src 		input buffer
  * @param src_len 	input buffer length
  * @param dst_len 	output buffer length
- *
+ * 
  * @return output buffer
  */
 uint8_t *huffman_compress(uint8_t *src, uint32_t src_len, uint32_t *dst_len)
 {
-	struct huffman_node *tree, *nodes[NR_CHARACTERS] = { NULL };
-	uint32_t i, freqs[NR_CHARACTERS] = { 0 };
 	struct bit_stream bs_out = { 0 };
-	uint8_t *dst;
 
-	/* compute characters frequencies */
-	for (i = 0; i < src_len; i++)
-		freqs[src[i]]++;
+	/* compress */
+	__huffman_compress(src, src_len, &bs_out);
 
-	/* build huffman tree */
-	tree = huffman_tree_create(freqs, NR_CHARACTERS);
+	/* set destination length */
+	*dst_len = bs_out.byte_offset;
 
-	/* extract huffman nodes */
-	huffman_tree_extract_nodes(tree, nodes);
+	return bs_out.buf;
+}
 
-	/* write huffman header (= write dictionnary with frequencies) */
-	dst = __write_huffman_header(src_len, nodes, dst_len);
+/**
+ * @brief Compress a buffer with huffman algorithm into a caller buffer.
+ * 
+ * @param src 		input buffer
+ * @param src_len 	input buffer length
+ * @param dst 		output buffer
+ * @param dst_cap 	output buffer capacity
+ * @param dst_len 	output buffer length (needed length if output buffer is too small)
+ * 
+ * @return 0 on success, -1 if output buffer is too small
+ */
+int huffman_compress_into(uint8_t *src, uint32_t src_len, uint8_t *dst, uint32_t dst_cap, uint32_t *dst_len)
+{
+	struct bit_stream bs_out = { 0 };
 
 	/* set output bit stream */
-	bs_out.capacity = *dst_len;
 	bs_out.buf = dst;
-	bs_out.byte_offset = *dst_len;
-	bs_out.bit_offset = 0;
+	bs_out.capacity = dst_cap;
+	bs_out.fixed = 1;
 
-	/* write huffman content (= encode input buffer) */
-	__write_huffman_content(src, src_len, nodes, &bs_out);
+	/* compress */
+	__huffman_compress(src, src_len, &bs_out);
 
 	/* set destination length */
-	*dst_len = bs_out.byte_offset + (bs_out.bit_offset ? 1 : 0);
+	*dst_len = bs_out.byte_offset;
+
+	return *dst_len > dst_cap ? -1 : 0;
+}
 
-	/* free huffman tree */
-	huffman_tree_free(tree);
+/**
+ * @brief Uncompress huffman content.
+ * 
+ * @param src 		input buffer
+ * @param src_len 	input buffer length
+ * @param header_len 	huffman header length
+ * @param codes_len 	codes lengths (read from header)
+ * @param dst 		output buffer
+ * @param dst_len 	output buffer length
+ * 
+ * @return 0 on success, -1 on corrupted input
+ */
+static int __huffman_uncompress(uint8_t *src, uint32_t src_len, uint32_t header_len, uint32_t *codes_len, uint8_t *dst, uint32_t dst_len)
+{
+	uint32_t lookup[HUFFMAN_LOOKUP_SIZE];
+	struct bit_stream bs_in = { 0 };
+	struct huffman_table table;
+	int ret;
 
-	return bs_out.buf;
+	/* build canonical huffman codes and decoding table */
+	huffman_table_build_from_lengths(codes_len, NR_CHARACTERS, &table);
+	__build_lookup(&table, lookup);
+
+	/* set input bit stream */
+	bs_in.capacity = src_len - header_len;
+	bs_in.buf = src + header_len;
+
+	/* decode input buffer */
+	ret = __read_huffman_content(&bs_in, dst, dst_len, lookup);
+
+	/* free huffman table */
+	huffman_table_free(&table);
+
+	/* input must be read up to its end (last byte is padded) */
+	return ret < 0 || (bit_stream_read_pos(&bs_in) + 7) / 8 != bs_in.capacity ? -1 : 0;
 }
 
 /**
@@ -233,35 +364,62 @@ uint8_t *huffman_compress(uint8_t *src, uint32_t src_len, uint32_t *dst_len)
  * @param src 		input buffer
  * @param src_len 	input buffer length
  * @param dst_len 	output buffer length
- *
- * @return output buffer
+ * 
+ * @return output buffer, NULL on corrupted input
  */
 uint8_t *huffman_uncompress(uint8_t *src, uint32_t src_len, uint32_t *dst_len)
 {
-	uint32_t freqs[NR_CHARACTERS] = { 0 };
-	struct bit_stream bs_in = { 0 };
-	struct huffman_node *tree;
-	uint32_t header_len;
+	uint32_t codes_len[NR_CHARACTERS] = { 0 };
 	uint8_t *dst;
 
 	/* read huffman header */
-	header_len = __read_huffman_header(src, freqs, dst_len);
+	if (__read_huffman_header(src, src_len, codes_len, dst_len) < 0) {
+		*dst_len = 0;
+		return NULL;
+	}
 
 	/* allocate output buffer */
 	dst = (uint8_t *) xmalloc(*dst_len);
 
-	/* build huffman tree */
-	tree = huffman_tree_create(freqs, NR_CHARACTERS);
+	/* uncompress */
+	if (huffman_uncompress_into(src, src_len, dst, *dst_len, dst_len) < 0) {
+		xfree(dst);
+		return NULL;
+	}
 
-	/* set input bit stream */
-	bs_in.capacity = src_len - header_len;
-	bs_in.buf = src + header_len;
+	return dst;
+}
 
-	/* decode input buffer */
-	__read_huffman_content(&bs_in, dst, *dst_len, tree);
+/**
+ * @brief Uncompress a buffer with huffman algorithm into a caller buffer.
+ * 
+ * @param src 		input buffer
+ * @param src_len 	input buffer length
+ * @param dst 		output buffer
+ * @param dst_cap 	output buffer capacity
+ * @param dst_len 	output buffer length (needed length if output buffer is too small, 0 on corrupted input)
+ * 
+ * @return 0 on success, -1 if output buffer is too small or on corrupted input
+ */
+int huffman_uncompress_into(uint8_t *src, uint32_t src_len, uint8_t *dst, uint32_t dst_cap, uint32_t *dst_len)
+{
+	uint32_t codes_len[NR_CHARACTERS] = { 0 };
+	int header_len;
 
-	/* free huffman tree */
-	huffman_tree_free(tree);
+	/* read huffman header */
+	header_len = __read_huffman_header(src, src_len, codes_len, dst_len);
+	if (header_len < 0) {
+		*dst_len = 0;
+		return -1;
+	}
+	if (*dst_len > dst_cap)
+		return -1;
 
-	return dst;
+	/* uncompress */
+	if (__huffman_uncompress(src, src_len, header_len, codes_len, dst, *dst_len) < 0) {
+		*dst_len = 0;
+		return -1;
+	}
+
+	return 0;
 }
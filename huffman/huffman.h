@@ -15,6 +15,28 @@
  */
 uint8_t *huffman_compress(uint8_t *src, uint32_t src_len, uint32_t *dst_len);
 
+/**
+ * @brief Compute maximum compressed length (size a caller buffer for huffman_compress_into).
+ * 
+ * @param len 		input buffer length
+ *
+ * @return maximum output buffer length
+ */
+uint32_t huffman_compress_bound(uint32_t len);
+
+/**
+ * @brief Compress a buffer with huffman algorithm into a caller buffer.
+ * 
+ * @param src 		input buffer
+ * @param src_len 	input buffer length
+ * @param dst 		output buffer
+ * @param dst_cap 	output buffer capacity
+ * @param dst_len 	output buffer length (needed length if output buffer is too small)
+ *
+ * @return 0 on success, -1 if output buffer is too small
+ */
+int huffman_compress_into(uint8_t *src, uint32_t src_len, uint8_t *dst, uint32_t dst_cap, uint32_t *dst_len);
+
 /**
  * @brief Uncompress a buffer with huffman algorithm.
  * 
@@ -22,8 +44,21 @@ uint8_t *huffman_compress(uint8_t *src, uint32_t src_len, uint32_t *dst_len);
  * @param src_len 	input buffer length
  * @param dst_len 	output buffer length
  *
- * @return output buffer
+ * @return output buffer, NULL on corrupted input
  */
 uint8_t *huffman_uncompress(uint8_t *src, uint32_t src_len, uint32_t *dst_len);
 
+/**
+ * @brief Uncompress a buffer with huffman algorithm into a caller buffer.
+ * 
+ * @param src 		input buffer
+ * @param src_len 	input buffer length
+ * @param dst 		output buffer
+ * @param dst_cap 	output buffer capacity
+ * @param dst_len 	output buffer length (needed length if output buffer is too small, 0 on corrupted input)
+ *
+ * @return 0 on success, -1 if output buffer is too small or on corrupted input
+ */
+int huffman_uncompress_into(uint8_t *src, uint32_t src_len, uint8_t *dst, uint32_t dst_cap, uint32_t *dst_len);
+
 #endif
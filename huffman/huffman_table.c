@@ -1,8 +1,11 @@
 #include <string.h>
+#include <assert.h>
 
 #include "huffman_table.h"
 #include "../utils/mem.h"
 
+#define HUFFMAN_TABLE_MAX_LEN		255
+
 /**
  * @brief Create a huffman table.
  * 
@@ -15,6 +18,9 @@ void huffman_table_create(struct huffman_table *table, uint32_t len)
 	table->len = len;
 	table->codes = (uint32_t *) xmalloc(len * sizeof(uint32_t));
 	table->codes_len = (uint32_t *) xmalloc(len * sizeof(uint32_t));
+	table->lookup = NULL;
+	table->lookup_bits = 0;
+	table->max_bits = 0;
 
 	/* clear huffman table */
 	memset(table->codes, 0, len * sizeof(uint32_t));
@@ -22,33 +28,61 @@ void huffman_table_create(struct huffman_table *table, uint32_t len)
 }
 
 /**
- * @brief Build a huffman table from a huffman tree.
+ * @brief Build canonical codes from codes lengths.
  * 
- * @param tree			input huffman tree
- * @param table			output huffman table
- * @param len			huffman table length
+ * @param codes_len 		codes lengths
+ * @param nr_codes 		number of codes
+ * @param table 		output huffman table
  */
-void huffman_table_build_from_tree(struct huffman_node *tree, struct huffman_table *table, uint32_t len)
+static void __huffman_table_build_codes(uint32_t *codes_len, uint32_t nr_codes, struct huffman_table *table)
 {
-	struct huffman_node **nodes;
-	uint32_t *codes_len, i;
+	uint32_t count[HUFFMAN_TABLE_MAX_LEN + 1], next_code[HUFFMAN_TABLE_MAX_LEN + 1], max = 0, code = 0, i;
 
-	/* extract huffman nodes */
-	nodes = (struct huffman_node **) xmalloc(sizeof(struct huffman_node *) * len);
-	memset(nodes, 0, sizeof(struct huffman_node *) * len);
-	huffman_tree_extract_nodes(tree, nodes);
+	/* find maximum length */
+	for (i = 0, max = 0; i < nr_codes; i++)
+		max = codes_len[i] > max ? codes_len[i] : max;
 
-	/* extract codes length */
-	codes_len = xmalloc(sizeof(uint32_t) * len);
-	for (i = 0; i < len; i++)
-		codes_len[i] = nodes[i] ? nodes[i]->nr_bits : 0;
+	/* create huffman table */
+	huffman_table_create(table, nr_codes);
+	table->max_bits = max;
 
-	/* build huffman table */
-	huffman_table_build_from_lengths(codes_len, len, table);
+	/* count codes of each length */
+	memset(count, 0, sizeof(uint32_t) * (max + 1));
+	for (i = 0; i < nr_codes; i++)
+		count[codes_len[i]]++;
 
-	/* free nodes */
-	xfree(nodes);
-	xfree(codes_len);
+	/* first code of each length (codes of a length follow values order, then code is right shifted) */
+	for (i = 1, count[0] = 0; i <= max; i++) {
+		code = (code + count[i - 1]) << 1;
+		next_code[i] = code;
+	}
+
+	/* assign codes */
+	for (i = 0; i < nr_codes; i++) {
+		if (codes_len[i]) {
+			table->codes[i] = next_code[codes_len[i]]++;
+			table->codes_len[i] = codes_len[i];
+		}
+	}
+}
+
+/**
+ * @brief Build a huffman table from characters frequencies (encoding only : no decoding table is built).
+ * 
+ * @param freqs			characters frequencies
+ * @param nr_codes		number of codes
+ * @param max_bits		maximum code length
+ * @param table			output huffman table
+ */
+void huffman_table_build_from_freqs(uint32_t *freqs, uint32_t nr_codes, uint32_t max_bits, struct huffman_table *table)
+{
+	uint32_t codes_len[HUFFMAN_MAX_CHARACTERS];
+
+	/* build codes lengths */
+	huffman_tree_build_limited_lengths(freqs, nr_codes, max_bits, codes_len);
+
+	/* build canonical codes */
+	__huffman_table_build_codes(codes_len, nr_codes, table);
 }
 
 /**
@@ -60,28 +94,97 @@ void huffman_table_build_from_tree(struct huffman_node *tree, struct huffman_tab
  */
 void huffman_table_build_from_lengths(uint32_t *codes_len, uint32_t nr_codes, struct huffman_table *table)
 {
-	uint32_t max = 0, code = 0, i, j;
+	/* build canonical codes */
+	__huffman_table_build_codes(codes_len, nr_codes, table);
+
+	/* build decoding table */
+	huffman_table_build_lookup(table);
+}
+
+/**
+ * @brief Build decoding table of a huffman table (from codes and codes lengths).
+ * 
+ * Codes are read Most Significant bit first, so tables are indexed by reversed codes :
+ * the primary table is indexed by the next lookup_bits bits and longer codes are resolved
+ * in a sub table (one per primary index), indexed by the following bits.
+ * 
+ * @param table 		huffman table
+ */
+void huffman_table_build_lookup(struct huffman_table *table)
+{
+	uint32_t i, j, rev, len, mask, size, offset, sub_bits, nr_entries, *sub_offsets;
+	uint8_t *sub_max;
 
 	/* find maximum length */
-	for (i = 0, max = 0; i < nr_codes; i++)
-		max = codes_len[i] > max ? codes_len[i] : max;
+	for (i = 0, table->max_bits = 0; i < table->len; i++)
+		if (table->codes_len[i] > table->max_bits)
+			table->max_bits = table->codes_len[i];
+
+	/* codes must fit in a peek */
+	assert(table->max_bits <= 32);
+
+	/* compute primary table size */
+	table->lookup_bits = table->max_bits < HUFFMAN_LOOKUP_BITS ? table->max_bits : HUFFMAN_LOOKUP_BITS;
+	size = 1 << table->lookup_bits;
+	mask = size - 1;
+
+	/* compute sub tables sizes (= maximum length of codes sharing a primary index) */
+	sub_max = (uint8_t *) xmalloc(size);
+	sub_offsets = (uint32_t *) xmalloc(sizeof(uint32_t) * size);
+	memset(sub_max, 0, size);
+	for (i = 0; i < table->len; i++) {
+		len = table->codes_len[i];
+		if (len <= table->lookup_bits)
+			continue;
+
+		rev = bit_stream_reverse_bits(table->codes[i], len) & mask;
+		if (len > sub_max[rev])
+			sub_max[rev] = len;
+	}
 
-	/* create huffman table */
-	huffman_table_create(table, nr_codes);
+	/* compute sub tables offsets */
+	for (i = 0, nr_entries = size; i < size; i++) {
+		sub_offsets[i] = nr_entries;
+		if (sub_max[i])
+			nr_entries += 1 << (sub_max[i] - table->lookup_bits);
+	}
 
-	/* for each length */
-	for (i = 1; i <= max; i++) {
-		/* find matching codes */
-		for (j = 0; j < nr_codes; j++) {
-			if (codes_len[j] == i) {
-				table->codes[j] = code++;
-				table->codes_len[j] = i;
-			}
+	/* allocate decoding table (unused codes are invalid) */
+	xfree(table->lookup);
+	table->lookup = (uint32_t *) xmalloc(sizeof(uint32_t) * nr_entries);
+	for (i = 0; i < nr_entries; i++)
+		table->lookup[i] = huffman_lookup_entry(0, HUFFMAN_LOOKUP_INVALID, 0);
+
+	/* link primary table to sub tables */
+	for (i = 0; i < size; i++)
+		if (sub_max[i])
+			table->lookup[i] = huffman_lookup_entry(sub_offsets[i], HUFFMAN_LOOKUP_LINK, sub_max[i] - table->lookup_bits);
+
+	/* fill tables */
+	for (i = 0; i < table->len; i++) {
+		len = table->codes_len[i];
+		if (!len)
+			continue;
+
+		rev = bit_stream_reverse_bits(table->codes[i], len);
+
+		/* short code : fill all primary entries starting with this code */
+		if (len <= table->lookup_bits) {
+			for (j = rev; j < size; j += 1 << len)
+				table->lookup[j] = huffman_lookup_entry(i, 0, len);
+			continue;
 		}
 
-		/* right shift code */
-		code <<= 1;
+		/* long code : fill all sub table entries starting with the remaining bits */
+		offset = sub_offsets[rev & mask];
+		sub_bits = sub_max[rev & mask] - table->lookup_bits;
+		for (j = rev >> table->lookup_bits; j < (1U << sub_bits); j += 1 << (len - table->lookup_bits))
+			table->lookup[offset + j] = huffman_lookup_entry(i, 0, len);
 	}
+
+	/* free temporary arrays */
+	xfree(sub_max);
+	xfree(sub_offsets);
 }
 
 
@@ -95,6 +198,7 @@ void huffman_table_free(struct huffman_table *table)
 	if (table) {
 		xfree(table->codes);
 		xfree(table->codes_len);
+		xfree(table->lookup);
 	}
 }
 
@@ -104,23 +208,27 @@ void huffman_table_free(struct huffman_table *table)
  * @param bs_in		input bit stream
  * @param table		huffman table
  * 
- * @return symbol
+ * @return symbol (-1 if code is invalid)
  */
-int huffman_table_read_symbol(struct bit_stream *bs_in, struct huffman_table *table)
+int huffman_table_read_symbol(struct bit_stream *bs_in, const struct huffman_table *table)
 {
-	uint32_t code = 0, code_len = 0, i;
+	uint32_t bits, entry;
 
-	for (;;) {
-		/* read next bit */
-		code |= bit_stream_read_bits(bs_in, 1, BIT_ORDER_MSB);
-		code_len++;
+	/* peek enough bits for longest code */
+	bits = bit_stream_peek_bits_lsb(bs_in, table->max_bits);
 
-		/* try to find code in huffman table */
-		for (i = 0; i < table->len; i++)
-			if (table->codes_len[i] == code_len && table->codes[i] == code)
-				return i;
+	/* primary table */
+	entry = table->lookup[bits & ((1 << table->lookup_bits) - 1)];
 
-		/* go to next bit */
-		code <<= 1;
-	}
+	/* sub table */
+	if (entry & HUFFMAN_LOOKUP_LINK)
+		entry = table->lookup[huffman_lookup_value(entry)
+				      + ((bits >> table->lookup_bits) & ((1 << huffman_lookup_nr_bits(entry)) - 1))];
+
+	/* invalid code */
+	if (entry & HUFFMAN_LOOKUP_INVALID)
+		return -1;
+
+	bit_stream_consume_bits(bs_in, huffman_lookup_nr_bits(entry));
+	return huffman_lookup_value(entry);
 }
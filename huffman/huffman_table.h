@@ -6,6 +6,20 @@
 #include "huffman_tree.h"
 #include "../utils/bit_stream.h"
 
+#define HUFFMAN_LOOKUP_BITS		9
+#define HUFFMAN_LOOKUP_LINK		0x100
+#define HUFFMAN_LOOKUP_INVALID		0x200
+
+/*
+ * Lookup table entry = (value << 16) | flags | number of bits :
+ * - symbol : value = symbol, number of bits = code length
+ * - link : value = sub table offset, number of bits = sub table index bits
+ * - invalid : code not used
+ */
+#define huffman_lookup_entry(value, flags, nr_bits)	(((value) << 16) | (flags) | (nr_bits))
+#define huffman_lookup_value(entry)			((entry) >> 16)
+#define huffman_lookup_nr_bits(entry)			((entry) & 0xFF)
+
 /**
  * @brief Huffman table.
  */
@@ -13,6 +27,9 @@ struct huffman_table {
 	uint32_t		len;		/* table length */
 	uint32_t * 		codes;		/* values to huffman codes */
 	uint32_t * 		codes_len;	/* values to huffman codes lengths (= number of bits) */
+	uint32_t *		lookup;		/* decoding table (primary table followed by sub tables) */
+	uint32_t		lookup_bits;	/* primary decoding table index bits */
+	uint32_t		max_bits;	/* maximum code length */
 };
 
 /**
@@ -24,13 +41,14 @@ struct huffman_table {
 void huffman_table_create(struct huffman_table *table, uint32_t len);
 
 /**
- * @brief Build a huffman table from a huffman tree.
+ * @brief Build a huffman table from characters frequencies (encoding only : no decoding table is built).
  * 
- * @param tree			input huffman tree
+ * @param freqs			characters frequencies
+ * @param nr_codes		number of codes
+ * @param max_bits		maximum code length
  * @param table			output huffman table
- * @param len			huffman table length
  */
-void huffman_table_build_from_tree(struct huffman_node *tree, struct huffman_table *table, uint32_t len);
+void huffman_table_build_from_freqs(uint32_t *freqs, uint32_t nr_codes, uint32_t max_bits, struct huffman_table *table);
 
 /**
  * @brief Build a huffman table from codes lengths.
@@ -41,6 +59,13 @@ void huffman_table_build_from_tree(struct huffman_node *tree, struct huffman_tab
  */
 void huffman_table_build_from_lengths(uint32_t *codes_len, uint32_t nr_codes, struct huffman_table *table);
 
+/**
+ * @brief Build decoding table of a huffman table (from codes and codes lengths).
+ * 
+ * @param table 		huffman table
+ */
+void huffman_table_build_lookup(struct huffman_table *table);
+
 /**
  * @brief Free a huffman table.
  * 
@@ -56,6 +81,6 @@ void huffman_table_free(struct huffman_table *table);
  * 
  * @return symbol
  */
-int huffman_table_read_symbol(struct bit_stream *bs_in, struct huffman_table *table);
+int huffman_table_read_symbol(struct bit_stream *bs_in, const struct huffman_table *table);
 
 #endif
\ No newline at end of file
@@ -1,182 +1,263 @@
 /*
- * Huffman encoding = lossless data compression method, working at alphabet level :
- * 1 - parse all file to compute frequency of each character
- * 2 - build huffman tree (min heap) based on frequencies
- *	-> every letter is a leaf in the heap
+ * Huffman tree = optimal prefix code, working at alphabet level :
+ * 1 - sort characters by frequency
+ * 2 - repeatedly merge the 2 least frequent items (characters or already merged items)
+ *	-> merged items are created in frequency order, so 2 queues (characters and merged items) replace a heap
  *	-> more frequent letters have shortest code
- * 3 - build binary code of every letter
- * 4 - write header in compressed file = every letter with its frequency = dictionnary (so decompressor will be able to rebuild the tree)
- * 5 - encode file = replace each letter with binary code
+ * 3 - code length of every letter = depth of the letter in the tree
+ *
+ * Only codes lengths are computed (codes are then built canonically from lengths), in place in
+ * a single array (Moffat-Katajainen algorithm) : no node is allocated.
  */
 
+#include <stdlib.h>
 #include <string.h>
-#include <endian.h>
+#include <assert.h>
 
 #include "huffman_tree.h"
-#include "../utils/mem.h"
-#include "../utils/heap.h"
-#include "../utils/bit_stream.h"
 
 /**
- * @brief Compare 2 huffman nodes.
+ * @brief Compare 2 characters by frequency (then by value).
  * 
- * @param h1 		first node
- * @param h2 		second node
+ * @param s1 		first character
+ * @param s2 		second character
  * 
  * @return result
  */
-static int __huffman_node_compare(const void *h1, const void *h2)
+static int __symbol_compare(const void *s1, const void *s2)
 {
-	return ((struct huffman_node *) h1)->freq - ((struct huffman_node *) h2)->freq;
+	const uint64_t a = *((const uint64_t *) s1), b = *((const uint64_t *) s2);
+
+	return a < b ? -1 : a > b;
 }
 
 /**
- * @brief Create a huffman node.
+ * @brief Sort used characters by frequency.
  * 
- * @param val		value
- * @param freq 		frequency
- *
- * @return huffman node
+ * @param freqs 		characters frequencies
+ * @param nr_characters		number of characters in the alphabet
+ * @param symbols		output sorted characters (frequency in high bits, value in low bits)
+ * 
+ * @return number of used characters
  */
-static struct huffman_node *__huffman_node_create(uint32_t val, uint32_t freq)
+static uint32_t __sort_symbols(uint32_t *freqs, uint32_t nr_characters, uint64_t *symbols)
 {
-	struct huffman_node *node;
+	uint32_t i, n;
+
+	assert(nr_characters <= HUFFMAN_MAX_CHARACTERS);
+
+	for (i = 0, n = 0; i < nr_characters; i++)
+		if (freqs[i])
+			symbols[n++] = ((uint64_t) freqs[i] << 32) | i;
 
-	node = (struct huffman_node *) xmalloc(sizeof(struct huffman_node));
-	node->val = val;
-	node->freq = freq;
-	node->left = NULL;
-	node->right = NULL;
-	node->huffman_code = 0;
-	node->nr_bits = 0;
+	qsort(symbols, n, sizeof(uint64_t), __symbol_compare);
 
-	return node;
+	return n;
 }
 
 /**
- * @brief Build huffman codes.
+ * @brief Compute huffman codes lengths in place (Moffat-Katajainen algorithm).
  * 
- * @param root 		huffman tree
- * @param code 		huffman code
- * @param nr_bits	number of bits
+ * @param a 		input frequencies sorted in ascending order / output codes lengths
+ * @param n 		number of characters (>= 2)
  */
-static void __huffman_tree_build_codes(struct huffman_node *root, uint32_t code, uint32_t nr_bits)
+static void __build_lengths_in_place(uint64_t *a, uint32_t n)
 {
-	/* build huffman code on left (encode with a zero) */
-	if (root->left)
-		__huffman_tree_build_codes(root->left, code << 1, nr_bits + 1);
-
-	/* build huffman code on right (encode with a one) */
-	if (root->right)
-		__huffman_tree_build_codes(root->right, (code << 1) | 0x01, nr_bits + 1);
-
-	/* leaf : create code */
-	if (__huffman_leaf(root)) {
-		root->huffman_code = code;
-		root->nr_bits = nr_bits;
+	uint32_t root, leaf, next, avail, used, depth;
+	int i;
+
+	/* first pass (left to right) : merge items, internal nodes frequencies are replaced by parents indexes */
+	a[0] += a[1];
+	for (root = 0, leaf = 2, next = 1; next < n - 1; next++) {
+		/* first item = smallest of next leaf and next internal node */
+		if (leaf >= n || a[root] < a[leaf]) {
+			a[next] = a[root];
+			a[root++] = next;
+		} else {
+			a[next] = a[leaf++];
+		}
+
+		/* second item */
+		if (leaf >= n || (root < next && a[root] < a[leaf])) {
+			a[next] += a[root];
+			a[root++] = next;
+		} else {
+			a[next] += a[leaf++];
+		}
+	}
+
+	/* second pass (right to left) : internal nodes depths */
+	a[n - 2] = 0;
+	for (i = n - 3; i >= 0; i--)
+		a[i] = a[a[i]] + 1;
+
+	/* third pass (right to left) : leaves depths */
+	avail = 1;
+	used = depth = 0;
+	root = n - 2;
+	next = n - 1;
+	while (avail > 0) {
+		/* count internal nodes at this depth */
+		while ((int) root >= 0 && a[root] == depth) {
+			used++;
+			root--;
+		}
+
+		/* remaining nodes at this depth are leaves */
+		while (avail > used) {
+			a[next--] = depth;
+			avail--;
+		}
+
+		/* go to next depth */
+		avail = 2 * used;
+		depth++;
+		used = 0;
 	}
 }
 
 /**
- * @brief Create a huffman tree.
+ * @brief Compute length limited huffman codes lengths (package-merge algorithm).
  * 
- * @param freqs 		characters frequencies
- * @param nr_characters		number of characters in the alphabet
+ * Level 1 list = characters sorted by frequency. Each next level list = characters merged with
+ * packages (= pairs) of previous level list. The 2n - 2 cheapest items of the last level are selected :
+ * every time a character is selected (directly or inside a package) its code length is incremented.
+ * Characters are sorted, so selected characters are always the first ones of a list and only the
+ * number of characters in each selected prefix is needed.
  * 
- * @return huffman tree
+ * @param symbols 		sorted characters
+ * @param n 			number of characters (>= 2)
+ * @param max_bits		maximum code length
+ * @param codes_len		output codes lengths
  */
-struct huffman_node *huffman_tree_create(uint32_t *freqs, uint32_t nr_characters)
+static void __package_merge(uint64_t *symbols, uint32_t n, uint32_t max_bits, uint32_t *codes_len)
 {
-	struct huffman_node *left, *right, *top, *node;
-	struct heap *heap;
-	uint32_t i;
-
-	/* create a heap */
-	heap = heap_create(HEAP_MIN, nr_characters * 2, __huffman_node_compare);
-	if (!heap)
-		return NULL;
-
-	/* build min heap */
-	for (i = 0; i < nr_characters; i++) {
-		if (!freqs[i])
-			continue;
-
-		/* create node */
-		node = __huffman_node_create(i, freqs[i]);
-		if (!node)
-			goto out;
-
-		/* insert node */
-		heap_insert(heap, node);
+	uint64_t lists[2][2 * HUFFMAN_MAX_CHARACTERS], *list, *prev, package;
+	uint8_t is_leaf[32 * 2 * HUFFMAN_MAX_CHARACTERS];
+	uint32_t i, j, k, level, len, prev_len, m, nr_leaves;
+
+	/* level 1 = characters */
+	prev = lists[0];
+	list = lists[1];
+	for (i = 0; i < n; i++) {
+		prev[i] = symbols[i] >> 32;
+		is_leaf[i] = 1;
 	}
+	prev_len = n;
+
+	/* next levels = characters merged with packages of previous level (each list has at most 2n - 1 items) */
+	for (level = 1; level < max_bits; level++) {
+		for (i = 0, j = 0, len = 0; i < n || j + 1 < prev_len; len++) {
+			package = j + 1 < prev_len ? prev[j] + prev[j + 1] : UINT64_MAX;
 
-	/* build huffman tree */
-	while (heap->size > 1) {
-		/* extract 2 minimum values */
-		left = heap_min(heap);
-		right = heap_min(heap);
-
-		/* build parent node (= left frequency + right frequency)*/
-		top = __huffman_node_create('$', left->freq + right->freq);
-		if (!top)
-			return NULL;
-
-		/* insert parent node in heap */
-		top->left = left;
-		top->right = right;
-		heap_insert(heap, top);
+			/* characters first on ties */
+			if (i < n && (symbols[i] >> 32) <= package) {
+				list[len] = symbols[i++] >> 32;
+				is_leaf[level * 2 * n + len] = 1;
+			} else {
+				list[len] = package;
+				is_leaf[level * 2 * n + len] = 0;
+				j += 2;
+			}
+		}
+
+		/* swap lists */
+		prev = list;
+		list = prev == lists[0] ? lists[1] : lists[0];
+		prev_len = len;
 	}
 
-	/* get root */
-	node = heap_min(heap);
+	/* select 2n - 2 cheapest items of last level and expand packages down to level 1 */
+	for (level = max_bits, m = 2 * n - 2; level > 0 && m > 0; level--) {
+		/* count characters in selected prefix */
+		for (k = 0, nr_leaves = 0; k < m; k++)
+			nr_leaves += is_leaf[(level - 1) * 2 * n + k];
+
+		/* increment selected characters lengths */
+		for (k = 0; k < nr_leaves; k++)
+			codes_len[symbols[k] & 0xFFFFFFFF]++;
 
-	/* build huffman codes */
-	__huffman_tree_build_codes(node, 0, 0);
-out:
-	heap_free(heap);
-	return node;
+		/* selected packages = 2 items each at previous level */
+		m = 2 * (m - nr_leaves);
+	}
 }
 
 /**
- * @brief Extract huffman nodes from a tree.
+ * @brief Build huffman codes lengths (= leaves depths in huffman tree).
  * 
- * @param root		huffman tree
- * @param nodes		output nodes
+ * @param freqs 		characters frequencies
+ * @param nr_characters		number of characters in the alphabet (<= HUFFMAN_MAX_CHARACTERS)
+ * @param codes_len		output codes lengths (0 for unused characters)
  */
-void huffman_tree_extract_nodes(struct huffman_node *root, struct huffman_node **nodes)
+void huffman_tree_build_lengths(uint32_t *freqs, uint32_t nr_characters, uint32_t *codes_len)
 {
-	if (!root)
-		return;
+	uint64_t symbols[HUFFMAN_MAX_CHARACTERS], a[HUFFMAN_MAX_CHARACTERS];
+	uint32_t n, i;
 
-	if (root->left)
-		huffman_tree_extract_nodes(root->left, nodes);
+	/* reset codes lengths */
+	memset(codes_len, 0, sizeof(uint32_t) * nr_characters);
 
-	if (root->right)
-		huffman_tree_extract_nodes(root->right, nodes);
+	/* sort used characters by frequency */
+	n = __sort_symbols(freqs, nr_characters, symbols);
 
-	if (__huffman_leaf(root))
-		nodes[root->val] = root;
-}
+	/* 0 or 1 character (a single character still needs a 1 bit code) */
+	if (n <= 1) {
+		if (n == 1)
+			codes_len[symbols[0] & 0xFFFFFFFF] = 1;
+		return;
+	}
 
+	/* compute codes lengths */
+	for (i = 0; i < n; i++)
+		a[i] = symbols[i] >> 32;
+	__build_lengths_in_place(a, n);
+
+	/* set codes lengths */
+	for (i = 0; i < n; i++)
+		codes_len[symbols[i] & 0xFFFFFFFF] = a[i];
+}
 
 /**
- * @brief Free a huffman tree.
+ * @brief Build length limited huffman codes lengths.
  * 
- * @param root 		root node
+ * @param freqs 		characters frequencies
+ * @param nr_characters		number of characters in the alphabet (<= HUFFMAN_MAX_CHARACTERS)
+ * @param max_bits		maximum code length (< 32)
+ * @param codes_len		output codes lengths (0 for unused characters)
  */
-void huffman_tree_free(struct huffman_node *root)
+void huffman_tree_build_limited_lengths(uint32_t *freqs, uint32_t nr_characters, uint32_t max_bits, uint32_t *codes_len)
 {
-	struct huffman_node *left, *right;
+	uint64_t symbols[HUFFMAN_MAX_CHARACTERS], a[HUFFMAN_MAX_CHARACTERS];
+	uint32_t n, i;
+
+	/* reset codes lengths */
+	memset(codes_len, 0, sizeof(uint32_t) * nr_characters);
+
+	/* sort used characters by frequency */
+	n = __sort_symbols(freqs, nr_characters, symbols);
 
-	if (!root)
+	/* 0 or 1 character (a single character still needs a 1 bit code) */
+	if (n <= 1) {
+		if (n == 1)
+			codes_len[symbols[0] & 0xFFFFFFFF] = 1;
 		return;
+	}
+
+	/* maximum code length must allow n codes */
+	assert(max_bits < 32 && (1U << max_bits) >= n);
 
-	/* free root */
-	left = root->left;
-	right = root->right;
-	xfree(root);
+	/* compute unlimited codes lengths (longest code = least frequent character = first one) */
+	for (i = 0; i < n; i++)
+		a[i] = symbols[i] >> 32;
+	__build_lengths_in_place(a, n);
 
-	/* free children */
-	huffman_tree_free(left);
-	huffman_tree_free(right);
-}
\ No newline at end of file
+	/* codes too long : use package-merge */
+	if (a[0] > max_bits) {
+		__package_merge(symbols, n, max_bits, codes_len);
+		return;
+	}
+
+	/* set codes lengths */
+	for (i = 0; i < n; i++)
+		codes_len[symbols[i] & 0xFFFFFFFF] = a[i];
+}
@@ -4,43 +4,25 @@
 #include <stdio.h>
 #include <stdint.h>
 
-#define __huffman_leaf(node)	((node)->left == NULL && (node)->right == NULL)
+#define HUFFMAN_MAX_CHARACTERS		288
 
 /**
- * @brief Huffman node.
- */
-struct huffman_node {
-	uint32_t		val;				/* value */
-	uint32_t 		freq;				/* frequency */
-	uint32_t		huffman_code;			/* huffman code */
-	uint32_t		nr_bits;			/* number of bits in huffman code */
-	struct huffman_node *	left;				/* left node */
-	struct huffman_node *	right;				/* right node */
-};
-
-/**
- * @brief Create a huffman tree.
+ * @brief Build huffman codes lengths (= leaves depths in huffman tree).
  * 
  * @param freqs 		characters frequencies
- * @param nr_characters		number of characters in the alphabet
- * 
- * @return huffman tree
+ * @param nr_characters		number of characters in the alphabet (<= HUFFMAN_MAX_CHARACTERS)
+ * @param codes_len		output codes lengths (0 for unused characters)
  */
-struct huffman_node *huffman_tree_create(uint32_t *freqs, uint32_t nr_characters);
+void huffman_tree_build_lengths(uint32_t *freqs, uint32_t nr_characters, uint32_t *codes_len);
 
 /**
- * @brief Free a huffman tree.
+ * @brief Build length limited huffman codes lengths.
  * 
- * @param root 		root node
- */
-void huffman_tree_free(struct huffman_node *root);
-
-/**
- * @brief Extract huffman nodes from a tree.
- * 
- * @param root		huffman tree
- * @param nodes		output nodes
+ * @param freqs 		characters frequencies
+ * @param nr_characters		number of characters in the alphabet (<= HUFFMAN_MAX_CHARACTERS)
+ * @param max_bits		maximum code length (< 32)
+ * @param codes_len		output codes lengths (0 for unused characters)
  */
-void huffman_tree_extract_nodes(struct huffman_node *root, struct huffman_node **nodes);
+void huffman_tree_build_limited_lengths(uint32_t *freqs, uint32_t nr_characters, uint32_t max_bits, uint32_t *codes_len);
 
 #endif
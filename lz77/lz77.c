@@ -11,6 +11,7 @@
 
 #include "lz77.h"
 #include "../utils/byte_stream.h"
+#include "../utils/match_copy.h"
 #include "../utils/mem.h"
 
 #define WINDOW_SIZE		255
@@ -66,23 +67,20 @@ static void __lz77_match(uint8_t *window, uint8_t *buf, uint32_t len, struct lz7
 }
 
 /**
- * @brief Compress a buffer with LZ77 algorithm.
+ * @brief Compress a buffer with LZ77 algorithm to a byte stream.
  * 
  * @param src 		input buffer
  * @param src_len 	input buffer length
- * @param dst_len 	output buffer length
- *
- * @return output buffer
+ * @param bs_out 	output byte stream
  */
-uint8_t *lz77_compress(uint8_t *src, uint32_t src_len, uint32_t *dst_len)
+static void __lz77_compress(uint8_t *src, uint32_t src_len, struct byte_stream *bs_out)
 {
-	struct byte_stream bs_out = { 0 };
 	uint8_t *window, *buf_in;
 	uint32_t window_size, i;
 	struct lz77_node node;
 
 	/* write uncompressed length first */
-	byte_stream_write_u32(&bs_out, htole32(src_len));
+	byte_stream_write_u32(bs_out, htole32(src_len));
 
 	/* set input buffer and initial window */
 	buf_in = window = src;
@@ -90,7 +88,7 @@ uint8_t *lz77_compress(uint8_t *src, uint32_t src_len, uint32_t *dst_len)
 	/* copy first window to destination */
 	window_size = src_len < WINDOW_SIZE ? src_len : WINDOW_SIZE;
 	for (i = 0; i < window_size; i++)
-		byte_stream_write_u8(&bs_out, *buf_in++);
+		byte_stream_write_u8(bs_out, *buf_in++);
 
 	/* compress nodes */
 	while (buf_in < src + src_len) {
@@ -98,14 +96,45 @@ uint8_t *lz77_compress(uint8_t *src, uint32_t src_len, uint32_t *dst_len)
 		__lz77_match(window, buf_in, src + src_len - buf_in - 1, &node);
 
 		/* write match or literal */
-		byte_stream_write_u8(&bs_out, node.off);
-		byte_stream_write_u8(&bs_out, node.len);
-		byte_stream_write_u8(&bs_out, node.literal);
+		byte_stream_write_u8(bs_out, node.off);
+		byte_stream_write_u8(bs_out, node.len);
+		byte_stream_write_u8(bs_out, node.literal);
 
 		/* update window and buffer */
 		window += node.len + 1;
 		buf_in += node.len + 1;
 	}
+}
+
+/**
+ * @brief Compute maximum compressed length (first window is copied, then each node holds at least one character).
+ * 
+ * @param len 		input buffer length
+ *
+ * @return maximum output buffer length
+ */
+uint32_t lz77_compress_bound(uint32_t len)
+{
+	uint32_t window_size = len < WINDOW_SIZE ? len : WINDOW_SIZE;
+
+	return sizeof(uint32_t) + window_size + (len - window_size) * sizeof(struct lz77_node);
+}
+
+/**
+ * @brief Compress a buffer with LZ77 algorithm.
+ * 
+ * @param src 		input buffer
+ * @param src_len 	input buffer length
+ * @param dst_len 	output buffer length
+ *
+ * @return output buffer
+ */
+uint8_t *lz77_compress(uint8_t *src, uint32_t src_len, uint32_t *dst_len)
+{
+	struct byte_stream bs_out = { 0 };
+
+	/* compress */
+	__lz77_compress(src, src_len, &bs_out);
 
 	/* set destination length */
 	*dst_len = bs_out.size;
@@ -114,33 +143,66 @@ uint8_t *lz77_compress(uint8_t *src, uint32_t src_len, uint32_t *dst_len)
 }
 
 /**
- * @brief Uncompress a buffer with LZ77 algorithm.
+ * @brief Compress a buffer with LZ77 algorithm into a caller buffer.
  * 
  * @param src 		input buffer
  * @param src_len 	input buffer length
- * @param dst_len 	output buffer length
+ * @param dst 		output buffer
+ * @param dst_cap 	output buffer capacity
+ * @param dst_len 	output buffer length (needed length if output buffer is too small)
  *
- * @return output buffer
+ * @return 0 on success, -1 if output buffer is too small
  */
-uint8_t *lz77_uncompress(uint8_t *src, uint32_t src_len, uint32_t *dst_len)
+int lz77_compress_into(uint8_t *src, uint32_t src_len, uint8_t *dst, uint32_t dst_cap, uint32_t *dst_len)
 {
-	uint8_t *dst, *buf_in, *buf_out;
+	struct byte_stream bs_out = { 0 };
+
+	/* set output byte stream */
+	bs_out.buf = dst;
+	bs_out.capacity = dst_cap;
+	bs_out.fixed = 1;
+
+	/* compress */
+	__lz77_compress(src, src_len, &bs_out);
+
+	/* set destination length */
+	*dst_len = bs_out.size;
+
+	return *dst_len > dst_cap ? -1 : 0;
+}
+
+/**
+ * @brief Compute maximum uncompressed length of an input (first window is raw, then a node holds at most 256 characters).
+ * 
+ * @param src_len 	input buffer length (with uncompressed length)
+ * 
+ * @return maximum uncompressed length
+ */
+static uint64_t __lz77_uncompress_bound(uint32_t src_len)
+{
+	return WINDOW_SIZE + (uint64_t) (src_len - sizeof(uint32_t)) / sizeof(struct lz77_node) * (UINT8_MAX + 1);
+}
+
+/**
+ * @brief Uncompress LZ77 nodes.
+ * 
+ * @param src 		input buffer (after uncompressed length)
+ * @param src_len 	input buffer length
+ * @param dst 		output buffer
+ * @param dst_len 	output buffer length
+ * 
+ * @return 0 on success, -1 on corrupted input
+ */
+static int __lz77_uncompress(uint8_t *src, uint32_t src_len, uint8_t *dst, uint32_t dst_len)
+{
+	uint8_t *buf_in = src, *buf_out = dst, *dst_end = dst + dst_len;
 	struct lz77_node *node;
 	uint32_t window_size;
 
-	/* read uncompressed length first */
-	*dst_len = le32toh(*((uint32_t *) src));
-	src += sizeof(uint32_t);
-	src_len -= sizeof(uint32_t);
-	
-	/* set input buffer */
-	buf_in = src;
-	
-	/* allocate destination buffer */
-	dst = buf_out = (uint8_t *) xmalloc(*dst_len);
-
 	/* copy first window to destination */
 	window_size = src_len < WINDOW_SIZE ? src_len : WINDOW_SIZE;
+	if (window_size > dst_len)
+		return -1;
 	memcpy(buf_out, buf_in, window_size);
 	buf_in += window_size;
 	buf_out += window_size;
@@ -148,12 +210,18 @@ uint8_t *lz77_uncompress(uint8_t *src, uint32_t src_len, uint32_t *dst_len)
 	/* uncompress nodes */
 	while (buf_in < src + src_len) {
 		/* read lz77 node */
+		if (src + src_len - buf_in < (long) sizeof(struct lz77_node))
+			return -1;
 		node = (struct lz77_node *) buf_in;
 		buf_in += sizeof(struct lz77_node);
 
+		/* match and literal must fit in output buffer, match must stay in it */
+		if (node->len + 1 > dst_end - buf_out || (node->len > 0 && (node->off == 0 || node->off > buf_out - dst)))
+			return -1;
+
 		/* retrieve match */
 		if (node->len > 0) {
-			memcpy(buf_out, buf_out - node->off, node->len);
+			match_copy(buf_out, node->off, node->len, dst_end);
 			buf_out += node->len;
 		}
 
@@ -161,5 +229,79 @@ uint8_t *lz77_uncompress(uint8_t *src, uint32_t src_len, uint32_t *dst_len)
 		*buf_out++ = node->literal;
 	}
 
+	return buf_out == dst_end ? 0 : -1;
+}
+
+/**
+ * @brief Uncompress a buffer with LZ77 algorithm.
+ * 
+ * @param src 		input buffer
+ * @param src_len 	input buffer length
+ * @param dst_len 	output buffer length
+ *
+ * @return output buffer, NULL on corrupted input
+ */
+uint8_t *lz77_uncompress(uint8_t *src, uint32_t src_len, uint32_t *dst_len)
+{
+	uint8_t *dst;
+
+	/* input too short for uncompressed length */
+	if (src_len < sizeof(uint32_t)) {
+		*dst_len = 0;
+		return NULL;
+	}
+
+	/* read uncompressed length first (it must fit in input) */
+	*dst_len = le32toh(*((uint32_t *) src));
+	if (*dst_len > __lz77_uncompress_bound(src_len)) {
+		*dst_len = 0;
+		return NULL;
+	}
+	
+	/* allocate destination buffer */
+	dst = (uint8_t *) xmalloc(*dst_len);
+
+	/* uncompress nodes */
+	if (lz77_uncompress_into(src, src_len, dst, *dst_len, dst_len) < 0) {
+		xfree(dst);
+		return NULL;
+	}
+
 	return dst;
+}
+
+/**
+ * @brief Uncompress a buffer with LZ77 algorithm into a caller buffer.
+ * 
+ * @param src 		input buffer
+ * @param src_len 	input buffer length
+ * @param dst 		output buffer
+ * @param dst_cap 	output buffer capacity
+ * @param dst_len 	output buffer length (needed length if output buffer is too small, 0 on corrupted input)
+ *
+ * @return 0 on success, -1 if output buffer is too small or on corrupted input
+ */
+int lz77_uncompress_into(uint8_t *src, uint32_t src_len, uint8_t *dst, uint32_t dst_cap, uint32_t *dst_len)
+{
+	/* input too short for uncompressed length */
+	*dst_len = 0;
+	if (src_len < sizeof(uint32_t))
+		return -1;
+
+	/* read uncompressed length first (it must fit in input) */
+	*dst_len = le32toh(*((uint32_t *) src));
+	if (*dst_len > __lz77_uncompress_bound(src_len)) {
+		*dst_len = 0;
+		return -1;
+	}
+	if (*dst_len > dst_cap)
+		return -1;
+
+	/* uncompress nodes */
+	if (__lz77_uncompress(src + sizeof(uint32_t), src_len - sizeof(uint32_t), dst, *dst_len) < 0) {
+		*dst_len = 0;
+		return -1;
+	}
+
+	return 0;
 }
\ No newline at end of file
@@ -19,16 +19,19 @@
  * 
  * @param node 		node
  * @param buf_out 	output buffer
+ * @param buf_end 	output buffer end
  * 
- * @return number of characters written
+ * @return number of characters written, -1 if they do not fit in output buffer
  */
-static int __decode_node(struct trie *node, uint8_t *buf_out)
+static int __decode_node(struct trie *node, uint8_t *buf_out, uint8_t *buf_end)
 {
 	struct trie *tmp;
 	int i, j;
 
 	/* compute dict entry size */
 	for (tmp = node, i = 0; tmp->parent != NULL; tmp = tmp->parent, i++);
+	if (i > buf_end - buf_out)
+		return -1;
 
 	/* write decoded string */
 	for (tmp = node, j = 0; tmp->parent != NULL; tmp = tmp->parent, j++)
@@ -38,18 +41,15 @@ static int __decode_node(struct trie *node, uint8_t *buf_out)
 }
 
 /**
- * @brief Compress a buffer with LZ78 algorithm.
+ * @brief Compress a buffer with LZ78 algorithm to a byte stream.
  * 
  * @param src 		input buffer
  * @param src_len 	input buffer length
- * @param dst_len 	output buffer length
- *
- * @return output buffer
+ * @param bs_out 	output byte stream
  */
-uint8_t *lz78_compress(uint8_t *src, uint32_t src_len, uint32_t *dst_len)
+static void __lz78_compress(uint8_t *src, uint32_t src_len, struct byte_stream *bs_out)
 {
 	struct trie *root = NULL, *node, *next;
-	struct byte_stream bs_out = { 0 };
 	uint8_t *buf_in, c;
 	int id = 0;
 
@@ -57,10 +57,10 @@ uint8_t *lz78_compress(uint8_t *src, uint32_t src_len, uint32_t *dst_len)
 	buf_in = src;
 
 	/* write uncompressed length first */
-	byte_stream_write_u32(&bs_out, htole32(src_len));
+	byte_stream_write_u32(bs_out, htole32(src_len));
 
 	/* write temporary dict size */
-	byte_stream_write_u32(&bs_out, htole32(id));
+	byte_stream_write_u32(bs_out, htole32(id));
 
 	/* create root node */
 	root = node = trie_insert(NULL, 0, id++);
@@ -81,8 +81,8 @@ uint8_t *lz78_compress(uint8_t *src, uint32_t src_len, uint32_t *dst_len)
 		trie_insert(node, c, id++);
 
 		/* write node id and next character */
-		byte_stream_write_u32(&bs_out, htole32(node->id));
-		byte_stream_write_u8(&bs_out, c);
+		byte_stream_write_u32(bs_out, htole32(node->id));
+		byte_stream_write_u8(bs_out, c);
 
 		/* go back to root */
 		node = root;
@@ -90,13 +90,43 @@ uint8_t *lz78_compress(uint8_t *src, uint32_t src_len, uint32_t *dst_len)
 
 	/* write last node id */
 	if (node != root)
-		byte_stream_write_u32(&bs_out, node->id);
+		byte_stream_write_u32(bs_out, node->id);
 		
-	/* write final dict size */
-	*((int *) (bs_out.buf + sizeof(uint32_t))) = htole32(id);
+	/* write final dict size (if it fits in output buffer) */
+	if (bs_out->capacity >= 2 * sizeof(uint32_t))
+		*((int *) (bs_out->buf + sizeof(uint32_t))) = htole32(id);
 
 	/* free dictionnary */
 	trie_free(root);
+}
+
+/**
+ * @brief Compute maximum compressed length (each node holds at least one character).
+ * 
+ * @param len 		input buffer length
+ *
+ * @return maximum output buffer length
+ */
+uint32_t lz78_compress_bound(uint32_t len)
+{
+	return 2 * sizeof(uint32_t) + len * (sizeof(uint32_t) + sizeof(uint8_t));
+}
+
+/**
+ * @brief Compress a buffer with LZ78 algorithm.
+ * 
+ * @param src 		input buffer
+ * @param src_len 	input buffer length
+ * @param dst_len 	output buffer length
+ *
+ * @return output buffer
+ */
+uint8_t *lz78_compress(uint8_t *src, uint32_t src_len, uint32_t *dst_len)
+{
+	struct byte_stream bs_out = { 0 };
+
+	/* compress */
+	__lz78_compress(src, src_len, &bs_out);
 
 	/* set destination length */
 	*dst_len = bs_out.size;
@@ -105,34 +135,69 @@ uint8_t *lz78_compress(uint8_t *src, uint32_t src_len, uint32_t *dst_len)
 }
 
 /**
- * @brief Uncompress a buffer with LZ78 algorithm.
+ * @brief Compress a buffer with LZ78 algorithm into a caller buffer.
  * 
  * @param src 		input buffer
  * @param src_len 	input buffer length
- * @param dst_len 	output buffer length
+ * @param dst 		output buffer
+ * @param dst_cap 	output buffer capacity
+ * @param dst_len 	output buffer length (needed length if output buffer is too small)
  *
- * @return output buffer
+ * @return 0 on success, -1 if output buffer is too small
  */
-uint8_t *lz78_uncompress(uint8_t *src, uint32_t src_len, uint32_t *dst_len)
+int lz78_compress_into(uint8_t *src, uint32_t src_len, uint8_t *dst, uint32_t dst_cap, uint32_t *dst_len)
 {
-	uint8_t *dst, *buf_in, *buf_out, c;
-	int dict_size, id = 0, node_id, i;
-	struct trie **dict, *root, *node;
+	struct byte_stream bs_out = { 0 };
 
-	/* read uncompressed length first */
-	*dst_len = le32toh(*((uint32_t *) src));
-	src += sizeof(uint32_t);
-	src_len -= sizeof(uint32_t);
+	/* set output byte stream */
+	bs_out.buf = dst;
+	bs_out.capacity = dst_cap;
+	bs_out.fixed = 1;
 
-	/* set input buffer */
-	buf_in = src;
+	/* compress */
+	__lz78_compress(src, src_len, &bs_out);
 
-	/* allocate output buffer */
-	dst = buf_out = (uint8_t *) xmalloc(*dst_len);
+	/* set destination length */
+	*dst_len = bs_out.size;
+
+	return *dst_len > dst_cap ? -1 : 0;
+}
+
+/**
+ * @brief Compute maximum uncompressed length of an input (n-th node decodes to n characters at most).
+ * 
+ * @param src_len 	input buffer length (with uncompressed length and dict size)
+ * 
+ * @return maximum uncompressed length
+ */
+static uint64_t __lz78_uncompress_bound(uint32_t src_len)
+{
+	uint64_t nr_nodes = (src_len - 2 * sizeof(uint32_t)) / (sizeof(int) + sizeof(uint8_t)) + 1;
 
-	/* get dict size */
+	return nr_nodes * (nr_nodes + 1) / 2;
+}
+
+/**
+ * @brief Uncompress LZ78 nodes.
+ * 
+ * @param src 		input buffer (after uncompressed length)
+ * @param src_len 	input buffer length
+ * @param dst 		output buffer
+ * @param dst_len 	output buffer length
+ * 
+ * @return 0 on success, -1 on corrupted input
+ */
+static int __lz78_uncompress(uint8_t *src, uint32_t src_len, uint8_t *dst, uint32_t dst_len)
+{
+	uint8_t *buf_in = src, *buf_out = dst, *dst_end = dst + dst_len, c;
+	int dict_size, id = 0, node_id, i, n, ret = -1;
+	struct trie **dict, *root, *node;
+
+	/* get dict size (at most one node per input byte) */
 	dict_size = le32toh(*((int *) buf_in));
 	buf_in += sizeof(int);
+	if (dict_size < 1 || (uint32_t) dict_size > src_len + 1)
+		return -1;
 
 	/* create dict */
 	dict = (struct trie **) xmalloc(sizeof(struct trie *) * dict_size);
@@ -145,14 +210,21 @@ uint8_t *lz78_uncompress(uint8_t *src, uint32_t src_len, uint32_t *dst_len)
 	/* uncompress */
 	while (buf_in < src + src_len) {
 		/* read node id */
+		if (src + src_len - buf_in < (long) sizeof(int))
+			goto out;
 		node_id = le32toh(*((int *) buf_in));
 		buf_in += sizeof(int);
 		
 		/* get node */
+		if (node_id < 0 || node_id >= id || !dict[node_id])
+			goto out;
 		node = dict[node_id];
 
 		/* decode node */
-		buf_out += __decode_node(node, buf_out);
+		n = __decode_node(node, buf_out, dst_end);
+		if (n < 0)
+			goto out;
+		buf_out += n;
 
 		/* no next character : exit */
 		if (buf_in >= src + src_len)
@@ -160,6 +232,8 @@ uint8_t *lz78_uncompress(uint8_t *src, uint32_t src_len, uint32_t *dst_len)
 
 		/* read next character */
 		c = *buf_in++;
+		if (id >= dict_size || buf_out >= dst_end)
+			goto out;
 
 		/* insert new node */
 		trie_insert(node, c, id++);
@@ -170,9 +244,86 @@ uint8_t *lz78_uncompress(uint8_t *src, uint32_t src_len, uint32_t *dst_len)
 		*buf_out++ = c;
 	}
 
+	/* output must be complete */
+	ret = buf_out == dst_end ? 0 : -1;
+out:
 	/* free dictionnary */
 	xfree(dict);
 	trie_free(root);
 
+	return ret;
+}
+
+/**
+ * @brief Uncompress a buffer with LZ78 algorithm.
+ * 
+ * @param src 		input buffer
+ * @param src_len 	input buffer length
+ * @param dst_len 	output buffer length
+ *
+ * @return output buffer, NULL on corrupted input
+ */
+uint8_t *lz78_uncompress(uint8_t *src, uint32_t src_len, uint32_t *dst_len)
+{
+	uint8_t *dst;
+
+	/* input too short for uncompressed length and dict size */
+	if (src_len < 2 * sizeof(uint32_t)) {
+		*dst_len = 0;
+		return NULL;
+	}
+
+	/* read uncompressed length first (it must fit in input) */
+	*dst_len = le32toh(*((uint32_t *) src));
+	if (*dst_len > __lz78_uncompress_bound(src_len)) {
+		*dst_len = 0;
+		return NULL;
+	}
+
+	/* allocate output buffer */
+	dst = (uint8_t *) xmalloc(*dst_len);
+
+	/* uncompress */
+	if (lz78_uncompress_into(src, src_len, dst, *dst_len, dst_len) < 0) {
+		xfree(dst);
+		return NULL;
+	}
+
 	return dst;
 }
+
+/**
+ * @brief Uncompress a buffer with LZ78 algorithm into a caller buffer.
+ * 
+ * @param src 		input buffer
+ * @param src_len 	input buffer length
+ * @param dst 		output buffer
+ * @param dst_cap 	output buffer capacity
+ * @param dst_len 	output buffer length (needed length if output buffer is too small, 0 on corrupted input)
+ *
+ * @return 0 on success, -1 if output buffer is too small or on corrupted input
+ */
+int lz78_uncompress_into(uint8_t *src, uint32_t src_len, uint8_t *dst, uint32_t dst_cap, uint32_t *dst_len)
+{
+	/* input too short for uncompressed length and dict size */
+	*dst_len = 0;
+	if (src_len < 2 * sizeof(uint32_t))
+		return -1;
+
+	/* read uncompressed length first (it must fit in input) */
+	*dst_len = le32toh(*((uint32_t *) src));
+	if (*dst_len > __lz78_uncompress_bound(src_len)) {
+		*dst_len = 0;
+		return -1;
+	}
+	if (*dst_len > dst_cap)
+		return -1;
+
+	/* uncompress */
+	if (__lz78_uncompress(src + sizeof(uint32_t), src_len - sizeof(uint32_t), dst, *dst_len) < 0) {
+		*dst_len = 0;
+		return -1;
+	}
+
+	return 0;
+}
\ No newline at end of file
@@ -7,6 +7,7 @@
 
 #include "lzss.h"
 #include "../utils/bit_stream.h"
+#include "../utils/match_copy.h"
 #include "../utils/mem.h"
 
 #define MATCH_MIN_LEN		3
@@ -53,23 +54,20 @@ static void __lzss_match(uint8_t *window, uint8_t *buf, uint32_t len, struct lzs
 }
 
 /**
- * @brief Compress a buffer with LZSS algorithm.
+ * @brief Compress a buffer with LZSS algorithm to a bit stream.
  * 
  * @param src 		input buffer
  * @param src_len 	input buffer length
- * @param dst_len 	output buffer length
- *
- * @return output buffer
+ * @param bs_out 	output bit stream
  */
-uint8_t *lzss_compress(uint8_t *src, uint32_t src_len, uint32_t *dst_len)
+static void __lzss_compress(uint8_t *src, uint32_t src_len, struct bit_stream *bs_out)
 {
-	struct bit_stream bs_out = { 0 };
 	uint8_t *window, *buf_in;
 	uint32_t window_size, i;
 	struct lzss_match match;
 
 	/* write uncompressed length first */
-	bit_stream_write_bits(&bs_out, htole32(src_len), 32, BIT_ORDER_MSB);
+	bit_stream_write_bits(bs_out, htole32(src_len), 32, BIT_ORDER_MSB);
 
 	/* set input buffer and initial window */
 	buf_in = window = src;
@@ -77,7 +75,7 @@ uint8_t *lzss_compress(uint8_t *src, uint32_t src_len, uint32_t *dst_len)
 	/* copy first window to destination */
 	window_size = src_len < WINDOW_SIZE ? src_len : WINDOW_SIZE;
 	for (i = 0; i < window_size; i++)
-	 	bit_stream_write_bits(&bs_out, *buf_in++, 8, BIT_ORDER_MSB);
+	 	bit_stream_write_bits(bs_out, *buf_in++, 8, BIT_ORDER_MSB);
 
 	/* compress nodes */
 	while (buf_in < src + src_len) {
@@ -86,9 +84,9 @@ uint8_t *lzss_compress(uint8_t *src, uint32_t src_len, uint32_t *dst_len)
 
 		/* write match */
 		if (match.len >= MATCH_MIN_LEN) {
-			bit_stream_write_bits(&bs_out, 1, 1, BIT_ORDER_MSB);
-			bit_stream_write_bits(&bs_out, match.off, 8, BIT_ORDER_MSB);
-			bit_stream_write_bits(&bs_out, match.len, 8, BIT_ORDER_MSB);
+			bit_stream_write_bits(bs_out, 1, 1, BIT_ORDER_MSB);
+			bit_stream_write_bits(bs_out, match.off, 8, BIT_ORDER_MSB);
+			bit_stream_write_bits(bs_out, match.len, 8, BIT_ORDER_MSB);
 
 			/* update window and buffer */
 			window += match.len;
@@ -97,69 +95,227 @@ uint8_t *lzss_compress(uint8_t *src, uint32_t src_len, uint32_t *dst_len)
 		}
 
 		/* else write literal */
-		bit_stream_write_bits(&bs_out, 0, 1, BIT_ORDER_MSB);
-		bit_stream_write_bits(&bs_out, *buf_in, 8, BIT_ORDER_MSB);
+		bit_stream_write_bits(bs_out, 0, 1, BIT_ORDER_MSB);
+		bit_stream_write_bits(bs_out, *buf_in, 8, BIT_ORDER_MSB);
 
 		/* update window and buffer */
 		window++;
 		buf_in++;
 	}
 
+	/* flush last byte */
+	bit_stream_flush(bs_out);
+}
+
+/**
+ * @brief Compute maximum compressed length (first window is copied, then each character is a 9 bits literal at worst).
+ * 
+ * @param len 		input buffer length
+ *
+ * @return maximum output buffer length
+ */
+uint32_t lzss_compress_bound(uint32_t len)
+{
+	uint32_t window_size = len < WINDOW_SIZE ? len : WINDOW_SIZE;
+
+	return sizeof(uint32_t) + len + (len - window_size + 7) / 8;
+}
+
+/**
+ * @brief Compress a buffer with LZSS algorithm.
+ * 
+ * @param src 		input buffer
+ * @param src_len 	input buffer length
+ * @param dst_len 	output buffer length
+ *
+ * @return output buffer
+ */
+uint8_t *lzss_compress(uint8_t *src, uint32_t src_len, uint32_t *dst_len)
+{
+	struct bit_stream bs_out = { 0 };
+
+	/* compress */
+	__lzss_compress(src, src_len, &bs_out);
+
 	/* set destination length */
-	bit_stream_flush(&bs_out);
 	*dst_len = bs_out.byte_offset;
 
 	return bs_out.buf;
 }
 
 /**
- * @brief Uncompress a buffer with LZSS algorithm.
+ * @brief Compress a buffer with LZSS algorithm into a caller buffer.
  * 
  * @param src 		input buffer
  * @param src_len 	input buffer length
- * @param dst_len 	output buffer length
+ * @param dst 		output buffer
+ * @param dst_cap 	output buffer capacity
+ * @param dst_len 	output buffer length (needed length if output buffer is too small)
  *
- * @return output buffer
+ * @return 0 on success, -1 if output buffer is too small
  */
-uint8_t *lzss_uncompress(uint8_t *src, uint32_t src_len, uint32_t *dst_len)
+int lzss_compress_into(uint8_t *src, uint32_t src_len, uint8_t *dst, uint32_t dst_cap, uint32_t *dst_len)
 {
-	struct bit_stream bs_in = { 0 };
-	uint8_t *dst, *buf_out, type;
+	struct bit_stream bs_out = { 0 };
+
+	/* set output bit stream */
+	bs_out.buf = dst;
+	bs_out.capacity = dst_cap;
+	bs_out.fixed = 1;
+
+	/* compress */
+	__lzss_compress(src, src_len, &bs_out);
+
+	/* set destination length */
+	*dst_len = bs_out.byte_offset;
+
+	return *dst_len > dst_cap ? -1 : 0;
+}
+
+/**
+ * @brief Compute maximum uncompressed length of an input (first window is raw, then a match of 255 characters takes 17 bits).
+ * 
+ * @param src_len 	input buffer length (with uncompressed length)
+ * 
+ * @return maximum uncompressed length
+ */
+static uint64_t __lzss_uncompress_bound(uint32_t src_len)
+{
+	return WINDOW_SIZE + (uint64_t) (src_len - sizeof(uint32_t)) * 8 * UINT8_MAX / 17;
+}
+
+/**
+ * @brief Uncompress a LZSS bit stream.
+ * 
+ * @param bs_in 	input bit stream (after uncompressed length)
+ * @param dst 		output buffer
+ * @param dst_len 	output buffer length
+ * 
+ * @return 0 on success, -1 on corrupted input
+ */
+static int __lzss_uncompress(struct bit_stream *bs_in, uint8_t *dst, uint32_t dst_len)
+{
+	uint8_t *buf_out = dst, type;
 	struct lzss_match match;
 	uint32_t window_size, i;
-	
-	/* set input bit stream */
-	bs_in.buf = src;
-	bs_in.capacity = src_len;
-
-	/* read uncompressed length first */
-	*dst_len = le32toh(bit_stream_read_bits(&bs_in, 32, BIT_ORDER_MSB));
-	
-	/* allocate destination buffer */
-	dst = buf_out = (uint8_t *) xmalloc(*dst_len);
 
 	/* copy first window to destination */
-	window_size = src_len < WINDOW_SIZE ? src_len : WINDOW_SIZE;
+	window_size = dst_len < WINDOW_SIZE ? dst_len : WINDOW_SIZE;
 	for (i = 0; i < window_size; i++)
-		*buf_out++ = bit_stream_read_bits(&bs_in, 8, BIT_ORDER_MSB);
+		*buf_out++ = bit_stream_read_bits_msb(bs_in, 8);
 
 	/* uncompress nodes */
-	while (buf_out < dst + *dst_len) {
+	while (buf_out < dst + dst_len) {
+		/* input exhausted */
+		if (bit_stream_read_pos(bs_in) > (uint64_t) bs_in->capacity * 8)
+			return -1;
+
 		/* read type (match or literal) */
-		type = bit_stream_read_bits(&bs_in, 1, BIT_ORDER_MSB);
+		type = bit_stream_read_bits_msb(bs_in, 1);
 
 		/* decode match */
 		if (type) {
-			match.off = bit_stream_read_bits(&bs_in, 8, BIT_ORDER_MSB);
-			match.len = bit_stream_read_bits(&bs_in, 8, BIT_ORDER_MSB);
-			memcpy(buf_out, buf_out - match.off, match.len);
+			match.off = bit_stream_read_bits_msb(bs_in, 8);
+			match.len = bit_stream_read_bits_msb(bs_in, 8);
+
+			/* match must stay in output buffer */
+			if (match.off == 0 || match.off > buf_out - dst || match.len > dst + dst_len - buf_out)
+				return -1;
+
+			match_copy(buf_out, match.off, match.len, dst + dst_len);
 			buf_out += match.len;
 			continue;
 		}
 
 		/* else decode literal */
-		*buf_out++ = bit_stream_read_bits(&bs_in, 8, BIT_ORDER_MSB);
+		*buf_out++ = bit_stream_read_bits_msb(bs_in, 8);
+	}
+
+	/* input must be read up to its end (last byte is padded) */
+	return (bit_stream_read_pos(bs_in) + 7) / 8 != bs_in->capacity ? -1 : 0;
+}
+
+/**
+ * @brief Uncompress a buffer with LZSS algorithm.
+ * 
+ * @param src 		input buffer
+ * @param src_len 	input buffer length
+ * @param dst_len 	output buffer length
+ *
+ * @return output buffer, NULL on corrupted input
+ */
+uint8_t *lzss_uncompress(uint8_t *src, uint32_t src_len, uint32_t *dst_len)
+{
+	struct bit_stream bs_in = { 0 };
+	uint8_t *dst;
+	
+	/* set input bit stream */
+	bs_in.buf = src;
+	bs_in.capacity = src_len;
+
+	/* input too short for uncompressed length */
+	if (src_len < sizeof(uint32_t)) {
+		*dst_len = 0;
+		return NULL;
+	}
+
+	/* read uncompressed length first (it must fit in input) */
+	*dst_len = le32toh(bit_stream_read_bits_msb(&bs_in, 32));
+	if (*dst_len > __lzss_uncompress_bound(src_len)) {
+		*dst_len = 0;
+		return NULL;
+	}
+	
+	/* allocate destination buffer */
+	dst = (uint8_t *) xmalloc(*dst_len);
+
+	/* uncompress */
+	if (lzss_uncompress_into(src, src_len, dst, *dst_len, dst_len) < 0) {
+		xfree(dst);
+		return NULL;
 	}
 
 	return dst;
+}
+
+/**
+ * @brief Uncompress a buffer with LZSS algorithm into a caller buffer.
+ * 
+ * @param src 		input buffer
+ * @param src_len 	input buffer length
+ * @param dst 		output buffer
+ * @param dst_cap 	output buffer capacity
+ * @param dst_len 	output buffer length (needed length if output buffer is too small, 0 on corrupted input)
+ *
+ * @return 0 on success, -1 if output buffer is too small or on corrupted input
+ */
+int lzss_uncompress_into(uint8_t *src, uint32_t src_len, uint8_t *dst, uint32_t dst_cap, uint32_t *dst_len)
+{
+	struct bit_stream bs_in = { 0 };
+
+	/* set input bit stream */
+	bs_in.buf = src;
+	bs_in.capacity = src_len;
+
+	/* input too short for uncompressed length */
+	*dst_len = 0;
+	if (src_len < sizeof(uint32_t))
+		return -1;
+
+	/* read uncompressed length first (it must fit in input) */
+	*dst_len = le32toh(bit_stream_read_bits_msb(&bs_in, 32));
+	if (*dst_len > __lzss_uncompress_bound(src_len)) {
+		*dst_len = 0;
+		return -1;
+	}
+	if (*dst_len > dst_cap)
+		return -1;
+
+	/* uncompress */
+	if (__lzss_uncompress(&bs_in, dst, *dst_len) < 0) {
+		*dst_len = 0;
+		return -1;
+	}
+
+	return 0;
 }
\ No newline at end of file
@@ -9,21 +9,18 @@
 #include "../utils/bit_stream.h"
 
 /**
- * @brief Compress a buffer with Run-Length Encoding algorithm.
+ * @brief Compress a buffer with Run-Length Encoding algorithm to a bit stream.
  * 
  * @param src 		input buffer
  * @param src_len 	input buffer length
- * @param dst_len 	output buffer length
- *
- * @return output buffer
+ * @param bs_out 	output bit stream
  */
-uint8_t *rle_compress(uint8_t *src, uint32_t src_len, uint32_t *dst_len)
+static void __rle_compress(uint8_t *src, uint32_t src_len, struct bit_stream *bs_out)
 {
-	struct bit_stream bs_out = { 0 };
 	uint32_t i, j;
 
 	/* write uncompressed length */
-	bit_stream_write_bits(&bs_out, htole32(src_len), 32, BIT_ORDER_MSB);
+	bit_stream_write_bits(bs_out, htole32(src_len), 32, BIT_ORDER_MSB);
 
 	/* compress */
 	for (i = 0; i < src_len;) {
@@ -31,21 +28,50 @@ uint8_t *rle_compress(uint8_t *src, uint32_t src_len, uint32_t *dst_len)
 		for (j = 0; j < UINT8_MAX && i + j < src_len && src[i] == src[i + j]; j++);
 
 		/* write compressed/uncompressed bit */
-		bit_stream_write_bits(&bs_out, j > 1 ? 1 : 0, 1, BIT_ORDER_MSB);
+		bit_stream_write_bits(bs_out, j > 1 ? 1 : 0, 1, BIT_ORDER_MSB);
 
 		/* write number of occurences */
 		if (j > 1)
-			bit_stream_write_bits(&bs_out, j, 8, BIT_ORDER_MSB);
+			bit_stream_write_bits(bs_out, j, 8, BIT_ORDER_MSB);
 
 		/* write character */
-		bit_stream_write_bits(&bs_out, src[i], 8, BIT_ORDER_MSB);
+		bit_stream_write_bits(bs_out, src[i], 8, BIT_ORDER_MSB);
 
 		/* go to next character */
 		i += j;
 	}
 
 	/* flust last byte */
-	bit_stream_flush(&bs_out);
+	bit_stream_flush(bs_out);
+}
+
+/**
+ * @brief Compute maximum compressed length (every character is written as an uncompressed 9 bits literal at worst).
+ * 
+ * @param len 		input buffer length
+ *
+ * @return maximum output buffer length
+ */
+uint32_t rle_compress_bound(uint32_t len)
+{
+	return sizeof(uint32_t) + len + (len + 7) / 8;
+}
+
+/**
+ * @brief Compress a buffer with Run-Length Encoding algorithm.
+ * 
+ * @param src 		input buffer
+ * @param src_len 	input buffer length
+ * @param dst_len 	output buffer length
+ *
+ * @return output buffer
+ */
+uint8_t *rle_compress(uint8_t *src, uint32_t src_len, uint32_t *dst_len)
+{
+	struct bit_stream bs_out = { 0 };
+
+	/* compress */
+	__rle_compress(src, src_len, &bs_out);
 
 	/* set destination length */
 	*dst_len = bs_out.byte_offset;
@@ -54,44 +80,169 @@ uint8_t *rle_compress(uint8_t *src, uint32_t src_len, uint32_t *dst_len)
 }
 
 /**
- * @brief Uncompress a buffer with Run-Length Encoding algorithm.
+ * @brief Compress a buffer with Run-Length Encoding algorithm into a caller buffer.
  * 
  * @param src 		input buffer
  * @param src_len 	input buffer length
- * @param dst_len 	output buffer length
+ * @param dst 		output buffer
+ * @param dst_cap 	output buffer capacity
+ * @param dst_len 	output buffer length (needed length if output buffer is too small)
  *
- * @return output buffer
+ * @return 0 on success, -1 if output buffer is too small
  */
-uint8_t *rle_uncompress(uint8_t *src, uint32_t src_len, uint32_t *dst_len)
+int rle_compress_into(uint8_t *src, uint32_t src_len, uint8_t *dst, uint32_t dst_cap, uint32_t *dst_len)
 {
-	uint8_t *dst, *buf_out, nr, c;
-	struct bit_stream bs_in = { 0 };
-	uint32_t i;
+	struct bit_stream bs_out = { 0 };
 
-	/* set input bit stream */
-	bs_in.buf = src;
+	/* set output bit stream */
+	bs_out.buf = dst;
+	bs_out.capacity = dst_cap;
+	bs_out.fixed = 1;
 
-	/* read uncompressed length */
-	*dst_len = le32toh(bit_stream_read_bits(&bs_in, 32, BIT_ORDER_MSB));
+	/* compress */
+	__rle_compress(src, src_len, &bs_out);
 
-	/* allocate output buffer */
-	dst = buf_out = (uint8_t *) xmalloc(*dst_len);
+	/* set destination length */
+	*dst_len = bs_out.byte_offset;
+
+	return *dst_len > dst_cap ? -1 : 0;
+}
+
+/**
+ * @brief Compute maximum uncompressed length of an input (a run of 255 characters takes 17 bits).
+ * 
+ * @param src_len 	input buffer length (with uncompressed length)
+ * 
+ * @return maximum uncompressed length
+ */
+static uint64_t __rle_uncompress_bound(uint32_t src_len)
+{
+	return (uint64_t) (src_len - sizeof(uint32_t)) * 8 * UINT8_MAX / 17;
+}
+
+/**
+ * @brief Uncompress a Run-Length Encoding bit stream.
+ * 
+ * @param bs_in 	input bit stream (after uncompressed length)
+ * @param dst 		output buffer
+ * @param dst_len 	output buffer length
+ * 
+ * @return 0 on success, -1 on corrupted input
+ */
+static int __rle_uncompress(struct bit_stream *bs_in, uint8_t *dst, uint32_t dst_len)
+{
+	uint8_t *buf_out = dst, nr, c;
+	uint32_t i;
 
 	/* uncompress */
-	while (buf_out - dst < *dst_len && bs_in.byte_offset < src_len) {
+	while (buf_out - dst < dst_len) {
+		/* input exhausted */
+		if (bit_stream_read_pos(bs_in) > (uint64_t) bs_in->capacity * 8)
+			return -1;
+
 		/* read compressed/uncompressed bit */
-		nr = bit_stream_read_bits(&bs_in, 1, BIT_ORDER_MSB);
+		nr = bit_stream_read_bits_msb(bs_in, 1);
 
 		/* read number of occurences and character */
-		nr = nr ? bit_stream_read_bits(&bs_in, 8, BIT_ORDER_MSB): 1;
+		nr = nr ? bit_stream_read_bits_msb(bs_in, 8) : 1;
 
 		/* read character */
-		c = bit_stream_read_bits(&bs_in, 8, BIT_ORDER_MSB);
+		c = bit_stream_read_bits_msb(bs_in, 8);
+
+		/* run must fit in output buffer */
+		if (nr > dst + dst_len - buf_out)
+			return -1;
 
 		/* write charaters to output */
 		for (i = 0; i < nr; i++)
 			*buf_out++ = c;
 	}
 
+	/* input must be read up to its end (last byte is padded) */
+	return (bit_stream_read_pos(bs_in) + 7) / 8 != bs_in->capacity ? -1 : 0;
+}
+
+/**
+ * @brief Uncompress a buffer with Run-Length Encoding algorithm.
+ * 
+ * @param src 		input buffer
+ * @param src_len 	input buffer length
+ * @param dst_len 	output buffer length
+ *
+ * @return output buffer, NULL on corrupted input
+ */
+uint8_t *rle_uncompress(uint8_t *src, uint32_t src_len, uint32_t *dst_len)
+{
+	struct bit_stream bs_in = { 0 };
+	uint8_t *dst;
+
+	/* set input bit stream */
+	bs_in.buf = src;
+	bs_in.capacity = src_len;
+
+	/* input too short for uncompressed length */
+	if (src_len < sizeof(uint32_t)) {
+		*dst_len = 0;
+		return NULL;
+	}
+
+	/* read uncompressed length (it must fit in input) */
+	*dst_len = le32toh(bit_stream_read_bits_msb(&bs_in, 32));
+	if (*dst_len > __rle_uncompress_bound(src_len)) {
+		*dst_len = 0;
+		return NULL;
+	}
+
+	/* allocate output buffer */
+	dst = (uint8_t *) xmalloc(*dst_len);
+
+	/* uncompress */
+	if (rle_uncompress_into(src, src_len, dst, *dst_len, dst_len) < 0) {
+		xfree(dst);
+		return NULL;
+	}
+
 	return dst;
+}
+
+/**
+ * @brief Uncompress a buffer with Run-Length Encoding algorithm into a caller buffer.
+ * 
+ * @param src 		input buffer
+ * @param src_len 	input buffer length
+ * @param dst 		output buffer
+ * @param dst_cap 	output buffer capacity
+ * @param dst_len 	output buffer length (needed length if output buffer is too small, 0 on corrupted input)
+ *
+ * @return 0 on success, -1 if output buffer is too small or on corrupted input
+ */
+int rle_uncompress_into(uint8_t *src, uint32_t src_len, uint8_t *dst, uint32_t dst_cap, uint32_t *dst_len)
+{
+	struct bit_stream bs_in = { 0 };
+
+	/* input too short for uncompressed length */
+	*dst_len = 0;
+	if (src_len < sizeof(uint32_t))
+		return -1;
+
+	/* set input bit stream */
+	bs_in.buf = src;
+	bs_in.capacity = src_len;
+
+	/* read uncompressed length (it must fit in input) */
+	*dst_len = le32toh(bit_stream_read_bits_msb(&bs_in, 32));
+	if (*dst_len > __rle_uncompress_bound(src_len)) {
+		*dst_len = 0;
+		return -1;
+	}
+	if (*dst_len > dst_cap)
+		return -1;
+
+	/* uncompress */
+	if (__rle_uncompress(&bs_in, dst, *dst_len) < 0) {
+		*dst_len = 0;
+		return -1;
+	}
+
+	return 0;
 }
\ No newline at end of file
@@ -6,7 +6,9 @@
 #include "lzss/lzss.h"
 #include "lz78/lz78.h"
 #include "huffman/huffman.h"
+#include "huffman/huffman_tree.h"
 #include "deflate/deflate.h"
+#include "utils/byte_stream.h"
 #include "utils/mem.h"
 
 #define DEFAULT_INPUT_FILE	"./data/miserables.txt"
@@ -18,6 +20,49 @@
 #define COMPRESSION_HUFFMAN	5
 #define COMPRESSION_DEFLATE	6
 
+#define NR_TEST_INPUTS		4
+#define TEST_INPUT_LEN		(300 * 1024)
+#define TEST_FLUSH_INTERVAL	10000
+
+/**
+ * @brief Behavioural test input.
+ */
+struct test_input {
+	const char *	name;		/* input name */
+	uint8_t *	buf;		/* input buffer */
+	uint32_t	len;		/* input buffer length */
+};
+
+/* behavioural tests inputs (empty, 1 byte, incompressible and highly repetitive) */
+static struct test_input test_inputs[NR_TEST_INPUTS];
+
+/**
+ * @brief Codec functions.
+ */
+struct test_codec {
+	const char *	name;									/* codec name */
+	uint8_t *	(*compress)(uint8_t *, uint32_t, uint32_t *);				/* compress */
+	uint32_t	(*compress_bound)(uint32_t);						/* maximum compressed length */
+	int		(*compress_into)(uint8_t *, uint32_t, uint8_t *, uint32_t, uint32_t *);	/* compress into a caller buffer */
+	uint8_t *	(*uncompress)(uint8_t *, uint32_t, uint32_t *);				/* uncompress */
+	int		(*uncompress_into)(uint8_t *, uint32_t, uint8_t *, uint32_t, uint32_t *);	/* uncompress into a caller buffer */
+};
+
+/* codecs */
+static const struct test_codec test_codecs[] = {
+	{ "RLE", rle_compress, rle_compress_bound, rle_compress_into, rle_uncompress, rle_uncompress_into },
+	{ "LZ77", lz77_compress, lz77_compress_bound, lz77_compress_into, lz77_uncompress, lz77_uncompress_into },
+	{ "LZSS", lzss_compress, lzss_compress_bound, lzss_compress_into, lzss_uncompress, lzss_uncompress_into },
+	{ "LZ78", lz78_compress, lz78_compress_bound, lz78_compress_into, lz78_uncompress, lz78_uncompress_into },
+	{ "HUFFMAN", huffman_compress, huffman_compress_bound, huffman_compress_into, huffman_uncompress, huffman_uncompress_into },
+	{ "DEFLATE", deflate_compress, deflate_compress_bound, deflate_compress_into, deflate_uncompress, deflate_uncompress_into },
+};
+
+#define NR_TEST_CODECS		((int) (sizeof(test_codecs) / sizeof(test_codecs[0])))
+
+/* deflate stream "a" + match (length 3, distance 1) with a fix huffman block, then CRC and length */
+static uint8_t deflate_match_stream[] = { 0x4B, 0x04, 0x02, 0x00, 0x45, 0xE5, 0x98, 0xAD, 0x04, 0x00, 0x00, 0x00 };
+
 /**
  * @brief Read input file.
  * 
@@ -155,9 +200,680 @@ static void compression_test(uint8_t *src, uint32_t src_len, int compression_alg
 	xfree(unzip);
 }
 
+/**
+ * @brief Check a behavioural test condition (failures are printed).
+ * 
+ * @param cond 		condition
+ * @param test_name 	test name
+ * @param case_name 	test case name
+ * 
+ * @return 0 if condition holds, 1 otherwise
+ */
+static int check(int cond, const char *test_name, const char *case_name)
+{
+	if (!cond)
+		fprintf(stderr, "%s failed on %s\n", test_name, case_name);
+
+	return !cond;
+}
+
+/**
+ * @brief Check length limited huffman codes lengths : every used character has a code no longer than max bits,
+ * the code is complete (Kraft sum = 1) and it costs as much as an unlimited code when the limit is not reached.
+ * 
+ * @param freqs 		characters frequencies
+ * @param nr_characters 	number of characters
+ * @param max_bits 		maximum code length
+ * @param case_name 		test case name
+ * 
+ * @return number of errors
+ */
+static int check_limited_lengths(uint32_t *freqs, uint32_t nr_characters, uint32_t max_bits, const char *case_name)
+{
+	uint32_t codes_len[HUFFMAN_MAX_CHARACTERS], unlimited_len[HUFFMAN_MAX_CHARACTERS], i, nr_used = 0, max_len = 0;
+	uint64_t kraft = 0, cost = 0, unlimited_cost = 0;
+	int nr_errors = 0;
+
+	/* build limited and unlimited codes lengths */
+	huffman_tree_build_limited_lengths(freqs, nr_characters, max_bits, codes_len);
+	huffman_tree_build_lengths(freqs, nr_characters, unlimited_len);
+
+	for (i = 0; i < nr_characters; i++) {
+		/* unused characters have no code, used ones have a code of at most max bits */
+		nr_errors += check(freqs[i] ? codes_len[i] >= 1 && codes_len[i] <= max_bits : codes_len[i] == 0,
+				   "Huffman codes lengths", case_name);
+		if (!freqs[i])
+			continue;
+
+		/* compute Kraft sum (scaled by 2^max_bits) and costs */
+		nr_used++;
+		if (codes_len[i] >= 1 && codes_len[i] <= max_bits)
+			kraft += (uint64_t) 1 << (max_bits - codes_len[i]);
+		cost += (uint64_t) freqs[i] * codes_len[i];
+		unlimited_cost += (uint64_t) freqs[i] * unlimited_len[i];
+		max_len = unlimited_len[i] > max_len ? unlimited_len[i] : max_len;
+	}
+
+	/* a code of 2 characters or more must be complete, a single character takes half of the code space */
+	nr_errors += check(nr_used >= 2 ? kraft == (uint64_t) 1 << max_bits : kraft <= (uint64_t) 1 << max_bits,
+			   "Huffman Kraft sum", case_name);
+
+	/* limited code can't beat an optimal code, and must match it when the limit is not reached */
+	nr_errors += check(max_len > max_bits ? cost >= unlimited_cost : cost == unlimited_cost, "Huffman codes cost", case_name);
+
+	return nr_errors;
+}
+
+/**
+ * @brief Length limited huffman codes test (package-merge).
+ * 
+ * @return number of errors
+ */
+static int huffman_limited_lengths_test(void)
+{
+	uint32_t freqs[HUFFMAN_MAX_CHARACTERS], i, seed = 88675123U;
+	int nr_errors = 0;
+
+	/* fibonacci frequencies : unlimited code is 31 bits deep */
+	for (i = 0; i < 32; i++)
+		freqs[i] = i < 2 ? 1 : freqs[i - 1] + freqs[i - 2];
+	nr_errors += check_limited_lengths(freqs, 32, 15, "fibonacci frequencies (15 bits)");
+	nr_errors += check_limited_lengths(freqs, 32, 7, "fibonacci frequencies (7 bits)");
+	nr_errors += check_limited_lengths(freqs, 32, 5, "fibonacci frequencies (5 bits)");
+	nr_errors += check_limited_lengths(freqs, 32, 31, "fibonacci frequencies (31 bits)");
+
+	/* uniform frequencies : 288 characters need 9 bits */
+	for (i = 0; i < HUFFMAN_MAX_CHARACTERS; i++)
+		freqs[i] = 1;
+	nr_errors += check_limited_lengths(freqs, HUFFMAN_MAX_CHARACTERS, 9, "uniform frequencies");
+
+	/* skewed frequencies with unused characters */
+	for (i = 0; i < HUFFMAN_MAX_CHARACTERS; i++) {
+		seed ^= seed << 13;
+		seed ^= seed >> 17;
+		seed ^= seed << 5;
+		freqs[i] = i % 3 == 0 ? 0 : (seed & 0xFFFF) >> (seed % 16);
+	}
+	nr_errors += check_limited_lengths(freqs, HUFFMAN_MAX_CHARACTERS, 15, "skewed frequencies (15 bits)");
+	nr_errors += check_limited_lengths(freqs, HUFFMAN_MAX_CHARACTERS, 8, "skewed frequencies (8 bits)");
+
+	/* single and no character */
+	memset(freqs, 0, sizeof(freqs));
+	freqs[42] = 10;
+	nr_errors += check_limited_lengths(freqs, HUFFMAN_MAX_CHARACTERS, 7, "single character");
+	freqs[42] = 0;
+	nr_errors += check_limited_lengths(freqs, HUFFMAN_MAX_CHARACTERS, 7, "no character");
+
+	return nr_errors;
+}
+
+/**
+ * @brief Create behavioural tests inputs.
+ */
+static void test_inputs_create(void)
+{
+	uint32_t i, seed = 2463534242U;
+
+	/* empty and 1 byte inputs */
+	test_inputs[0].name = "empty input";
+	test_inputs[0].buf = (uint8_t *) xmalloc(1);
+	test_inputs[0].len = 0;
+	test_inputs[1].name = "1 byte input";
+	test_inputs[1].buf = (uint8_t *) xmalloc(1);
+	test_inputs[1].buf[0] = 'x';
+	test_inputs[1].len = 1;
+
+	/* incompressible input (xorshift generator) */
+	test_inputs[2].name = "incompressible input";
+	test_inputs[2].buf = (uint8_t *) xmalloc(TEST_INPUT_LEN);
+	test_inputs[2].len = TEST_INPUT_LEN;
+	for (i = 0; i < TEST_INPUT_LEN; i++) {
+		seed ^= seed << 13;
+		seed ^= seed >> 17;
+		seed ^= seed << 5;
+		test_inputs[2].buf[i] = seed >> 24;
+	}
+
+	/* highly repetitive input */
+	test_inputs[3].name = "repetitive input";
+	test_inputs[3].buf = (uint8_t *) xmalloc(TEST_INPUT_LEN);
+	test_inputs[3].len = TEST_INPUT_LEN;
+	for (i = 0; i < TEST_INPUT_LEN; i++)
+		test_inputs[3].buf[i] = "abcabcabdx"[i % 10] + (i % 997 == 0);
+}
+
+/**
+ * @brief Free behavioural tests inputs.
+ */
+static void test_inputs_free(void)
+{
+	int i;
+
+	for (i = 0; i < NR_TEST_INPUTS; i++)
+		xfree(test_inputs[i].buf);
+}
+
+/**
+ * @brief Check a deflate round trip (compressed buffer is freed).
+ * 
+ * @param input 	test input
+ * @param zip 		compressed buffer
+ * @param zip_len 	compressed buffer length
+ * @param test_name 	test name
+ * 
+ * @return number of errors
+ */
+static int check_deflate_round_trip(struct test_input *input, uint8_t *zip, uint32_t zip_len, const char *test_name)
+{
+	uint32_t unzip_len;
+	uint8_t *unzip;
+	int nr_errors;
+
+	/* compressed length must be bounded */
+	nr_errors = check(zip_len <= deflate_compress_bound(input->len), test_name, input->name);
+
+	/* uncompress and compare */
+	unzip = deflate_uncompress(zip, zip_len, &unzip_len);
+	nr_errors += check(unzip && unzip_len == input->len && memcmp(unzip, input->buf, unzip_len) == 0, test_name, input->name);
+
+	/* free memory */
+	xfree(zip);
+	xfree(unzip);
+
+	return nr_errors;
+}
+
+/**
+ * @brief Deflate compression levels test.
+ * 
+ * @return number of errors
+ */
+static int deflate_levels_test(void)
+{
+	uint32_t zip_len;
+	char test_name[64];
+	int nr_errors = 0, level, i;
+	uint8_t *zip;
+
+	for (level = DEFLATE_LEVEL_MIN; level <= DEFLATE_LEVEL_MAX; level++) {
+		snprintf(test_name, sizeof(test_name), "Deflate level %d", level);
+
+		for (i = 0; i < NR_TEST_INPUTS; i++) {
+			zip = deflate_compress_level(test_inputs[i].buf, test_inputs[i].len, &zip_len, level);
+			nr_errors += check_deflate_round_trip(&test_inputs[i], zip, zip_len, test_name);
+		}
+	}
+
+	return nr_errors;
+}
+
+/**
+ * @brief Parallel deflate test (1 thread, several threads and one thread per processor).
+ * 
+ * @return number of errors
+ */
+static int deflate_parallel_test(void)
+{
+	int nr_threads[] = { 1, 4, 0 }, levels[] = { DEFLATE_LEVEL_MIN, DEFLATE_LEVEL_DEFAULT, DEFLATE_LEVEL_MAX };
+	int nr_errors = 0, i, j, k;
+	char test_name[64];
+	uint32_t zip_len;
+	uint8_t *zip;
+
+	for (i = 0; i < (int) (sizeof(nr_threads) / sizeof(nr_threads[0])); i++) {
+		for (j = 0; j < (int) (sizeof(levels) / sizeof(levels[0])); j++) {
+			snprintf(test_name, sizeof(test_name), "Parallel deflate (%d threads, level %d)", nr_threads[i], levels[j]);
+
+			for (k = 0; k < NR_TEST_INPUTS; k++) {
+				zip = deflate_compress_parallel(test_inputs[k].buf, test_inputs[k].len, &zip_len, levels[j], nr_threads[i]);
+				nr_errors += check_deflate_round_trip(&test_inputs[k], zip, zip_len, test_name);
+			}
+		}
+	}
+
+	return nr_errors;
+}
+
+/**
+ * @brief Streaming output sink : append bytes to a byte stream.
+ * 
+ * @param arg 		byte stream
+ * @param buf 		bytes
+ * @param len 		number of bytes
+ * 
+ * @return 0
+ */
+static int byte_stream_sink(void *arg, uint8_t *buf, uint32_t len)
+{
+	byte_stream_write((struct byte_stream *) arg, buf, len);
+	return 0;
+}
+
+/**
+ * @brief Check that a flushed deflate stream holds the whole input compressed so far.
+ * 
+ * @param zip 		compressed output so far
+ * @param input 	test input
+ * @param len 		input length compressed so far
+ * @param test_name 	test name
+ * 
+ * @return number of errors
+ */
+static int check_flushed_stream(struct byte_stream *zip, struct test_input *input, uint32_t len, const char *test_name)
+{
+	struct deflate_uncompress_stream stream;
+	struct byte_stream unzip = { 0 };
+	int ret;
+
+	/* uncompress output so far (end of stream is not reached yet) */
+	deflate_uncompress_stream_init(&stream, byte_stream_sink, &unzip);
+	ret = deflate_uncompress_stream_update(&stream, zip->buf, zip->size);
+
+	/* every input byte must be available */
+	ret = check(ret == 0 && unzip.size == len && memcmp(unzip.buf, input->buf, len) == 0, test_name, input->name);
+
+	/* free memory */
+	deflate_uncompress_stream_free(&stream);
+	xfree(unzip.buf);
+
+	return ret;
+}
+
+/**
+ * @brief Streaming deflate compressor test (1 byte input chunks, sync and full flushes).
+ * 
+ * @return number of errors
+ */
+static int deflate_stream_test(void)
+{
+	int modes[] = { DEFLATE_SYNC_FLUSH, DEFLATE_FULL_FLUSH }, levels[] = { DEFLATE_LEVEL_MIN, DEFLATE_LEVEL_DEFAULT, DEFLATE_LEVEL_MAX };
+	int nr_errors = 0, ret, i, j, k;
+	struct deflate_stream stream;
+	struct byte_stream zip;
+	char test_name[64];
+	uint32_t n;
+
+	for (i = 0; i < (int) (sizeof(modes) / sizeof(modes[0])); i++) {
+		for (j = 0; j < (int) (sizeof(levels) / sizeof(levels[0])); j++) {
+			snprintf(test_name, sizeof(test_name), "Deflate stream (%s flush, level %d)",
+				 modes[i] == DEFLATE_SYNC_FLUSH ? "sync" : "full", levels[j]);
+
+			for (k = 0; k < NR_TEST_INPUTS; k++) {
+				memset(&zip, 0, sizeof(zip));
+				deflate_stream_init(&stream, levels[j], byte_stream_sink, &zip);
+
+				/* feed input byte by byte, flush regularly */
+				for (n = 0, ret = 0; n < test_inputs[k].len && ret == 0; n++) {
+					ret = deflate_stream_update(&stream, test_inputs[k].buf + n, 1);
+					if (ret == 0 && (n + 1) % TEST_FLUSH_INTERVAL == 0) {
+						ret = deflate_stream_flush(&stream, modes[i]);
+						nr_errors += check_flushed_stream(&zip, &test_inputs[k], n + 1, test_name);
+					}
+				}
+
+				/* finish stream */
+				if (ret == 0)
+					ret = deflate_stream_finish(&stream);
+				nr_errors += check(ret == 0, test_name, test_inputs[k].name);
+
+				/* check round trip */
+				nr_errors += check_deflate_round_trip(&test_inputs[k], zip.buf, zip.size, test_name);
+				deflate_stream_free(&stream);
+			}
+		}
+	}
+
+	return nr_errors;
+}
+
+/**
+ * @brief Feed a compressed buffer byte by byte to a streaming decompressor.
+ * 
+ * @param zip 		compressed buffer
+ * @param zip_len 	compressed buffer length
+ * @param unzip 	uncompressed output
+ * 
+ * @return 0 if every chunk but the last one needs more input and stream ends on the last one, -1 otherwise
+ */
+static int uncompress_stream_bytes(uint8_t *zip, uint32_t zip_len, struct byte_stream *unzip)
+{
+	struct deflate_uncompress_stream stream;
+	uint32_t i;
+	int ret = 0;
+
+	/* feed input byte by byte */
+	deflate_uncompress_stream_init(&stream, byte_stream_sink, unzip);
+	for (i = 0; i < zip_len && ret == 0; i++)
+		ret = deflate_uncompress_stream_update(&stream, zip + i, 1);
+
+	/* end of stream must be reached on last byte */
+	ret = ret == 1 && i == zip_len ? 0 : -1;
+
+	/* finish stream */
+	if (deflate_uncompress_stream_finish(&stream) < 0)
+		ret = -1;
+	deflate_uncompress_stream_free(&stream);
+
+	return ret;
+}
+
+/**
+ * @brief Streaming deflate decompressor test (1 byte input chunks, complete and truncated streams).
+ * 
+ * @return number of errors
+ */
+static int deflate_uncompress_stream_test(void)
+{
+	int levels[] = { DEFLATE_LEVEL_MIN, DEFLATE_LEVEL_DEFAULT, DEFLATE_LEVEL_MAX }, nr_errors = 0, i, j;
+	struct byte_stream unzip;
+	char test_name[64];
+	uint32_t zip_len;
+	uint8_t *zip;
+
+	for (i = 0; i < (int) (sizeof(levels) / sizeof(levels[0])); i++) {
+		snprintf(test_name, sizeof(test_name), "Deflate uncompress stream (level %d)", levels[i]);
+
+		for (j = 0; j < NR_TEST_INPUTS; j++) {
+			zip = deflate_compress_level(test_inputs[j].buf, test_inputs[j].len, &zip_len, levels[i]);
+
+			/* complete stream */
+			memset(&unzip, 0, sizeof(unzip));
+			nr_errors += check(uncompress_stream_bytes(zip, zip_len, &unzip) == 0 && unzip.size == test_inputs[j].len
+					   && (!unzip.size || memcmp(unzip.buf, test_inputs[j].buf, unzip.size) == 0), test_name, test_inputs[j].name);
+			xfree(unzip.buf);
+
+			/* truncated streams (last byte or trailer missing) */
+			memset(&unzip, 0, sizeof(unzip));
+			nr_errors += check(uncompress_stream_bytes(zip, zip_len - 1, &unzip) < 0, test_name, test_inputs[j].name);
+			xfree(unzip.buf);
+			memset(&unzip, 0, sizeof(unzip));
+			nr_errors += check(uncompress_stream_bytes(zip, zip_len - 2 * sizeof(uint32_t), &unzip) < 0, test_name, test_inputs[j].name);
+			xfree(unzip.buf);
+
+			xfree(zip);
+		}
+	}
+
+	return nr_errors;
+}
+
+/**
+ * @brief Check a compression into a caller buffer, with an exact size buffer and with one byte too few.
+ * 
+ * @param compress_into 	compress into a caller buffer function (NULL for deflate level or context variants)
+ * @param level 		compression level (deflate_compress_level_into)
+ * @param context 		compression context (deflate_compress_with_context_into)
+ * @param input 		test input
+ * @param zip 			expected compressed buffer
+ * @param zip_len 		expected compressed buffer length (at least 1)
+ * @param test_name 		test name
+ * 
+ * @return number of errors
+ */
+static int check_compress_into(int (*compress_into)(uint8_t *, uint32_t, uint8_t *, uint32_t, uint32_t *), int level,
+			       struct deflate_compress_context *context, struct test_input *input, uint8_t *zip, uint32_t zip_len,
+			       const char *test_name)
+{
+	uint32_t dst_len, cap;
+	int nr_errors = 0, ret, i;
+	uint8_t *dst;
+
+	for (i = 0; i < 2; i++) {
+		/* compress into a buffer of exactly cap bytes */
+		cap = zip_len - i;
+		dst = (uint8_t *) xmalloc(cap ? cap : 1);
+		if (compress_into)
+			ret = compress_into(input->buf, input->len, dst, cap, &dst_len);
+		else if (context)
+			ret = deflate_compress_with_context_into(context, input->buf, input->len, dst, cap, &dst_len);
+		else
+			ret = deflate_compress_level_into(input->buf, input->len, dst, cap, &dst_len, level);
+
+		/* exact size buffer must succeed, a smaller one must fail and give needed length */
+		nr_errors += check(dst_len == zip_len && (cap == zip_len ? ret == 0 && memcmp(dst, zip, zip_len) == 0 : ret < 0),
+				   test_name, input->name);
+		xfree(dst);
+	}
+
+	return nr_errors;
+}
+
+/**
+ * @brief Check an uncompression into a caller buffer, with an exact size buffer and with one byte too few.
+ * 
+ * @param uncompress_into 	uncompress into a caller buffer function
+ * @param input 		test input
+ * @param zip 			compressed buffer
+ * @param zip_len 		compressed buffer length
+ * @param test_name 		test name
+ * 
+ * @return number of errors
+ */
+static int check_uncompress_into(int (*uncompress_into)(uint8_t *, uint32_t, uint8_t *, uint32_t, uint32_t *), struct test_input *input,
+				 uint8_t *zip, uint32_t zip_len, const char *test_name)
+{
+	uint32_t dst_len;
+	int nr_errors, ret;
+	uint8_t *dst;
+
+	/* exact size buffer */
+	dst = (uint8_t *) xmalloc(input->len ? input->len : 1);
+	ret = uncompress_into(zip, zip_len, dst, input->len, &dst_len);
+	nr_errors = check(ret == 0 && dst_len == input->len && memcmp(dst, input->buf, input->len) == 0, test_name, input->name);
+	xfree(dst);
+
+	/* one byte too few : must fail and give needed length */
+	if (input->len) {
+		dst = (uint8_t *) xmalloc(input->len - 1 ? input->len - 1 : 1);
+		ret = uncompress_into(zip, zip_len, dst, input->len - 1, &dst_len);
+		nr_errors += check(ret < 0 && dst_len == input->len, test_name, input->name);
+		xfree(dst);
+	}
+
+	return nr_errors;
+}
+
+/**
+ * @brief Caller buffers test : every codec compresses and uncompresses into exact size buffers and rejects smaller ones.
+ * 
+ * @return number of errors
+ */
+static int into_test(void)
+{
+	int levels[] = { DEFLATE_LEVEL_MIN, DEFLATE_LEVEL_DEFAULT, DEFLATE_LEVEL_MAX }, nr_errors = 0, i, j;
+	struct deflate_uncompress_context uncompress_context;
+	struct deflate_compress_context compress_context;
+	uint32_t zip_len, unzip_len;
+	uint8_t *zip, *unzip;
+	char test_name[64];
+
+	/* every codec */
+	for (i = 0; i < NR_TEST_CODECS; i++) {
+		snprintf(test_name, sizeof(test_name), "%s into", test_codecs[i].name);
+
+		for (j = 0; j < NR_TEST_INPUTS; j++) {
+			zip = test_codecs[i].compress(test_inputs[j].buf, test_inputs[j].len, &zip_len);
+			nr_errors += check(zip_len <= test_codecs[i].compress_bound(test_inputs[j].len), test_name, test_inputs[j].name);
+			nr_errors += check_compress_into(test_codecs[i].compress_into, 0, NULL, &test_inputs[j], zip, zip_len, test_name);
+			nr_errors += check_uncompress_into(test_codecs[i].uncompress_into, &test_inputs[j], zip, zip_len, test_name);
+			xfree(zip);
+		}
+	}
+
+	/* deflate levels (greedy, lazy and optimal parsing) */
+	for (i = 0; i < (int) (sizeof(levels) / sizeof(levels[0])); i++) {
+		snprintf(test_name, sizeof(test_name), "Deflate level %d into", levels[i]);
+
+		for (j = 0; j < NR_TEST_INPUTS; j++) {
+			zip = deflate_compress_level(test_inputs[j].buf, test_inputs[j].len, &zip_len, levels[i]);
+			nr_errors += check_compress_into(NULL, levels[i], NULL, &test_inputs[j], zip, zip_len, test_name);
+			xfree(zip);
+		}
+	}
+
+	/* deflate contexts (reused for every input) */
+	deflate_compress_context_init(&compress_context, DEFLATE_LEVEL_DEFAULT);
+	deflate_uncompress_context_init(&uncompress_context);
+	for (j = 0; j < NR_TEST_INPUTS; j++) {
+		zip = deflate_compress(test_inputs[j].buf, test_inputs[j].len, &zip_len);
+		nr_errors += check_compress_into(NULL, 0, &compress_context, &test_inputs[j], zip, zip_len, "Deflate context into");
+		unzip = deflate_uncompress_with_context(&uncompress_context, zip, zip_len, &unzip_len);
+		nr_errors += check(unzip && unzip_len == test_inputs[j].len && memcmp(unzip, test_inputs[j].buf, unzip_len) == 0,
+				   "Deflate uncompress context", test_inputs[j].name);
+		xfree(zip);
+	}
+	deflate_compress_context_free(&compress_context);
+	deflate_uncompress_context_free(&uncompress_context);
+
+	return nr_errors;
+}
+
+/**
+ * @brief Check that a codec rejects a corrupted input.
+ * 
+ * @param codec 	codec
+ * @param zip 		corrupted input
+ * @param zip_len 	corrupted input length
+ * @param len 		original uncompressed length
+ * @param test_name 	test name
+ * @param case_name 	test case name
+ * 
+ * @return number of errors
+ */
+static int check_corrupted(const struct test_codec *codec, uint8_t *zip, uint32_t zip_len, uint32_t len, const char *test_name,
+			   const char *case_name)
+{
+	uint32_t unzip_len;
+	uint8_t *unzip;
+	int nr_errors;
+
+	/* uncompress into a new buffer */
+	unzip = codec->uncompress(zip, zip_len, &unzip_len);
+	nr_errors = check(unzip == NULL, test_name, case_name);
+	xfree(unzip);
+
+	/* uncompress into a caller buffer */
+	unzip = (uint8_t *) xmalloc(len ? len : 1);
+	nr_errors += check(codec->uncompress_into(zip, zip_len, unzip, len, &unzip_len) < 0, test_name, case_name);
+	xfree(unzip);
+
+	return nr_errors;
+}
+
+/**
+ * @brief Corrupt the first match distance of a compressed buffer (repetitive input : first match follows first window).
+ * 
+ * @param codec 	codec
+ * @param zip 		compressed buffer
+ * @param zip_len 	compressed buffer length
+ * 
+ * @return 0 on success, -1 if codec has no distance
+ */
+static int corrupt_distance(const struct test_codec *codec, uint8_t *zip, uint32_t zip_len)
+{
+	/* LZ77 : uncompressed length, first window, then (offset, length, literal) nodes */
+	if (codec->compress == lz77_compress && zip_len > 262 && zip[260] > 0) {
+		zip[259] = 0;
+		return 0;
+	}
+
+	/* LZSS : uncompressed length, first window, then match flag and offset (bits are packed from least significant) */
+	if (codec->compress == lzss_compress && zip_len > 260 && (zip[259] & 0x01)) {
+		zip[259] &= 0x01;
+		zip[260] &= 0xFE;
+		return 0;
+	}
+
+	/* LZ78 : uncompressed length, dictionary size, then (node id, character) nodes */
+	if (codec->compress == lz78_compress && zip_len > 12) {
+		zip[8] = zip[9] = zip[10] = 0xFF;
+		zip[11] = 0x7F;
+		return 0;
+	}
+
+	return -1;
+}
+
+/**
+ * @brief Corrupted inputs test : truncated inputs, corrupted distances and oversized length headers are rejected.
+ * 
+ * @return number of errors
+ */
+static int corrupted_test(void)
+{
+	uint32_t zip_len, len_off, unzip_len;
+	uint8_t *zip, *corrupted;
+	char test_name[64];
+	int nr_errors = 0, i, j;
+
+	for (i = 0; i < NR_TEST_CODECS; i++) {
+		for (j = 2; j < NR_TEST_INPUTS; j++) {
+			zip = test_codecs[i].compress(test_inputs[j].buf, test_inputs[j].len, &zip_len);
+			corrupted = (uint8_t *) xmalloc(zip_len);
+
+			/* truncated input */
+			snprintf(test_name, sizeof(test_name), "%s truncated input", test_codecs[i].name);
+			nr_errors += check_corrupted(&test_codecs[i], zip, zip_len - 1, test_inputs[j].len, test_name, test_inputs[j].name);
+			nr_errors += check_corrupted(&test_codecs[i], zip, zip_len / 2, test_inputs[j].len, test_name, test_inputs[j].name);
+
+			/* oversized length header (deflate length is in trailer) */
+			snprintf(test_name, sizeof(test_name), "%s oversized length", test_codecs[i].name);
+			len_off = test_codecs[i].compress == deflate_compress ? zip_len - sizeof(uint32_t) : 0;
+			memcpy(corrupted, zip, zip_len);
+			memset(corrupted + len_off, 0xFF, sizeof(uint32_t));
+			nr_errors += check_corrupted(&test_codecs[i], corrupted, zip_len, test_inputs[j].len, test_name, test_inputs[j].name);
+
+			/* corrupted distance (repetitive input only) */
+			snprintf(test_name, sizeof(test_name), "%s corrupted distance", test_codecs[i].name);
+			memcpy(corrupted, zip, zip_len);
+			if (j == 3 && corrupt_distance(&test_codecs[i], corrupted, zip_len) == 0)
+				nr_errors += check_corrupted(&test_codecs[i], corrupted, zip_len, test_inputs[j].len, test_name,
+							     test_inputs[j].name);
+
+			/* free memory */
+			xfree(corrupted);
+			xfree(zip);
+		}
+	}
+
+	/* deflate distance before output start */
+	zip = deflate_uncompress(deflate_match_stream, sizeof(deflate_match_stream), &unzip_len);
+	nr_errors += check(zip && unzip_len == 4 && memcmp(zip, "aaaa", 4) == 0, "DEFLATE distance", "valid distance");
+	xfree(zip);
+	deflate_match_stream[2] |= 0x40;
+	nr_errors += check_corrupted(&test_codecs[NR_TEST_CODECS - 1], deflate_match_stream, sizeof(deflate_match_stream), 4,
+				     "DEFLATE corrupted distance", "distance before output start");
+	deflate_match_stream[2] &= ~0x40;
+
+	return nr_errors;
+}
+
+/**
+ * @brief Run a behavioural test and print its status.
+ * 
+ * @param test 		test function (returns number of errors)
+ * @param test_name 	test name
+ * 
+ * @return number of errors
+ */
+static int behavioural_test(int (*test)(void), const char *test_name)
+{
+	int nr_errors;
+
+	/* print start message */
+	printf("********************** %s **********************\n", test_name);
+
+	/* run test */
+	nr_errors = test();
+	printf("Test status : %s\n", nr_errors ? "ERROR" : "OK");
+
+	return nr_errors;
+}
+
 int main(int argc, char **argv)
 {
 	const char *input_file;
+	int nr_errors = 0;
 	uint32_t src_len;
 	uint8_t *src;
 
@@ -182,6 +898,18 @@ int main(int argc, char **argv)
 	compression_test(src, src_len, COMPRESSION_LZ78, "LZ78");
 	compression_test(src, src_len, COMPRESSION_HUFFMAN, "HUFFMAN");
 	compression_test(src, src_len, COMPRESSION_DEFLATE, "DEFLATE");
+	xfree(src);
 
-	return 0;
+	/* behavioural tests */
+	test_inputs_create();
+	nr_errors += behavioural_test(huffman_limited_lengths_test, "HUFFMAN LIMITED LENGTHS");
+	nr_errors += behavioural_test(deflate_levels_test, "DEFLATE LEVELS");
+	nr_errors += behavioural_test(deflate_parallel_test, "DEFLATE PARALLEL");
+	nr_errors += behavioural_test(deflate_stream_test, "DEFLATE STREAM");
+	nr_errors += behavioural_test(deflate_uncompress_stream_test, "DEFLATE UNCOMPRESS STREAM");
+	nr_errors += behavioural_test(into_test, "CALLER BUFFERS");
+	nr_errors += behavioural_test(corrupted_test, "CORRUPTED INPUTS");
+	test_inputs_free();
+
+	return nr_errors ? 1 : 0;
 }
\ No newline at end of file
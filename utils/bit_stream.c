@@ -8,139 +8,145 @@
 
 #define GROW_SIZE		64
 
-#define read_bit(bs, i)		(((bs)->buf[(bs)->byte_offset] >> (i)) & 0x01)
-#define set_bit(bs, i)		((bs)->buf[(bs)->byte_offset] |= 0x01 << (i))
-#define clear_bit(bs, i)	((bs)->buf[(bs)->byte_offset] &= ~(0x01 << (i)))
-
 /**
  * @brief Grow a bit stream.
  * 
- * @param bs 	bit stream
+ * @param bs 		bit stream
+ * @param nr_bytes	minimum number of bytes needed after current byte position
+ * 
+ * @return 1 if stream was grown, 0 if it is fixed
  */
-static void __bit_stream_grow(struct bit_stream *bs)
+int bit_stream_grow(struct bit_stream *bs, uint32_t nr_bytes)
 {
-	bs->capacity = bs->byte_offset + GROW_SIZE;
+	uint32_t capacity;
+
+	/* caller buffer can't grow */
+	if (bs->fixed)
+		return 0;
+
+	/* double capacity (at least GROW_SIZE bytes after needed ones) */
+	capacity = bs->byte_offset + nr_bytes + GROW_SIZE;
+	if (capacity < bs->capacity * 2)
+		capacity = bs->capacity * 2;
+
+	bs->capacity = capacity;
 	bs->buf = (uint8_t *) xrealloc(bs->buf, bs->capacity);
+
+	return 1;
 }
 
 /**
- * @brief Write bits.
+ * @brief Write bits (Least Significant first) byte by byte, at the end of a fixed stream.
+ * 
+ * Bytes past capacity are dropped but position still moves : final position is the needed length.
  * 
  * @param bs 		bit stream
  * @param value 	value
  * @param nr_bits	number of bits to write
- * @param bit_order	bit order (Least Significant first or Most Significant first)
  */
-void bit_stream_write_bits(struct bit_stream *bs, uint32_t value, int nr_bits, int bit_order)
+void bit_stream_write_bits_tail(struct bit_stream *bs, uint64_t value, int nr_bits)
 {
-	int start, end, step, i;
-
-	/* number of bits must be <= 32 */
-	assert(nr_bits <= 32);
-
-	/* bit offset must be < 8 */
-	assert(bs->bit_offset < 8);
-
-	/* check bit order */
-	assert(bit_order == BIT_ORDER_LSB || bit_order == BIT_ORDER_MSB);
-
-	/* check number of bits */
-	if (nr_bits <= 0)
-		return;
-
-	/* choose bit order */
-	if (bit_order == BIT_ORDER_LSB) {
-		start = 0;
-		end = nr_bits;
-		step = 1;
-	} else {
-		start = nr_bits - 1;
-		end = -1;
-		step = -1;
-	}
-
-	/* write each bit */
-	for (i = start; i != end; i += step) {
-		/* grow bit stream if needed */
-		if (bs->byte_offset >= bs->capacity)
-			__bit_stream_grow(bs);
-
-		/* write next bit */
-		if ((value >> i) & 0x01)
-			set_bit(bs, bs->bit_offset);
-		else
-			clear_bit(bs, bs->bit_offset);
-
-		/* go to next byte if needed */
-		if (++bs->bit_offset == 8) {
-			bs->byte_offset++;
-			bs->bit_offset = 0;
-		}
+	int n;
+
+	for (; nr_bits > 0; nr_bits -= n, value >>= n) {
+		/* fill current byte (dropped past capacity) */
+		n = 8 - (int) bs->bit_offset;
+		if (n > nr_bits)
+			n = nr_bits;
+
+		if (bs->byte_offset < bs->capacity)
+			bs->buf[bs->byte_offset] = (bs->buf[bs->byte_offset] & ((1 << bs->bit_offset) - 1))
+						 | ((value & ((1 << n) - 1)) << bs->bit_offset);
+
+		/* update position */
+		bs->bit_offset += n;
+		bs->byte_offset += bs->bit_offset >> 3;
+		bs->bit_offset &= 0x07;
 	}
 }
 
 /**
- * @brief Read bits.
+ * @brief Refill read bit buffer from the last bytes of the stream (bytes after capacity are read as zeros).
  * 
  * @param bs 		bit stream
- * @param nr_bits 	number of bits to read
- * @param bit_order	bit order (Least Significant first or Most Significant first)
- * 
- * @return value
  */
-uint32_t bit_stream_read_bits(struct bit_stream *bs, int nr_bits, int bit_order)
+void bit_stream_refill_tail(struct bit_stream *bs)
 {
-	int start, end, step, i;
-	uint32_t value = 0;
-
-	/* number of bits must be <= 32 */
-	assert(nr_bits <= 32);
-
-	/* bit offset must be < 8 */
-	assert(bs->bit_offset < 8);
-
-	/* check bit order */
-	assert(bit_order == BIT_ORDER_LSB || bit_order == BIT_ORDER_MSB);
-	
-	/* check number of bits */
-	if (nr_bits <= 0)
-		return value;
-
-	/* choose bit order */
-	if (bit_order == BIT_ORDER_LSB) {
-		start = 0;
-		end = nr_bits;
-		step = 1;
-	} else {
-		start = nr_bits - 1;
-		end = -1;
-		step = -1;
-	}
-
-	/* read each bit */
-	for (i = start; i != end; i += step) {
-		/* read next bit */
-		value |= read_bit(bs, bs->bit_offset) << i;
+	while (bs->bit_count <= 56) {
+		/* past the end : pad with zeros */
+		if (bs->byte_offset < bs->capacity)
+			bs->bit_buf |= (uint64_t) bs->buf[bs->byte_offset] << bs->bit_count;
 
-		/* go to next byte if needed */
-		if (++bs->bit_offset == 8) {
-			bs->byte_offset++;
-			bs->bit_offset = 0;
-		}
+		bs->byte_offset++;
+		bs->bit_count += 8;
 	}
-
-	return value;
 }
 
 /**
- * @brief Flush last byte.
+ * @brief Flush last byte (write) or skip remaining bits of current byte (read).
  * 
  * @param bs 		bit stream
  */
 void bit_stream_flush(struct bit_stream *bs)
 {
+	/* read : skip remaining bits of current byte */
+	bs->bit_buf >>= bs->bit_count & 0x07;
+	bs->bit_count &= ~0x07;
+
+	/* write : go to next byte */
 	if (bs->bit_offset) {
 		bs->byte_offset++;
 		bs->bit_offset = 0;
 	}
 }
+
+/**
+ * @brief Write bytes (stream must be on a byte boundary, bytes past a fixed stream capacity are dropped).
+ * 
+ * @param bs 		bit stream
+ * @param buf 		bytes to write
+ * @param len 		number of bytes
+ */
+void bit_stream_write_bytes(struct bit_stream *bs, uint8_t *buf, uint32_t len)
+{
+	uint32_t n = len;
+
+	assert(bs->bit_offset == 0);
+
+	if (!len)
+		return;
+
+	/* fixed stream : copy bytes which fit */
+	if (bs->byte_offset + len > bs->capacity && !bit_stream_grow(bs, len))
+		n = bs->byte_offset < bs->capacity ? bs->capacity - bs->byte_offset : 0;
+
+	if (n)
+		memcpy(bs->buf + bs->byte_offset, buf, n);
+	bs->byte_offset += len;
+}
+
+/**
+ * @brief Read bytes (stream must be on a byte boundary, bytes after capacity are read as zeros).
+ * 
+ * @param bs 		bit stream
+ * @param buf 		output bytes
+ * @param len 		number of bytes
+ */
+void bit_stream_read_bytes(struct bit_stream *bs, uint8_t *buf, uint32_t len)
+{
+	uint32_t n = 0;
+
+	assert((bs->bit_count & 0x07) == 0);
+
+	/* drop read bit buffer (go back to first unread byte) */
+	bs->byte_offset -= bs->bit_count >> 3;
+	bs->bit_buf = 0;
+	bs->bit_count = 0;
+
+	/* copy bytes */
+	if (bs->byte_offset < bs->capacity)
+		n = len < bs->capacity - bs->byte_offset ? len : bs->capacity - bs->byte_offset;
+	memcpy(buf, bs->buf + bs->byte_offset, n);
+	memset(buf + n, 0, len - n);
+	bs->byte_offset += len;
+}
@@ -3,6 +3,9 @@
 
 #include <stdio.h>
 #include <stdint.h>
+#include <string.h>
+#include <endian.h>
+#include <assert.h>
 
 #define BIT_ORDER_MSB		1
 #define BIT_ORDER_LSB		2
@@ -15,8 +18,108 @@ struct bit_stream {
 	uint32_t 		capacity;		/* capacity */
 	uint32_t 		byte_offset;		/* current byte position */
 	uint32_t 		bit_offset;		/* current bit position (in last byte) */
+	uint64_t		bit_buf;		/* read bit buffer (next bits in stream order) */
+	uint32_t		bit_count;		/* number of bits in read bit buffer */
+	int			fixed;			/* caller buffer : never grown, bytes past capacity are only counted */
 };
 
+/**
+ * @brief Grow a bit stream.
+ * 
+ * @param bs 		bit stream
+ * @param nr_bytes	minimum number of bytes needed after current byte position
+ * 
+ * @return 1 if stream was grown, 0 if it is fixed
+ */
+int bit_stream_grow(struct bit_stream *bs, uint32_t nr_bytes);
+
+/**
+ * @brief Write bits (Least Significant first) byte by byte, at the end of a fixed stream.
+ * 
+ * @param bs 		bit stream
+ * @param value 	value
+ * @param nr_bits	number of bits to write
+ */
+void bit_stream_write_bits_tail(struct bit_stream *bs, uint64_t value, int nr_bits);
+
+/**
+ * @brief Refill read bit buffer from the last bytes of the stream (bytes after capacity are read as zeros).
+ * 
+ * @param bs 		bit stream
+ */
+void bit_stream_refill_tail(struct bit_stream *bs);
+
+/**
+ * @brief Reverse bits of a value.
+ * 
+ * @param value 	value
+ * @param nr_bits 	number of bits to reverse
+ * 
+ * @return reversed value
+ */
+static inline uint32_t bit_stream_reverse_bits(uint32_t value, int nr_bits)
+{
+	if (nr_bits <= 0)
+		return 0;
+
+	/* swap bits, pairs, nibbles and then bytes */
+	value = ((value >> 1) & 0x55555555) | ((value & 0x55555555) << 1);
+	value = ((value >> 2) & 0x33333333) | ((value & 0x33333333) << 2);
+	value = ((value >> 4) & 0x0F0F0F0F) | ((value & 0x0F0F0F0F) << 4);
+	value = __builtin_bswap32(value);
+
+	return value >> (32 - nr_bits);
+}
+
+/**
+ * @brief Write bits (Least Significant first).
+ * 
+ * The 64 bits word at current byte position is used as accumulator : pending bits of current
+ * byte are merged with the new value and the whole word is written back at once.
+ * 
+ * @param bs 		bit stream
+ * @param value 	value
+ * @param nr_bits	number of bits to write (<= 56)
+ */
+static inline void bit_stream_write_bits_lsb(struct bit_stream *bs, uint64_t value, int nr_bits)
+{
+	uint64_t word;
+
+	/* number of bits must be <= 56 and bit offset must be < 8 */
+	assert(nr_bits <= 56);
+	assert(bs->bit_offset < 8);
+
+	/* make sure a whole word can be written at current position (end of a fixed stream : write byte by byte) */
+	if (bs->byte_offset + sizeof(uint64_t) > bs->capacity && !bit_stream_grow(bs, sizeof(uint64_t))) {
+		bit_stream_write_bits_tail(bs, value, nr_bits);
+		return;
+	}
+
+	/* merge value with pending bits of current byte */
+	memcpy(&word, bs->buf + bs->byte_offset, sizeof(uint64_t));
+	word = le64toh(word) & ((1ULL << bs->bit_offset) - 1);
+	word |= (value & ((1ULL << nr_bits) - 1)) << bs->bit_offset;
+	word = htole64(word);
+	memcpy(bs->buf + bs->byte_offset, &word, sizeof(uint64_t));
+
+	/* update position */
+	bs->bit_offset += nr_bits;
+	bs->byte_offset += bs->bit_offset >> 3;
+	bs->bit_offset &= 0x07;
+}
+
+/**
+ * @brief Write bits (Most Significant first).
+ * 
+ * @param bs 		bit stream
+ * @param value 	value
+ * @param nr_bits	number of bits to write
+ */
+static inline void bit_stream_write_bits_msb(struct bit_stream *bs, uint32_t value, int nr_bits)
+{
+	bit_stream_write_bits_lsb(bs, bit_stream_reverse_bits(value, nr_bits), nr_bits);
+}
+
 /**
  * @brief Write bits.
  * 
@@ -25,7 +128,117 @@ struct bit_stream {
  * @param nr_bits	number of bits to write
  * @param bit_order	bit order (Least Significant first or Most Significant first)
  */
-void bit_stream_write_bits(struct bit_stream *bs, uint32_t value, int nr_bits, int bit_order);
+static inline void bit_stream_write_bits(struct bit_stream *bs, uint32_t value, int nr_bits, int bit_order)
+{
+	/* check bit order */
+	assert(bit_order == BIT_ORDER_LSB || bit_order == BIT_ORDER_MSB);
+
+	/* check number of bits */
+	if (nr_bits <= 0)
+		return;
+
+	if (bit_order == BIT_ORDER_LSB)
+		bit_stream_write_bits_lsb(bs, value, nr_bits);
+	else
+		bit_stream_write_bits_msb(bs, value, nr_bits);
+}
+
+/**
+ * @brief Refill read bit buffer (at least 57 bits are available after a refill).
+ * 
+ * @param bs 		bit stream
+ */
+static inline void bit_stream_refill(struct bit_stream *bs)
+{
+	uint64_t word;
+
+	/* end of stream : refill byte by byte */
+	if (bs->byte_offset + sizeof(uint64_t) > bs->capacity) {
+		bit_stream_refill_tail(bs);
+		return;
+	}
+
+	/* load a whole word and keep as many full bytes as possible */
+	memcpy(&word, bs->buf + bs->byte_offset, sizeof(uint64_t));
+	bs->bit_buf |= le64toh(word) << bs->bit_count;
+	bs->byte_offset += (63 - bs->bit_count) >> 3;
+	bs->bit_count |= 56;
+}
+
+/**
+ * @brief Peek bits (Least Significant first) without consuming them.
+ * 
+ * @param bs 		bit stream
+ * @param nr_bits 	number of bits to peek (<= 32)
+ * 
+ * @return value
+ */
+static inline uint32_t bit_stream_peek_bits_lsb(struct bit_stream *bs, int nr_bits)
+{
+	assert(nr_bits <= 32);
+
+	if (bs->bit_count < (uint32_t) nr_bits)
+		bit_stream_refill(bs);
+
+	return bs->bit_buf & ((1ULL << nr_bits) - 1);
+}
+
+/**
+ * @brief Peek bits (Most Significant first) without consuming them.
+ * 
+ * @param bs 		bit stream
+ * @param nr_bits 	number of bits to peek (<= 32)
+ * 
+ * @return value
+ */
+static inline uint32_t bit_stream_peek_bits_msb(struct bit_stream *bs, int nr_bits)
+{
+	return bit_stream_reverse_bits(bit_stream_peek_bits_lsb(bs, nr_bits), nr_bits);
+}
+
+/**
+ * @brief Consume bits (bits must have been peeked before).
+ * 
+ * @param bs 		bit stream
+ * @param nr_bits 	number of bits to consume
+ */
+static inline void bit_stream_consume_bits(struct bit_stream *bs, int nr_bits)
+{
+	assert((uint32_t) nr_bits <= bs->bit_count);
+
+	bs->bit_buf >>= nr_bits;
+	bs->bit_count -= nr_bits;
+}
+
+/**
+ * @brief Read bits (Least Significant first).
+ * 
+ * @param bs 		bit stream
+ * @param nr_bits 	number of bits to read (<= 32)
+ * 
+ * @return value
+ */
+static inline uint32_t bit_stream_read_bits_lsb(struct bit_stream *bs, int nr_bits)
+{
+	uint32_t value = bit_stream_peek_bits_lsb(bs, nr_bits);
+	bit_stream_consume_bits(bs, nr_bits);
+	return value;
+}
+
+/**
+ * @brief Read bits (Most Significant first).
+ * 
+ * @param bs 		bit stream
+ * @param nr_bits 	number of bits to read (<= 32)
+ * 
+ * @return value
+ */
+static inline uint32_t bit_stream_read_bits_msb(struct bit_stream *bs, int nr_bits)
+{
+	uint32_t value = bit_stream_peek_bits_msb(bs, nr_bits);
+	bit_stream_consume_bits(bs, nr_bits);
+	return value;
+}
 
 /**
  * @brief Read bits.
@@ -36,13 +249,56 @@ void bit_stream_write_bits(struct bit_stream *bs, uint32_t value, int nr_bits, i
  * 
  * @return value
  */
-uint32_t bit_stream_read_bits(struct bit_stream *bs, int nr_bits, int bit_order);
+static inline uint32_t bit_stream_read_bits(struct bit_stream *bs, int nr_bits, int bit_order)
+{
+	/* check bit order */
+	assert(bit_order == BIT_ORDER_LSB || bit_order == BIT_ORDER_MSB);
+
+	/* check number of bits */
+	if (nr_bits <= 0)
+		return 0;
+
+	if (bit_order == BIT_ORDER_LSB)
+		return bit_stream_read_bits_lsb(bs, nr_bits);
+
+	return bit_stream_read_bits_msb(bs, nr_bits);
+}
 
 /**
- * @brief Flush last byte.
+ * @brief Get read position (in bits).
+ * 
+ * @param bs 		bit stream
+ * 
+ * @return number of bits read (more than capacity if bits past the end of the stream were read)
+ */
+static inline uint64_t bit_stream_read_pos(struct bit_stream *bs)
+{
+	return (uint64_t) bs->byte_offset * 8 - bs->bit_count;
+}
+
+/**
+ * @brief Flush last byte (write) or skip remaining bits of current byte (read).
  * 
  * @param bs 		bit stream
  */
 void bit_stream_flush(struct bit_stream *bs);
 
+/**
+ * @brief Write bytes (stream must be on a byte boundary, bytes past a fixed stream capacity are dropped).
+ * 
+ * @param bs 		bit stream
+ * @param buf 		bytes to write
+ * @param len 		number of bytes
+ */
+void bit_stream_write_bytes(struct bit_stream *bs, uint8_t *buf, uint32_t len);
+
+/**
+ * @brief Read bytes (stream must be on a byte boundary, bytes after capacity are read as zeros).
+ * 
+ * @param bs 		bit stream
+ * @param buf 		output bytes
+ * @param len 		number of bytes
+ */
+void bit_stream_read_bytes(struct bit_stream *bs, uint8_t *buf, uint32_t len);
+
 #endif
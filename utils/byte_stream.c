@@ -5,18 +5,32 @@
 #include "mem.h"
 
 #define MIN_GROW_SIZE		64
-#define MAX(x, y)		((x) > (y) ? (x) : (y))
 
 /**
  * @brief Grow a byte stream.
  * 
  * @param bs 		bit stream
  * @param nr_bytes	number of bytes to grow
+ * 
+ * @return 1 if stream was grown, 0 if it is fixed
  */
-static void __byte_stream_grow(struct byte_stream *bs, uint32_t nr_bytes)
+static int __byte_stream_grow(struct byte_stream *bs, uint32_t nr_bytes)
 {
-	bs->capacity += MAX(nr_bytes, MIN_GROW_SIZE);
+	uint32_t capacity;
+
+	/* caller buffer can't grow */
+	if (bs->fixed)
+		return 0;
+
+	/* double capacity (at least MIN_GROW_SIZE bytes after needed ones) */
+	capacity = bs->capacity + nr_bytes + MIN_GROW_SIZE;
+	if (capacity < bs->capacity * 2)
+		capacity = bs->capacity * 2;
+
+	bs->capacity = capacity;
 	bs->buf = (uint8_t *) xrealloc(bs->buf, bs->capacity);
+
+	return 1;
 }
 
 /**
@@ -28,12 +42,15 @@ static void __byte_stream_grow(struct byte_stream *bs, uint32_t nr_bytes)
  */
 void byte_stream_write(struct byte_stream *bs, uint8_t *value, uint32_t nr_bytes)
 {
-	/* grow byte stream if needed */
-	if (bs->size + nr_bytes > bs->capacity)
-		__byte_stream_grow(bs, bs->size + nr_bytes - bs->capacity);
+	uint32_t n = nr_bytes;
+
+	/* grow byte stream if needed (fixed stream : copy bytes which fit) */
+	if (bs->size + nr_bytes > bs->capacity && !__byte_stream_grow(bs, bs->size + nr_bytes - bs->capacity))
+		n = bs->size < bs->capacity ? bs->capacity - bs->size : 0;
 
 	/* copy data */
-	memcpy(bs->buf + bs->size, value, nr_bytes);
+	if (n)
+		memcpy(bs->buf + bs->size, value, n);
 	bs->size += nr_bytes;
 }
 
@@ -45,9 +62,11 @@ void byte_stream_write(struct byte_stream *bs, uint8_t *value, uint32_t nr_bytes
  */
 void byte_stream_write_u8(struct byte_stream *bs, uint8_t value)
 {
-	/* grow byte stream if needed */
-	if (bs->size + sizeof(uint8_t) > bs->capacity)
-		__byte_stream_grow(bs, bs->size + sizeof(uint8_t) - bs->capacity);
+	/* end of stream : generic path */
+	if (bs->size + sizeof(uint8_t) > bs->capacity) {
+		byte_stream_write(bs, &value, sizeof(uint8_t));
+		return;
+	}
 
 	/* copy data */
 	bs->buf[bs->size++] = value;
@@ -61,11 +80,13 @@ void byte_stream_write_u8(struct byte_stream *bs, uint8_t value)
  */
 void byte_stream_write_u32(struct byte_stream *bs, uint32_t value)
 {
-	/* grow byte stream if needed */
-	if (bs->size + sizeof(uint32_t) > bs->capacity)
-		__byte_stream_grow(bs, bs->size + sizeof(uint32_t) - bs->capacity);
+	/* end of stream : generic path */
+	if (bs->size + sizeof(uint32_t) > bs->capacity) {
+		byte_stream_write(bs, (uint8_t *) &value, sizeof(uint32_t));
+		return;
+	}
 
 	/* copy data */
 	*((uint32_t *) (bs->buf + bs->size)) = value;
 	bs->size += sizeof(uint32_t);
-}
\ No newline at end of file
+}
@@ -11,10 +11,11 @@ struct byte_stream {
 	uint8_t *		buf;			/* data */
 	uint32_t 		capacity;		/* capacity */
 	uint32_t		size;			/* size */
+	int			fixed;			/* caller buffer : never grown, bytes past capacity are only counted */
 };
 
 /**
- * @brief Write bytes.
+ * @brief Write bytes (bytes past a fixed stream capacity are dropped).
  * 
  * @param bs 		byte stream
  * @param value 	value
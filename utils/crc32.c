@@ -0,0 +1,327 @@
+/*
+ * CRC-32 (reflected polynomial 0xEDB88320, as in gzip/zlib) :
+ * - slice-by-8/16 : 8 or 16 input bytes are processed per step with one table lookup per byte,
+ *   table k giving CRC contribution of a byte followed by k zero bytes
+ * - PCLMULQDQ : 64 bytes blocks are folded with carry-less multiplications by x^n modulo polynomial,
+ *   remaining 128 bits are then reduced to 32 bits (Barrett reduction)
+ * 
+ * Best implementation is chosen once, at first call, with CPU feature detection.
+ */
+#include <string.h>
+#include <endian.h>
+#include <pthread.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define CRC32_PCLMUL
+#endif
+
+#include "crc32.h"
+
+#define CRC32_POLY		0xEDB88320
+#define CRC32_PCLMUL_MIN_LEN	64
+
+/* slice-by-16 tables (first 8 tables are slice-by-8 tables) */
+static uint32_t crc32_tables[16][256];
+
+/* best implementation */
+static uint32_t (*crc32_impl)(uint32_t, const uint8_t *, uint32_t);
+static pthread_once_t crc32_once = PTHREAD_ONCE_INIT;
+
+/**
+ * @brief Build CRC tables and choose best implementation.
+ */
+static void __crc32_init(void)
+{
+	uint32_t crc, i, j;
+
+	/* table 0 = CRC of each byte */
+	for (i = 0; i < 256; i++) {
+		for (j = 0, crc = i; j < 8; j++)
+			crc = crc & 1 ? (crc >> 1) ^ CRC32_POLY : crc >> 1;
+		crc32_tables[0][i] = crc;
+	}
+
+	/* table k = CRC of each byte followed by k zero bytes */
+	for (i = 0; i < 256; i++)
+		for (j = 1; j < 16; j++)
+			crc32_tables[j][i] = (crc32_tables[j - 1][i] >> 8) ^ crc32_tables[0][crc32_tables[j - 1][i] & 0xFF];
+
+	/* choose implementation */
+	crc32_impl = crc32_pclmul_supported() ? crc32_pclmul : crc32_slice16;
+}
+
+/**
+ * @brief Read a little endian 32 bits word.
+ * 
+ * @param buf 		input buffer
+ * 
+ * @return word
+ */
+static inline uint32_t __crc32_read_le32(const uint8_t *buf)
+{
+	uint32_t word;
+
+	memcpy(&word, buf, sizeof(uint32_t));
+	return le32toh(word);
+}
+
+/**
+ * @brief Update CRC byte by byte.
+ * 
+ * @param crc 		current CRC register (inverted CRC)
+ * @param buf 		input buffer
+ * @param len 		input buffer length
+ * 
+ * @return CRC register
+ */
+static inline uint32_t __crc32_bytes(uint32_t crc, const uint8_t *buf, uint32_t len)
+{
+	while (len--)
+		crc = crc32_tables[0][(crc ^ *buf++) & 0xFF] ^ (crc >> 8);
+
+	return crc;
+}
+
+/**
+ * @brief Update CRC-32 of a buffer with slice-by-8 tables.
+ * 
+ * @param crc 		CRC of previous data (0 for first buffer)
+ * @param buf 		input buffer
+ * @param len 		input buffer length
+ * 
+ * @return CRC of previous data and this buffer
+ */
+uint32_t crc32_slice8(uint32_t crc, const uint8_t *buf, uint32_t len)
+{
+	uint32_t a, b;
+
+	pthread_once(&crc32_once, __crc32_init);
+	crc = ~crc;
+
+	for (; len >= 8; buf += 8, len -= 8) {
+		a = __crc32_read_le32(buf) ^ crc;
+		b = __crc32_read_le32(buf + 4);
+		crc = crc32_tables[7][a & 0xFF] ^ crc32_tables[6][(a >> 8) & 0xFF]
+		      ^ crc32_tables[5][(a >> 16) & 0xFF] ^ crc32_tables[4][a >> 24]
+		      ^ crc32_tables[3][b & 0xFF] ^ crc32_tables[2][(b >> 8) & 0xFF]
+		      ^ crc32_tables[1][(b >> 16) & 0xFF] ^ crc32_tables[0][b >> 24];
+	}
+
+	return ~__crc32_bytes(crc, buf, len);
+}
+
+/**
+ * @brief Update CRC-32 of a buffer with slice-by-16 tables.
+ * 
+ * @param crc 		CRC of previous data (0 for first buffer)
+ * @param buf 		input buffer
+ * @param len 		input buffer length
+ * 
+ * @return CRC of previous data and this buffer
+ */
+uint32_t crc32_slice16(uint32_t crc, const uint8_t *buf, uint32_t len)
+{
+	uint32_t a, b, c, d;
+
+	pthread_once(&crc32_once, __crc32_init);
+	crc = ~crc;
+
+	for (; len >= 16; buf += 16, len -= 16) {
+		a = __crc32_read_le32(buf) ^ crc;
+		b = __crc32_read_le32(buf + 4);
+		c = __crc32_read_le32(buf + 8);
+		d = __crc32_read_le32(buf + 12);
+		crc = crc32_tables[15][a & 0xFF] ^ crc32_tables[14][(a >> 8) & 0xFF]
+		      ^ crc32_tables[13][(a >> 16) & 0xFF] ^ crc32_tables[12][a >> 24]
+		      ^ crc32_tables[11][b & 0xFF] ^ crc32_tables[10][(b >> 8) & 0xFF]
+		      ^ crc32_tables[9][(b >> 16) & 0xFF] ^ crc32_tables[8][b >> 24]
+		      ^ crc32_tables[7][c & 0xFF] ^ crc32_tables[6][(c >> 8) & 0xFF]
+		      ^ crc32_tables[5][(c >> 16) & 0xFF] ^ crc32_tables[4][c >> 24]
+		      ^ crc32_tables[3][d & 0xFF] ^ crc32_tables[2][(d >> 8) & 0xFF]
+		      ^ crc32_tables[1][(d >> 16) & 0xFF] ^ crc32_tables[0][d >> 24];
+	}
+
+	return ~__crc32_bytes(crc, buf, len);
+}
+
+#ifdef CRC32_PCLMUL
+/**
+ * @brief Fold 64 bytes blocks with carry-less multiplications (see Intel "Fast CRC Computation for
+ * Generic Polynomials Using PCLMULQDQ Instruction").
+ * 
+ * @param crc 		current CRC register (inverted CRC)
+ * @param buf 		input buffer
+ * @param len 		input buffer length (multiple of 16, at least 64)
+ * 
+ * @return CRC register
+ */
+__attribute__((target("pclmul,sse2")))
+static uint32_t __crc32_fold(uint32_t crc, const uint8_t *buf, uint32_t len)
+{
+	/* x^n modulo polynomial constants (bit reflected) and Barrett reduction constants */
+	const __m128i k1k2 = _mm_set_epi64x(0x01c6e41596, 0x0154442bd4);
+	const __m128i k3k4 = _mm_set_epi64x(0x00ccaa009e, 0x01751997d0);
+	const __m128i k5k0 = _mm_set_epi64x(0x0000000000, 0x0163cd6124);
+	const __m128i poly = _mm_set_epi64x(0x01f7011641, 0x01db710641);
+	const __m128i mask32 = _mm_setr_epi32(~0, 0, ~0, 0);
+	__m128i x1, x2, x3, x4, x5, x6, x7, x8;
+
+	/* load first block and add CRC */
+	x1 = _mm_xor_si128(_mm_loadu_si128((const __m128i *) buf), _mm_cvtsi32_si128(crc));
+	x2 = _mm_loadu_si128((const __m128i *) (buf + 16));
+	x3 = _mm_loadu_si128((const __m128i *) (buf + 32));
+	x4 = _mm_loadu_si128((const __m128i *) (buf + 48));
+	buf += 64;
+	len -= 64;
+
+	/* fold 4 x 128 bits over next 64 bytes */
+	for (; len >= 64; buf += 64, len -= 64) {
+		x5 = _mm_clmulepi64_si128(x1, k1k2, 0x00);
+		x6 = _mm_clmulepi64_si128(x2, k1k2, 0x00);
+		x7 = _mm_clmulepi64_si128(x3, k1k2, 0x00);
+		x8 = _mm_clmulepi64_si128(x4, k1k2, 0x00);
+		x1 = _mm_clmulepi64_si128(x1, k1k2, 0x11);
+		x2 = _mm_clmulepi64_si128(x2, k1k2, 0x11);
+		x3 = _mm_clmulepi64_si128(x3, k1k2, 0x11);
+		x4 = _mm_clmulepi64_si128(x4, k1k2, 0x11);
+		x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), _mm_loadu_si128((const __m128i *) buf));
+		x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), _mm_loadu_si128((const __m128i *) (buf + 16)));
+		x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), _mm_loadu_si128((const __m128i *) (buf + 32)));
+		x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), _mm_loadu_si128((const __m128i *) (buf + 48)));
+	}
+
+	/* fold 4 x 128 bits into 128 bits */
+	x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+	x1 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x1, k3k4, 0x11), x2), x5);
+	x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+	x1 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x1, k3k4, 0x11), x3), x5);
+	x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+	x1 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x1, k3k4, 0x11), x4), x5);
+
+	/* fold 128 bits over remaining 16 bytes blocks */
+	for (; len >= 16; buf += 16, len -= 16) {
+		x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+		x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+		x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), _mm_loadu_si128((const __m128i *) buf));
+	}
+
+	/* fold 128 bits into 64 bits */
+	x2 = _mm_clmulepi64_si128(x1, k3k4, 0x10);
+	x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), x2);
+	x2 = _mm_srli_si128(x1, 4);
+	x1 = _mm_and_si128(x1, mask32);
+	x1 = _mm_xor_si128(_mm_clmulepi64_si128(x1, k5k0, 0x00), x2);
+
+	/* Barrett reduction to 32 bits */
+	x2 = _mm_and_si128(x1, mask32);
+	x2 = _mm_clmulepi64_si128(x2, poly, 0x10);
+	x2 = _mm_and_si128(x2, mask32);
+	x2 = _mm_clmulepi64_si128(x2, poly, 0x00);
+	x1 = _mm_xor_si128(x1, x2);
+
+	return _mm_cvtsi128_si32(_mm_srli_si128(x1, 4));
+}
+#endif
+
+/**
+ * @brief Update CRC-32 of a buffer with carry-less multiplication folding (PCLMULQDQ).
+ * 
+ * Must only be called if crc32_pclmul_supported() is true.
+ * 
+ * @param crc 		CRC of previous data (0 for first buffer)
+ * @param buf 		input buffer
+ * @param len 		input buffer length
+ * 
+ * @return CRC of previous data and this buffer
+ */
+uint32_t crc32_pclmul(uint32_t crc, const uint8_t *buf, uint32_t len)
+{
+#ifdef CRC32_PCLMUL
+	uint32_t n;
+
+	/* short buffer : use tables */
+	if (len < CRC32_PCLMUL_MIN_LEN)
+		return crc32_slice16(crc, buf, len);
+
+	/* fold 16 bytes blocks, then finish with tables */
+	n = len & ~15U;
+	crc = ~__crc32_fold(~crc, buf, n);
+	return crc32_slice16(crc, buf + n, len - n);
+#else
+	return crc32_slice16(crc, buf, len);
+#endif
+}
+
+/**
+ * @brief Check if CPU supports carry-less multiplication.
+ * 
+ * @return 1 if supported, 0 otherwise
+ */
+int crc32_pclmul_supported(void)
+{
+#ifdef CRC32_PCLMUL
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("pclmul") && __builtin_cpu_supports("sse2");
+#else
+	return 0;
+#endif
+}
+
+/**
+ * @brief Update CRC-32 of a buffer (best implementation supported by CPU).
+ * 
+ * @param crc 		CRC of previous data (0 for first buffer)
+ * @param buf 		input buffer
+ * @param len 		input buffer length
+ * 
+ * @return CRC of previous data and this buffer
+ */
+uint32_t crc32_update(uint32_t crc, const uint8_t *buf, uint32_t len)
+{
+	pthread_once(&crc32_once, __crc32_init);
+	return crc32_impl(crc, buf, len);
+}
+
+/**
+ * @brief Multiply two polynomials modulo CRC polynomial (reflected bit order).
+ * 
+ * @param a 		first polynomial
+ * @param b 		second polynomial
+ * 
+ * @return a * b modulo CRC polynomial
+ */
+static uint32_t __crc32_multmodp(uint32_t a, uint32_t b)
+{
+	uint32_t m, p = 0;
+
+	for (m = 1U << 31; m; m >>= 1) {
+		if (a & m)
+			p ^= b;
+		b = b & 1 ? (b >> 1) ^ CRC32_POLY : b >> 1;
+	}
+
+	return p;
+}
+
+/**
+ * @brief Combine CRCs of two consecutive buffers.
+ * 
+ * @param crc1 		CRC of first buffer
+ * @param crc2 		CRC of second buffer
+ * @param len2 		second buffer length
+ * 
+ * @return CRC of both buffers
+ */
+uint32_t crc32_combine(uint32_t crc1, uint32_t crc2, uint32_t len2)
+{
+	uint32_t p = 1U << 31, sq = 1U << 23;
+
+	/* compute x^(8 * len2) modulo CRC polynomial (x^0 = bit 31, x^8 = bit 23) */
+	for (; len2; len2 >>= 1, sq = __crc32_multmodp(sq, sq))
+		if (len2 & 1)
+			p = __crc32_multmodp(sq, p);
+
+	/* shift first CRC over second buffer */
+	return __crc32_multmodp(p, crc1) ^ crc2;
+}
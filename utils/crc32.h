@@ -0,0 +1,70 @@
+#ifndef _CRC32_H_
+#define _CRC32_H_
+
+#include <stdint.h>
+
+/**
+ * @brief Update CRC-32 of a buffer (best implementation supported by CPU).
+ * 
+ * @param crc 		CRC of previous data (0 for first buffer)
+ * @param buf 		input buffer
+ * @param len 		input buffer length
+ * 
+ * @return CRC of previous data and this buffer
+ */
+uint32_t crc32_update(uint32_t crc, const uint8_t *buf, uint32_t len);
+
+/**
+ * @brief Update CRC-32 of a buffer with slice-by-8 tables.
+ * 
+ * @param crc 		CRC of previous data (0 for first buffer)
+ * @param buf 		input buffer
+ * @param len 		input buffer length
+ * 
+ * @return CRC of previous data and this buffer
+ */
+uint32_t crc32_slice8(uint32_t crc, const uint8_t *buf, uint32_t len);
+
+/**
+ * @brief Update CRC-32 of a buffer with slice-by-16 tables.
+ * 
+ * @param crc 		CRC of previous data (0 for first buffer)
+ * @param buf 		input buffer
+ * @param len 		input buffer length
+ * 
+ * @return CRC of previous data and this buffer
+ */
+uint32_t crc32_slice16(uint32_t crc, const uint8_t *buf, uint32_t len);
+
+/**
+ * @brief Update CRC-32 of a buffer with carry-less multiplication folding (PCLMULQDQ).
+ * 
+ * Must only be called if crc32_pclmul_supported() is true.
+ * 
+ * @param crc 		CRC of previous data (0 for first buffer)
+ * @param buf 		input buffer
+ * @param len 		input buffer length
+ * 
+ * @return CRC of previous data and this buffer
+ */
+uint32_t crc32_pclmul(uint32_t crc, const uint8_t *buf, uint32_t len);
+
+/**
+ * @brief Check if CPU supports carry-less multiplication.
+ * 
+ * @return 1 if supported, 0 otherwise
+ */
+int crc32_pclmul_supported(void);
+
+/**
+ * @brief Combine CRCs of two consecutive buffers.
+ * 
+ * @param crc1 		CRC of first buffer
+ * @param crc2 		CRC of second buffer
+ * @param len2 		second buffer length
+ * 
+ * @return CRC of both buffers
+ */
+uint32_t crc32_combine(uint32_t crc1, uint32_t crc2, uint32_t len2);
+
+#endif
@@ -0,0 +1,74 @@
+#ifndef _MATCH_COPY_H_
+#define _MATCH_COPY_H_
+
+#include <stdint.h>
+#include <string.h>
+
+#define MATCH_COPY_SLACK		32
+
+/**
+ * @brief Copy a match by chunks (chunks must not overlap : distance >= width).
+ *
+ * @param dst 		destination
+ * @param distance 	distance
+ * @param len 		length
+ * @param width 	chunk width (may write up to width - 1 bytes past length)
+ */
+static inline void __match_copy_chunks(uint8_t *dst, uint32_t distance, uint32_t len, uint32_t width)
+{
+	uint8_t *end = dst + len;
+
+	for (; dst < end; dst += width)
+		memcpy(dst, dst - distance, width);
+}
+
+/**
+ * @brief Copy a match (source and destination overlap if distance < length : pattern is repeated).
+ *
+ * Fast path copies 32, 16 or 8 bytes at a time and writes up to MATCH_COPY_SLACK bytes past the match : it is
+ * only used when they fit in the output buffer, otherwise the match is copied byte by byte.
+ *
+ * @param dst 		destination (current output position)
+ * @param distance 	distance (>= 1)
+ * @param len 		match length
+ * @param dst_end 	output buffer end
+ */
+static inline void match_copy(uint8_t *dst, uint32_t distance, uint32_t len, uint8_t *dst_end)
+{
+	uint8_t *src = dst - distance;
+	uint32_t period, i;
+
+	/* slow path : byte by byte */
+	if ((uint32_t) (dst_end - dst) < len + MATCH_COPY_SLACK) {
+		for (i = 0; i < len; i++)
+			dst[i] = src[i];
+		return;
+	}
+
+	/* no overlap within a chunk */
+	if (distance >= 32) {
+		__match_copy_chunks(dst, distance, len, 32);
+		return;
+	}
+	if (distance >= 16) {
+		__match_copy_chunks(dst, distance, len, 16);
+		return;
+	}
+
+	/* short distance : expand pattern to a period of at least 8 bytes (output repeats every distance bytes) */
+	if (distance < 8) {
+		period = distance * ((8 + distance - 1) / distance);
+		for (i = 0; i < period; i++)
+			dst[i] = src[i];
+		if (period >= len)
+			return;
+
+		dst += period;
+		len -= period;
+		distance = period;
+	}
+
+	__match_copy_chunks(dst, distance, len, 8);
+}
+
+#endif